@@ -5,15 +5,21 @@
 * Compile with MEX to use as MATLAB interface for Persistence1D class.
 * Tested on 32-bits only, MATLAB 2011b and above. 
 * 
-* Usage: [MinIndices MaxIndices Persistence GlobalMinIdx GlobalMinVal] = run_persistence1d(single(data))
+* Usage: [MinIndices MaxIndices Persistence GlobalMinIdx GlobalMinVal] = run_persistence1d(single(data) [, threshold [, topK]])
 *
-* Supports input in single format. Output is INT32 and SINGLE.
+* Supports input in single format. Output is SINGLE.
 *
-* To see output messages in Matlab, uncomment line 38 before compilation.
+* Input data is read in place from the Matlab matrix, without copying it, and results are written directly 
+* into the output matrices. The computation itself lives in run_persistence1d_adapter.hpp,
+* which does not depend on Matlab.
+*
+* To see output messages in Matlab, uncomment line 47 before compilation.
 *	
 * @param[in] data                   A vector of data, sorted according to coordinates. 
 *       							This should contain only data values to be sorted. 
 *               					Assumes the data is one dimensional. 
+* @param[in] threshold				[Optional] Only pairs whose persistence is greater than or equal to threshold are returned.
+* @param[in] topK					[Optional] Only the topK most persistent pairs are returned. 0 returns all pairs.
 *
 * @param[out] MinIndices			Vector of (Matlab compatible) indices of local maxima.
 * @param[out] MaxIndices			Vector of (Matlab compatible) indices of local minima.
@@ -26,11 +32,13 @@
 
 #include <matrix.h>
 #include <mex.h>
+#include <math.h>
 #include <algorithm>
 #include <vector>
-#include "..\src\persistence1d\persistence1d.hpp"
+#include "run_persistence1d_adapter.hpp"
 
-#define NUM_INPUT_VARIABLES 1
+#define MIN_INPUT_VARIABLES 1
+#define MAX_INPUT_VARIABLES 3
 #define NUM_OUTPUT_VARIABLES 5
 #define MATLAB_INDEXING true
 #define NO_FILTERING 0.0
@@ -41,16 +49,13 @@
 using namespace p1d;
 using namespace std;
 
-bool MxFloatArrayToFloatVector(const mxArray * input, std::vector<float> & data);
-mxArray * VectorToMxSingleArray(const std::vector<float> data);
-mxArray * VectorToMxSingleArray(const std::vector<int> data);
-mxArray * VectorToMxSingleArray(const std::vector<TPairedExtrema> data);
+mxArray * CreateMxSingleArray(const size_t size);
 mxArray * ScalarToMxSingleArray(const float data);
 mxArray * ScalarToMxSingleArray(const int data);
 
 bool CheckInput(const int nOuts, mxArray *outs[], const int nIns, const mxArray *ins[]);
-void WriteVectorToMexOutput(const std::vector<float> data);
-void WriteInputToVector(const mxArray *prhs[], std::vector<float> & data);
+bool GetOptionalScalar(const int nIns, const mxArray *ins[], const int position, double & value);
+void WriteDataToMexOutput(const float * data, const size_t size);
 
 /*!
 	Main MATLAB interface
@@ -62,58 +67,53 @@ void WriteInputToVector(const mxArray *prhs[], std::vector<float> & data);
 */
 void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
 {
-	//persistence and data variables
-	Persistence1D p;
-	std::vector<float> data; 
+	Persistence1DAdapter p;
+	double threshold = NO_FILTERING;
+	double topK = 0;
 
-	//Variables to store persistence results
-	std::vector<int> minIndices; 
-	std::vector<int> maxIndices; 
-	std::vector<TPairedExtrema> pairs;
-	float gminValue;
-	int gminIndex;
-	
-	//Assumption: Vector data lives in phrs[0]
+	//Assumption: Vector data lives in phrs[0], optional threshold and topK in prhs[1] and prhs[2].
 	//Any deviation from this is not tolerated.
 
 	//prhs - right hand - input - MATLAB standard naming convention
 	//plhs - left hand - output
 	if (!CheckInput(nlhs, plhs, nrhs, prhs)) return;
+	if (!GetOptionalScalar(nrhs, prhs, 1, threshold) || !GetOptionalScalar(nrhs, prhs, 2, topK)) return;
+	if (topK != floor(topK))
+	{
+		mexPrintf("\nExpecting topK to be an integer");
+		return;
+	}
+
+	const float * data = (const float *)mxGetData(prhs[0]);
+	size_t size = mxGetNumberOfElements(prhs[0]);
+
+	//there are fewer pairs than data values, so a larger topK (including Inf) returns all pairs, and fits in a size_t
+	if (topK > (double)size) topK = (double)size;
 
 #ifdef _DEBUG	
-    mexPrintf("Copying input data...\n");
-#endif
-	WriteInputToVector(prhs, data);
-	
-#ifdef _DEBUG
-	WriteVectorToMexOutput(data);
+	WriteDataToMexOutput(data, size);
 #endif
 	
 #ifdef _DEBUG
     mexPrintf("Running Persistence1D...\n");
 #endif
-	p.RunPersistence(data);
+	p.Run(data, size, (float)threshold);
 
 #ifdef _DEBUG
     mexPrintf("Done.\n");
-	mexPrintf("Getting results...\n");
-#endif
-
-    p.GetPairedExtrema(pairs, NO_FILTERING , MATLAB_INDEXING);
-    gminIndex = p.GetGlobalMinimumIndex(MATLAB_INDEXING);
-	gminValue = p.GetGlobalMinimumValue();
-	p.GetExtremaIndices(minIndices, maxIndices, NO_FILTERING, MATLAB_INDEXING);
-
-#ifdef _DEBUG
-	mexPrintf("Done.\n");
 	mexPrintf("Writing results to MATLAB...\n");
 #endif
     	
-	plhs[0] = VectorToMxSingleArray(minIndices);
-	plhs[1] = VectorToMxSingleArray(maxIndices);
-	plhs[2] = VectorToMxSingleArray(pairs);
-	plhs[3] = ScalarToMxSingleArray(gminIndex);
-	plhs[4] = ScalarToMxSingleArray(gminValue);
+	size_t numResults = p.GetNumberOfResults((size_t)topK);
+	plhs[0] = CreateMxSingleArray(numResults);
+	plhs[1] = CreateMxSingleArray(numResults);
+	plhs[2] = CreateMxSingleArray(numResults);
+
+	p.WriteResults((float *)mxGetData(plhs[0]), (float *)mxGetData(plhs[1]), (float *)mxGetData(plhs[2]),
+				   (size_t)topK, MATLAB_INDEXING);
+
+	plhs[3] = ScalarToMxSingleArray(p.GetGlobalMinimumIndex(MATLAB_INDEXING));
+	plhs[4] = ScalarToMxSingleArray(p.GetGlobalMinimumValue());
 
 #ifdef _DEBUG	
 	mexPrintf("Done.\n");
@@ -122,30 +122,15 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
 }
 
 /*!
-	Fills a given float data vector with values from float mxArray. 
-	Warning - does not check if mxArray format is single.
+	Creates a 1-d Single-Type MATLAB matrix. Its data is written by Persistence1DAdapter::WriteResults.
+
+	@param[in] size		Number of elements.
 */
-bool MxFloatArrayToFloatVector(const mxArray * input, std::vector<float> & data)
+mxArray * CreateMxSingleArray(const size_t size)
 {
-	if (mxGetClassID(input) != mxSINGLE_CLASS)
-	{
-		mexPrintf ("Error. Expecting SINGLE value matrix");
-		return false; 
-	}
-
-	mwSize numElements = mxGetNumberOfElements(input);
-	float *inputPt;
-	inputPt = (float *)mxGetData(input);
-	
-	data.reserve(numElements);
-	
-	for (int i = 0; i < numElements; i++)
-	{
-		data.push_back((float)*inputPt++);
-	}
-
-	return true;
+	return mxCreateNumericMatrix(size, 1, mxSINGLE_CLASS, mxREAL);
 }
+
 /*!
 	Creates a 1x1 Single Type Matlab matrix from a single float value.
 */
@@ -162,68 +147,16 @@ mxArray * ScalarToMxSingleArray(const int data)
 	return ScalarToMxSingleArray((float)data);
 }
 
-/*!
-	Copies vector<float> data to 1-d MATLAB matrix
-
-	@param[in] data A vector of float to copy.
-*/
-mxArray * VectorToMxSingleArray(const std::vector<float> data)
-{
-	mxArray * out = mxCreateNumericMatrix(data.size(), 1, mxSINGLE_CLASS, mxREAL);
-	float * mPt = (float *)mxGetData(out);
-
-	for (std::vector<float>::const_iterator pt = data.begin();
-		pt != data.end(); pt++)
-	{
-		*mPt++ = *pt;
-	}
-
-	return out;	
-}
-
-/*!
-	Copies vector<int> data to 1-d Single-type MATLAB matrix
-	@param[in] data 	data to be copied to Matlab.
-*/
-mxArray * VectorToMxSingleArray(const std::vector<int> data)
-{
-	mxArray * out = mxCreateNumericMatrix(data.size(), 1, mxSINGLE_CLASS, mxREAL);
-	float * mPt = (float *)mxGetData(out);
-
-	for (std::vector<int>::const_iterator pt = data.begin();
-		pt != data.end(); pt++)
-	{
-		*mPt++ = (float)*pt;
-	}
-
-	return out;	
-}
-/*!
-	Creates a 1-d Single-Type MATLAB matrix with the persistence values from a vector of TPairedExtrema.
-	@param[in] data 	Vector of paired extrema
-*/
-mxArray * VectorToMxSingleArray(const std::vector<TPairedExtrema> data)	
-{
-	mxArray * out = mxCreateNumericMatrix(data.size(), 1, mxSINGLE_CLASS, mxREAL);
-	float * mPt = (float *)mxGetData(out);
-		
-	for (std::vector<TPairedExtrema>::const_iterator pt = data.begin();
-		pt != data.end(); pt++)
-	{
-		*mPt++ = (*pt).Persistence;
-	}
-	return out;	
-}
 /*!
 	Validates the following for the input:
-	- Total number of arguments = 1
-	- The only arguments should be data, in a 1-d matrix 
+	- Total number of arguments is between 1 and 3
+	- The first argument should be data, in a 1-d matrix
 	- Matrix data type is single (AKA float)
 	- No complex data
 	- No char data
 
 	Validates the following for the output:
-	- There are three output variables
+	- There are five output variables
 
 	@param[in]	nOuts	Number of output variables.
 	@param[in]	outs	Array of pointers to output matrices.
@@ -234,10 +167,10 @@ bool CheckInput(const int nOuts, mxArray *outs[], const int nIns, const mxArray
 {
 	bool noerror = true;
 
-	if (nIns != NUM_INPUT_VARIABLES) 
+	if (nIns < MIN_INPUT_VARIABLES || nIns > MAX_INPUT_VARIABLES)
 	{	
-		mexPrintf("\nExpecting one input variables: data vector.");
-		noerror = false;
+		mexPrintf("\nExpecting one to three input variables: data vector [, threshold [, topK]].");
+		return false;
 	}
 	if (nOuts != NUM_OUTPUT_VARIABLES) 
 	{
@@ -253,7 +186,7 @@ bool CheckInput(const int nOuts, mxArray *outs[], const int nIns, const mxArray
 	mwSize dims = mxGetNumberOfDimensions(ins[0]);
 	if (dims > 2) 
     {
-        mexPrintf("\nWarning. %d number of dimensions not supported, will handle data as one dimensional data", dims);
+        mexPrintf("\nWarning. %d number of dimensions not supported, will handle data as one dimensional data", (int)dims);
     }
     
 	size_t mrows,ncols;
@@ -262,35 +195,50 @@ bool CheckInput(const int nOuts, mxArray *outs[], const int nIns, const mxArray
 	
 	if (mrows!=1 && ncols!=1) //Input data should be 1-d vector shaped - results are not guaranteed for 2d data
 	{
-        mexPrintf("\nInput rows: %d cols: %d", mrows, ncols);
-		mexPrintf("\nWarning. Expecting one dimensional vector data. Data vector contains: %d %d", mrows, ncols);
+        mexPrintf("\nInput rows: %d cols: %d", (int)mrows, (int)ncols);
+		mexPrintf("\nWarning. Expecting one dimensional vector data. Data vector contains: %d %d", (int)mrows, (int)ncols);
 	}
 	
 	return noerror;
 }
 /*!
-	Displays float-vector content in Matlab output window.
+	Reads an optional non-negative real scalar argument.
+	Leaves value unchanged if the argument was not given.
 
-	@param[in] data		Float vector to write
+	@param[in]	nIns		Number of input variables.
+	@param[in]	ins			Array of pointers in input matrices.
+	@param[in]	position	Position of the argument.
+	@param[out] value		Value of the argument.
 */
-void WriteVectorToMexOutput(const std::vector<float> data)
+bool GetOptionalScalar(const int nIns, const mxArray *ins[], const int position, double & value)
 {
-	for (std::vector<float>::const_iterator it = data.begin(); 
-		it != data.end(); it++)
+	if (nIns <= position) return true;
+
+	if (!mxIsNumeric(ins[position]) || mxIsComplex(ins[position]) || mxGetNumberOfElements(ins[position]) != 1)
 	{
-		mexPrintf("\n data[%d] %f",it-data.begin(),*it);
-	}		
-	mexPrintf("\n");
+		mexPrintf("\nExpecting threshold and topK to be REAL scalars");
+		return false;
+	}
+
+	value = mxGetScalar(ins[position]);
+	if (!(value >= 0))	//also rejects NaN
+	{
+		mexPrintf("\nExpecting threshold and topK to be greater than or equal to 0");
+		return false;
+	}
+	return true;
 }
 /*!
-	Assumption - first input argument is a vector of 1-d data, 				 
+	Displays data content in Matlab output window.
 
-	Copies the content of mxArray to a vector. 
-	
-	@param[in] inputs		Array of MATLAB matrix data, as received by mexFunction (MATLAB entrance point)
-	@param[out] data		Vector which contain data for Persistence
+	@param[in] data		Data to write
+	@param[in] size		Number of data values
 */
-void WriteInputToVector(const mxArray *inputs[], std::vector<float> & data)
+void WriteDataToMexOutput(const float * data, const size_t size)
 {
-	MxFloatArrayToFloatVector(inputs[0], data);
+	for (size_t i = 0; i != size; i++)
+	{
+		mexPrintf("\n data[%d] %f", (int)i, data[i]);
+	}		
+	mexPrintf("\n");
 }
\ No newline at end of file
@@ -0,0 +1,76 @@
+/*! \file run_persistence1d_adapter.hpp
+    Matlab-independent part of the Matlab interface in run_persistence1d.cpp.
+
+	Runs Persistence1D directly on the input buffer of a Matlab matrix (see Persistence1D::RunPersistenceLowMemory), 
+	and writes results directly into the buffers of preallocated output matrices.
+	Does not depend on mex.h, so it can be used and tested without Matlab.
+*/
+
+#ifndef RUN_PERSISTENCE1D_ADAPTER_H
+#define RUN_PERSISTENCE1D_ADAPTER_H
+
+#include "../src/persistence1d/persistence1d.hpp"
+
+namespace p1d
+{
+
+/*!
+	Persistence1D with access to its results through raw output buffers.
+
+	Filtering by threshold is done while pairs are created, filtering by number of pairs
+	(the topK most persistent pairs) is done while results are written.
+*/
+class Persistence1DAdapter : public Persistence1D
+{
+public:
+	/*!
+		Runs persistence on a data buffer, which is read in place and not copied.
+
+		@param[in] data			Pointer to data values. Not needed after the run.
+		@param[in] size			Number of data values.
+		@param[in] threshold	Only pairs whose persistence is greater than or equal to threshold are kept.
+	*/
+	bool Run(const float * data, const size_t size, const float threshold = 0)
+	{
+		return RunPersistenceLowMemory(data, size, threshold < 0 ? 0 : threshold);
+	}
+
+	/*!
+		Returns the number of pairs that WriteResults will write.
+
+		@param[in] topK		Maximal number of pairs. Set to 0 for all pairs.
+	*/
+	size_t GetNumberOfResults(const size_t topK = 0) const
+	{
+		if (topK == 0) return PairedExtrema.size();
+		return std::min(topK, PairedExtrema.size());
+	}
+
+	/*!
+		Writes the indices and persistence of the topK most persistent pairs to output buffers,
+		sorted according to persistence, from least to most persistent.
+		Each buffer must have room for GetNumberOfResults(topK) values.
+		Indices are written as float values, to match the single-type Matlab output.
+
+		@param[out] minIndices		Indices of paired minima. Ignored if NULL.
+		@param[out] maxIndices		Indices of paired maxima. Ignored if NULL.
+		@param[out] persistence		Persistence of pairs. Ignored if NULL.
+		@param[in]	topK			Maximal number of pairs. Set to 0 for all pairs.
+		@param[in]	matlabIndexing	Set this to true to change all indices to match Matlab's 1-indexing.
+	*/
+	void WriteResults(float * minIndices, float * maxIndices, float * persistence, const size_t topK = 0, const bool matlabIndexing = true) const
+	{
+		int matlabIndexFactor = 0;
+		if (matlabIndexing) matlabIndexFactor = MATLAB_INDEX_FACTOR;
+
+		for (std::vector<TPairedExtrema>::const_iterator p = PairedExtrema.end() - GetNumberOfResults(topK);
+			p != PairedExtrema.end(); p++)
+		{
+			if (minIndices != NULL) *minIndices++ = (float)((*p).MinIndex + matlabIndexFactor);
+			if (maxIndices != NULL) *maxIndices++ = (float)((*p).MaxIndex + matlabIndexFactor);
+			if (persistence != NULL) *persistence++ = (*p).Persistence;
+		}
+	}
+};
+}
+#endif
@@ -0,0 +1,545 @@
+/*! \file benchmarks.cpp
+    Timing of Persistence1D features against the basic RunPersistence. 
+	Build in release mode. Prints one line per measurement.
+	The benchmarks64 target runs the same benchmarks with 64-bit indices (P1D_64BIT_INDICES).
+*/
+
+#include "../persistence1d/persistence1d.hpp"
+#include "../persistence1d/persistence1d_approximate.hpp"
+#include "../persistence1d/persistence1d_dispatch.hpp"
+#include "../persistence1d/persistence1d_distances.hpp"
+#include "../persistence1d/persistence1d_fixed.hpp"
+#include "../persistence1d/persistence1d_trace.hpp"
+#include "../tests/peak_memory.hpp"
+
+#include <stdlib.h>
+#include <chrono>
+#include <fstream>
+#include <numeric>
+#include <string>
+
+using namespace std;
+using namespace p1d;
+
+/*!
+	Returns the time since the first call, in milliseconds.
+*/
+double GetTimeMs()
+{
+	static const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+/*!
+	Creates test data: either uniform noise or a random walk.
+*/
+void CreateData(vector<float> & data, const int size, const bool randomWalk)
+{
+	data.clear();
+	data.reserve(size);
+
+	float value = 0;
+	for (int i = 0; i < size; i++)
+	{
+		if (randomWalk) value += (float)rand() / RAND_MAX - 0.5f;
+		else value = (float)rand() / RAND_MAX;
+		data.push_back(value);
+	}
+}
+
+/*!
+	Compares UpdateValue to a full RunPersistence after correcting a single random sample,
+	by replacing it with the mean of its neighbors.
+*/
+void BenchmarkUpdateValue(const int size, const bool randomWalk)
+{
+	vector<float> data;
+	CreateData(data, size, randomWalk);
+
+	Persistence1D p;
+	double start = GetTimeMs();
+	p.RunPersistence(data);
+	double fullRun = GetTimeMs() - start;
+
+	const int numUpdates = 1000;
+	start = GetTimeMs();
+	for (int u = 0; u < numUpdates; u++)
+	{
+		int index = 1 + (int)(((double)rand() / RAND_MAX) * (size - 3));
+		data[index] = (data[index - 1] + data[index + 1]) / 2;
+		p.UpdateValue(index, data[index]);
+	}
+	double update = (GetTimeMs() - start) / numUpdates;
+
+	cout << "UpdateValue " << (randomWalk ? "random walk" : "noise") << " n=" << size
+		 << ": full run " << fullRun << " ms, update " << update << " ms" << endl;
+}
+
+/*!
+	Compares GetPersistenceCurve to calling GetExtremaIndices for each threshold.
+*/
+void BenchmarkPersistenceCurve(const int size, const int numThresholds)
+{
+	vector<float> data;
+	CreateData(data, size, true);
+
+	Persistence1D p;
+	p.RunPersistence(data);
+
+	vector<float> thresholds(numThresholds);
+	float maxPersistence = 0;
+	vector<TPairedExtrema> pairs;
+	if (p.GetPairedExtrema(pairs)) maxPersistence = pairs.back().Persistence;
+	for (int t = 0; t < numThresholds; t++)
+	{
+		thresholds[t] = maxPersistence * t / numThresholds;
+	}
+
+	vector<TIndex> counts(numThresholds);
+	double start = GetTimeMs();
+	p.GetPersistenceCurve(&thresholds[0], numThresholds, &counts[0]);
+	double curve = GetTimeMs() - start;
+
+	vector<TIndex> min, max;
+	const int step = numThresholds / 100;
+	start = GetTimeMs();
+	for (int t = 0; t < numThresholds; t += step)
+	{
+		p.GetExtremaIndices(min, max, thresholds[t]);
+	}
+	double perThreshold = (GetTimeMs() - start) / (numThresholds / step) * numThresholds;
+
+	cout << "GetPersistenceCurve n=" << size << " thresholds=" << numThresholds
+		 << ": single pass " << curve << " ms, GetExtremaIndices per threshold (extrapolated) " << perThreshold << " ms" << endl;
+}
+
+/*!
+	Times one-vs-many bottleneck and 2-Wasserstein distances, on one and on all cores.
+*/
+void BenchmarkDistances(const int size, const int numReferences)
+{
+	vector<float> data;
+	vector<PersistenceDiagram> references(numReferences);
+	PersistenceDiagram query;
+	Persistence1D p;
+
+	for (int r = 0; r <= numReferences; r++)
+	{
+		CreateData(data, size, false);
+		p.RunPersistence(data);
+		if (r == numReferences) query.Create(p, data);
+		else references[r].Create(p, data);
+	}
+
+	vector<double> distances;
+	const double exponents[] = { numeric_limits<double>::infinity(), 2 };
+	for (int e = 0; e < 2; e++)
+	{
+		double start = GetTimeMs();
+		PersistenceDiagramDistance::ComputeDistances(query, references, distances, exponents[e], 1);
+		double singleThread = GetTimeMs() - start;
+
+		start = GetTimeMs();
+		PersistenceDiagramDistance::ComputeDistances(query, references, distances, exponents[e]);
+		double allThreads = GetTimeMs() - start;
+
+		cout << (e == 0 ? "Bottleneck" : "2-Wasserstein") << " one-vs-" << numReferences << " diagrams of " << query.GetPoints().size()
+			 << " points: 1 thread " << singleThread << " ms, all threads " << allThreads << " ms" << endl;
+	}
+}
+
+/*!
+	Compares Persistence1DFixed to Persistence1D on all windows of size N of noise.
+*/
+template <int N>
+void BenchmarkFixedWindows(const int size)
+{
+	vector<float> data;
+	CreateData(data, size, false);
+
+	Persistence1D p;
+	Persistence1DFixed<N> fixed;
+	int checksum = 0, fixedChecksum = 0;
+
+	double start = GetTimeMs();
+	for (int first = 0; first + N <= size; first++)
+	{
+		p.RunPersistence(&data[first], N);
+		checksum += p.GetGlobalMinimumIndex();
+	}
+	double generic = GetTimeMs() - start;
+
+	start = GetTimeMs();
+	for (int first = 0; first + N <= size; first++)
+	{
+		fixed.RunPersistence(&data[first]);
+		fixedChecksum += fixed.GetGlobalMinimumIndex();
+	}
+	double fixedTime = GetTimeMs() - start;
+
+	const int numWindows = size - N + 1;
+	cout << "Persistence1DFixed<" << N << "> " << numWindows << " windows: Persistence1D " << generic * 1000000 / numWindows
+		 << " ns/window, fixed " << fixedTime * 1000000 / numWindows << " ns/window" << (checksum == fixedChecksum ? "" : " MISMATCH") << endl;
+}
+
+/*!
+	Compares time and peak memory of RunPersistenceLowMemory and RunPersistence, not counting the input data.
+*/
+void BenchmarkLowMemory(const int size, const bool randomWalk)
+{
+	vector<float> data;
+	CreateData(data, size, randomWalk);
+
+	//low memory first, so it cannot reuse memory which the regular run freed, but the process still holds
+	double time[2], bytesPerValue[2];
+	for (int lowMemory = 1; lowMemory >= 0; lowMemory--)
+	{
+		Persistence1D p;
+		GetPeakMemorySinceLastCall();
+		size_t before = GetPeakMemorySinceLastCall();
+
+		double start = GetTimeMs();
+		if (lowMemory) p.RunPersistenceLowMemory(&data[0], data.size());
+		else p.RunPersistence(&data[0], data.size());
+		time[lowMemory] = GetTimeMs() - start;
+
+		bytesPerValue[lowMemory] = (double)(GetPeakMemorySinceLastCall() - before) / size;
+	}
+
+	cout << "RunPersistenceLowMemory " << (randomWalk ? "random walk" : "noise") << " n=" << size
+		 << ": regular " << time[0] << " ms, " << bytesPerValue[0] << " bytes/value, low memory "
+		 << time[1] << " ms, " << bytesPerValue[1] << " bytes/value (peak memory including results)" << endl;
+}
+
+/*!
+	Persistence1D with the Watershed loop of the original release: unpadded colors with special cases for both boundaries, 
+	four tests of the neighbors' colors, and branches when extending and merging components.
+	It keeps its own colors, components and pairs, laid out as in that release.
+*/
+class BaselinePersistence1D : public Persistence1D
+{
+public:
+	///Returns the time of Watershed in milliseconds.
+	double RunWatershed(const vector<float>& InputData, PerfCounters& counters)
+	{
+		Data = InputData;
+		Init();
+		CreateIndexValueVector();
+		BaselineColors.assign(Data.size(), NO_COLOR);
+		BaselineComponents.clear();
+		BaselineComponents.reserve(Data.size() / RESIZE_FACTOR + 1);
+		BaselinePairs.clear();
+		BaselinePairs.reserve(Data.size() / RESIZE_FACTOR + 1);
+
+		double start = GetTimeMs();
+		counters.Start();
+		const TIndex last = (TIndex)Data.size() - 1;
+		for (vector<TIdxAndData>::iterator p = SortedData.begin(); p != SortedData.end(); p++)
+		{
+			const TIndex i = (*p).Idx;
+
+			if (i == 0)
+			{
+				if (BaselineColors[i+1] == NO_COLOR) CreateBaseline(i);
+				else ExtendBaseline(BaselineColors[i+1], i);
+			}
+			else if (i == last)
+			{
+				if (BaselineColors[i-1] == NO_COLOR) CreateBaseline(i);
+				else ExtendBaseline(BaselineColors[i-1], i);
+			}
+			else if (BaselineColors[i-1] == NO_COLOR && BaselineColors[i+1] == NO_COLOR) CreateBaseline(i);
+			else if (BaselineColors[i-1] != NO_COLOR && BaselineColors[i+1] == NO_COLOR) ExtendBaseline(BaselineColors[i-1], i);
+			else if (BaselineColors[i-1] == NO_COLOR && BaselineColors[i+1] != NO_COLOR) ExtendBaseline(BaselineColors[i+1], i);
+			else if (BaselineColors[i-1] != NO_COLOR && BaselineColors[i+1] != NO_COLOR)
+			{
+				const TIndex leftComp = BaselineColors[i-1], rightComp = BaselineColors[i+1];
+				if (BaselineComponents[rightComp].MinValue < BaselineComponents[leftComp].MinValue) PairBaseline(BaselineComponents[leftComp].MinIndex, i);
+				else PairBaseline(BaselineComponents[rightComp].MinIndex, i);
+				MergeBaseline(leftComp, rightComp);
+				BaselineColors[i] = BaselineColors[i-1];
+			}
+		}
+		counters.Stop();
+		return GetTimeMs() - start;
+	}
+
+	///Returns the number of pairs found by the last run.
+	size_t GetNumberOfBaselinePairs() const
+	{
+		return BaselinePairs.size();
+	}
+
+protected:
+	///A component as in the original release.
+	struct TBaselineComponent
+	{
+		TIndex LeftEdgeIndex;
+		TIndex RightEdgeIndex;
+		TIndex MinIndex;
+		float MinValue;
+		bool Alive;
+	};
+
+	vector<TIndex> BaselineColors;
+	vector<TBaselineComponent> BaselineComponents;
+	vector<TPairedExtrema> BaselinePairs;
+
+	void CreateBaseline(const TIndex minIdx)
+	{
+		TBaselineComponent comp;
+		comp.Alive = true;
+		comp.LeftEdgeIndex = minIdx;
+		comp.RightEdgeIndex = minIdx;
+		comp.MinIndex = minIdx;
+		comp.MinValue = Data[minIdx];
+		BaselineColors[minIdx] = (TIndex)BaselineComponents.size();
+		BaselineComponents.push_back(comp);
+	}
+
+	void ExtendBaseline(const TIndex componentIdx, const TIndex dataIdx)
+	{
+		if (dataIdx + 1 == BaselineComponents[componentIdx].LeftEdgeIndex) BaselineComponents[componentIdx].LeftEdgeIndex = dataIdx;
+		else if (dataIdx - 1 == BaselineComponents[componentIdx].RightEdgeIndex) BaselineComponents[componentIdx].RightEdgeIndex = dataIdx;
+		BaselineColors[dataIdx] = componentIdx;
+	}
+
+	void MergeBaseline(const TIndex firstIdx, const TIndex secondIdx)
+	{
+		TIndex survivorIdx, destroyedIdx;
+		if (BaselineComponents[firstIdx].MinValue < BaselineComponents[secondIdx].MinValue) { survivorIdx = firstIdx; destroyedIdx = secondIdx; }
+		else if (BaselineComponents[firstIdx].MinValue > BaselineComponents[secondIdx].MinValue) { survivorIdx = secondIdx; destroyedIdx = firstIdx; }
+		else if (firstIdx < secondIdx) { survivorIdx = firstIdx; destroyedIdx = secondIdx; }
+		else { survivorIdx = secondIdx; destroyedIdx = firstIdx; }
+
+		TBaselineComponent& destroyed = BaselineComponents[destroyedIdx];
+		TBaselineComponent& survivor = BaselineComponents[survivorIdx];
+		destroyed.Alive = false;
+		BaselineColors[destroyed.RightEdgeIndex] = survivorIdx;
+		BaselineColors[destroyed.LeftEdgeIndex] = survivorIdx;
+		if (survivor.MinIndex > destroyed.MinIndex) survivor.LeftEdgeIndex = destroyed.LeftEdgeIndex;
+		else survivor.RightEdgeIndex = destroyed.RightEdgeIndex;
+	}
+
+	void PairBaseline(const TIndex firstIdx, const TIndex secondIdx)
+	{
+		TPairedExtrema pair;
+		if (Data[firstIdx] > Data[secondIdx] || (Data[firstIdx] == Data[secondIdx] && firstIdx > secondIdx))
+		{
+			pair.MaxIndex = firstIdx;
+			pair.MinIndex = secondIdx;
+		}
+		else
+		{
+			pair.MaxIndex = secondIdx;
+			pair.MinIndex = firstIdx;
+		}
+		pair.Persistence = Data[pair.MaxIndex] - Data[pair.MinIndex];
+		BaselinePairs.push_back(pair);
+	}
+};
+
+/*!
+	Persistence1D which measures Watershed only.
+*/
+class MeasuredPersistence1D : public Persistence1D
+{
+public:
+	///Returns the time of Watershed in milliseconds.
+	double RunWatershed(const vector<float>& InputData, PerfCounters& counters)
+	{
+		Data = InputData;
+		Init();
+		CreateIndexValueVector();
+
+		TNullVisitor visitor;
+		double start = GetTimeMs();
+		counters.Start();
+		Watershed(visitor);
+		counters.Stop();
+		double time = GetTimeMs() - start;
+		SortPairedExtrema();
+		return time;
+	}
+};
+
+/*!
+	Compares the Watershed loop to the loop of the original release,
+	with hardware counters where perf_event_open is available.
+*/
+void BenchmarkWatershed(const int size, const bool randomWalk)
+{
+	vector<float> data;
+	CreateData(data, size, randomWalk);
+
+	PerfCounters counters;
+	const bool hasCounters = counters.Open();
+
+	double time[2];
+	PerfCounters results[2];
+	size_t numPairs[2];
+	for (int baseline = 0; baseline < 2; baseline++)
+	{
+		BaselinePersistence1D reference;
+		MeasuredPersistence1D current;
+
+		time[baseline] = baseline ? reference.RunWatershed(data, counters) : current.RunWatershed(data, counters);
+		vector<TPairedExtrema> pairs;
+		current.GetPairedExtrema(pairs);
+		numPairs[baseline] = baseline ? reference.GetNumberOfBaselinePairs() : pairs.size();
+
+		results[baseline].Cycles = counters.Cycles;
+		results[baseline].CacheMisses = counters.CacheMisses;
+		results[baseline].BranchMisses = counters.BranchMisses;
+	}
+
+	cout << "Watershed " << (randomWalk ? "random walk" : "noise") << " n=" << size
+		 << ": current " << time[0] << " ms, baseline " << time[1] << " ms" << (numPairs[0] == numPairs[1] ? "" : " MISMATCH");
+	if (hasCounters)
+	{
+		cout << "; current/baseline: cycles " << results[0].Cycles << "/" << results[1].Cycles 
+			 << ", cache misses " << results[0].CacheMisses << "/" << results[1].CacheMisses
+			 << ", branch misses " << results[0].BranchMisses << "/" << results[1].BranchMisses;
+	}
+	cout << endl;
+}
+
+/*!
+	Calibrates the cost model of PersistenceDispatcher, and compares all engines to the choice of the dispatcher
+	on noise, a random walk, small integers and a smooth sine.
+*/
+void BenchmarkDispatcher(const int size)
+{
+	TCostModel model;
+	double start = GetTimeMs();
+	model.Calibrate();
+	cout << "Dispatcher calibration: " << GetTimeMs() - start << " ms, ns per work: comparison " << model.ComparisonSort 
+		 << ", radix " << model.RadixSort << ", parallel " << model.ParallelSort << ", critical points " << model.CriticalPoints << endl;
+
+	PersistenceDispatcher dispatcher;
+	dispatcher.SetModel(model);
+	dispatcher.SetKeepData(false);
+
+	const char * names[] = { "noise", "random walk", "integers", "sine" };
+	for (int kind = 0; kind < 4; kind++)
+	{
+		vector<float> data;
+		if (kind < 2) CreateData(data, size, kind == 1);
+		for (int i = 0; kind >= 2 && i < size; i++)
+		{
+			data.push_back((kind == 2) ? (float)(rand() % 1000) : sinf(i * 0.001f));
+		}
+
+		Persistence1D p;
+		double time[NUMBER_OF_ENGINES];
+		for (int engine = 0; engine < NUMBER_OF_ENGINES; engine++)
+		{
+			dispatcher.SetOverride(engine);
+			start = GetTimeMs();
+			dispatcher.RunPersistence(p, data);
+			time[engine] = GetTimeMs() - start;
+		}
+		dispatcher.SetOverride(ENGINE_AUTOMATIC);
+		const int chosen = dispatcher.ChooseEngine(PersistenceDispatcher::ProfileInput(&data[0], data.size()));
+
+		cout << "Dispatcher " << names[kind] << " n=" << size << ":";
+		for (int engine = 0; engine < NUMBER_OF_ENGINES; engine++)
+		{
+			cout << " " << PersistenceDispatcher::GetEngineName(engine) << " " << time[engine] << " ms" << (engine == chosen ? " (chosen)" : "") << ",";
+		}
+		cout << " fastest " << PersistenceDispatcher::GetEngineName((int)(min_element(time, time + NUMBER_OF_ENGINES) - time)) << endl;
+	}
+}
+
+/*!
+	Compares a warm start to a run from scratch on a random walk, after perturbing all values by noise of several magnitudes,
+	relative to the largest step of the walk.
+*/
+void BenchmarkWarmStart(const int size)
+{
+	vector<float> data;
+	CreateData(data, size, true);
+
+	const float magnitudes[] = { 0, 0.0001f, 0.001f, 0.01f, 0.1f, 1 };
+	for (size_t m = 0; m < sizeof(magnitudes) / sizeof(magnitudes[0]); m++)
+	{
+		Persistence1D warm, cold;
+		warm.SetSortMethod(SORT_WARM_START);
+		warm.RunPersistence(data);
+
+		vector<float> perturbed(data);
+		for (int i = 0; i < size; i++)
+		{
+			perturbed[i] += magnitudes[m] * ((float)rand() / RAND_MAX - 0.5f);
+		}
+
+		double start = GetTimeMs();
+		cold.RunPersistence(perturbed);
+		const double coldTime = GetTimeMs() - start;
+		start = GetTimeMs();
+		warm.RunPersistence(perturbed);
+		const double warmTime = GetTimeMs() - start;
+
+		vector<TPairedExtrema> coldPairs, warmPairs;
+		cold.GetPairedExtrema(coldPairs);
+		warm.GetPairedExtrema(warmPairs);
+		cout << "WarmStart random walk n=" << size << ", perturbation " << magnitudes[m] << ": cold " << coldTime << " ms, warm " << warmTime << " ms"
+			 << (coldPairs.size() == warmPairs.size() ? "" : " MISMATCH") << endl;
+	}
+}
+
+/*!
+	Compares Persistence1DApproximate to a plain pass over the data which only sums it, 
+	and to RunPersistence, with the throughput of reading the data.
+*/
+void BenchmarkApproximate(const int size, const size_t blockSize)
+{
+	vector<float> data;
+	CreateData(data, size, true);
+
+	//independent sums, so the pass is not limited by the latency of additions
+	double start = GetTimeMs();
+	float sums[8] = { 0 };
+	for (int i = 0; i + 8 <= size; i += 8)
+	{
+		for (int k = 0; k < 8; k++) sums[k] += data[i + k];
+	}
+	const double passTime = GetTimeMs() - start;
+	const float sum = std::accumulate(sums, sums + 8, 0.0f);
+
+	Persistence1DApproximate approximate;
+	start = GetTimeMs();
+	approximate.Run(data, blockSize);
+	const double approximateTime = GetTimeMs() - start;
+
+	Persistence1D p;
+	start = GetTimeMs();
+	p.RunPersistence(data);
+	const double exactTime = GetTimeMs() - start;
+
+	const double gigabytes = (double)size * sizeof(float) / 1e9;
+	cout << "Approximate random walk n=" << size << ", block size " << blockSize << ": plain pass " << passTime << " ms (" 
+		 << gigabytes / passTime * 1000 << " GB/s, sum " << sum << "), approximate " << approximateTime << " ms (" 
+		 << gigabytes / approximateTime * 1000 << " GB/s), exact " << exactTime << " ms" << endl;
+}
+
+int main()
+{
+	srand(1);
+	cout << "Index size: " << sizeof(TIndex) * 8 << " bits" << endl;
+	BenchmarkUpdateValue(1000000, false);
+	BenchmarkUpdateValue(1000000, true);
+	BenchmarkPersistenceCurve(1000000, 1000000);
+	BenchmarkDistances(300, 200);
+	BenchmarkFixedWindows<16>(200000);
+	BenchmarkFixedWindows<64>(200000);
+	BenchmarkFixedWindows<256>(200000);
+	BenchmarkLowMemory(10000000, false);
+	BenchmarkLowMemory(10000000, true);
+	BenchmarkWatershed(10000000, false);
+	BenchmarkWatershed(10000000, true);
+	BenchmarkDispatcher(10000000);
+	BenchmarkWarmStart(10000000);
+	BenchmarkApproximate(50000000, APPROXIMATE_DEFAULT_BLOCK_SIZE);
+	return 0;
+}
@@ -6,18 +6,83 @@
 #define PERSISTENCE_H
 
 #include <assert.h>
+#include <math.h>
+#include <string.h>
 #include <algorithm>
+#include <atomic>
+#include <functional>
 #include <iostream>
 #include <iterator>
+#include <limits>
+#include <utility>
 #include <vector>
 
 #define NO_COLOR -1
 #define RESIZE_FACTOR 20
 #define MATLAB_INDEX_FACTOR 1
+#define SIMPLIFY_KEPT_OLD 1
+#define SIMPLIFY_KEPT_NEW 2
+#define LOOKUP_NOT_PAIRED -1
+#define LOOKUP_GLOBAL_MINIMUM -2
+#define SORT_COMPARISON 0
+#define SORT_RADIX 1
+#define SORT_CUSTOM 2
+#define SORT_WARM_START 3
+//Phases of a run, see Persistence1D::PhaseStarted
+#define PHASE_RUN 0
+#define PHASE_CREATE_INDEX_VALUE_VECTOR 1
+#define PHASE_WATERSHED 2
+#define PHASE_SORT_PAIRED_EXTREMA 3
+#define NUMBER_OF_PHASES 4
+
+//Functions which are usable at compile time if the compiler supports C++17, see Persistence1DFixed
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#define P1D_CONSTEXPR_ENABLED
+#define P1D_CONSTEXPR constexpr
+#else
+#define P1D_CONSTEXPR inline
+#endif
+
+//Software prefetch of memory which Watershed is about to use
+#if defined(__GNUC__) || defined(__clang__)
+#define P1D_PREFETCH(address) __builtin_prefetch(address)
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#define P1D_PREFETCH(address) _mm_prefetch((const char *)(address), _MM_HINT_T0)
+#else
+#define P1D_PREFETCH(address)
+#endif
+//Number of set bits of a 64-bit word
+#if defined(__GNUC__) || defined(__clang__)
+#define P1D_POPCOUNT64(word) __builtin_popcountll(word)
+#elif defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#define P1D_POPCOUNT64(word) __popcnt64(word)
+#endif
+//Number of bits sorted by each pass of the radix sort of SortedData
+#define RADIX_BITS 8
+//Moves per value after which the insertion sort of a warm start gives up, and sorts the rest from scratch
+#define WARM_START_MAX_MOVES 16
+//Number of vertices of the sorted order that Watershed looks ahead to prefetch colors
+#define WATERSHED_PREFETCH_DISTANCE 16
+
+//Define P1D_PAIR_ATTRIBUTES before including any Persistence1D header to add the width and area 
+//of the basin of each pair to TPairedExtrema. They are computed during the run, at constant cost per vertex.
 
 namespace p1d 
 {
 
+/*!
+	Type of indices of data values and components.
+	32-bit by default, which keeps the memory footprint small. 
+	Define P1D_64BIT_INDICES before including any Persistence1D header to process data with more than 2^31-1 values.
+*/
+#ifdef P1D_64BIT_INDICES
+typedef long long TIndex;
+#else
+typedef int TIndex;
+#endif
+
 /** Used to sort data according to its absolute value and refer to its original index in the Data vector.
 
 	A collection of TIdxAndData is sorted according to its data value (if values are equal, according
@@ -25,9 +90,9 @@ namespace p1d
 */
 struct TIdxAndData
 {
-	TIdxAndData():Idx(-1),Data(0){}
+	P1D_CONSTEXPR TIdxAndData():Idx(-1),Data(0){}
 
-	bool operator<(const TIdxAndData& other) const
+	P1D_CONSTEXPR bool operator<(const TIdxAndData& other) const
 	{
 		if (Data < other.Data) return true;
 		if (Data > other.Data) return false;
@@ -35,12 +100,18 @@ struct TIdxAndData
 	}
 
 	///The index of the vertex within the Data vector. 
-	int Idx;
+	TIndex Idx;
 
 	///Vertex data value from the original Data vector sent as an argument to RunPersistence.
 	float Data;
 };
 
+/*!
+	Sort of SORT_CUSTOM, see Persistence1D::SetSortMethod. 
+	Must sort the vertices according to TIdxAndData::operator<, like std::sort.
+*/
+typedef std::function<void (std::vector<TIdxAndData>&)> TSortFunction;
+
 
 /*! Defines a component within the data domain. 
 	A component is created at a local minimum - a vertex whose value is smaller than both of its neighboring 
@@ -51,15 +122,20 @@ struct TComponent
 	///A component is defined by the indices of its edges.
 	///Both variables hold the respective indices of the vertices in Data vector.
 	///All vertices between them are considered to belong to this component.
-	int LeftEdgeIndex;
-	int RightEdgeIndex;
+	TIndex LeftEdgeIndex;
+	TIndex RightEdgeIndex;
 
 	///The index of the local minimum within the component as longs as its alive. 
-	int MinIndex;
+	TIndex MinIndex;
 
 	///The value of the Data[MinIndex].
 	float MinValue; //redundant, but makes life easier
 
+#ifdef P1D_PAIR_ATTRIBUTES
+	///Sum of data values of all vertices between the edges.
+	double Sum;
+#endif
+
 	///Set to true when a component is created. Once components are merged,
 	///the destroyed component Alive value is set to false. 
 	///Used to verify correctness of algorithm.
@@ -74,17 +150,28 @@ struct TComponent
 struct TPairedExtrema
 {
 	///Index of local minimum, as per Data vector.
-	int MinIndex;
+	TIndex MinIndex;
 
 	///Index of local maximum, as per Data vector. 
-	int MaxIndex;
+	TIndex MaxIndex;
 
 	///The persistence of the two extrema.
 	///Data[MaxIndex] - Data[MinIndex]		 
 	///Guaranteed to be >= 0.
 	float Persistence;	
 
-	bool operator<(const TPairedExtrema& other) const
+#ifdef P1D_PAIR_ATTRIBUTES
+	///Number of vertices in the basin of the destroyed minimum when it merges at the maximum:
+	///all vertices on its side of the maximum which are smaller than the maximum. The maximum is not included.
+	///The depth of the basin is Persistence, the location of its saddle is MaxIndex.
+	TIndex Width;
+
+	///Sum of data values of the vertices in the basin.
+	///The area between the basin and the level of the maximum is Width * Data[MaxIndex] - Area.
+	double Area;
+#endif
+
+	P1D_CONSTEXPR bool operator<(const TPairedExtrema& other) const
 	{
 		if (Persistence < other.Persistence) return true;
 		if (Persistence > other.Persistence) return false;
@@ -93,6 +180,507 @@ struct TPairedExtrema
 };
 
 
+/*!
+	Creates a TPairedExtrema from a local minimum and the local maximum it is paired with.
+	The vertex with the larger value becomes the maximum. If both values are equal, 
+	the vertex with the smaller index becomes the minimum.
+
+	@param[in] firstIdx, firstValue		Index and data value of the first vertex.
+	@param[in] secondIdx, secondValue	Index and data value of the second vertex.
+*/
+P1D_CONSTEXPR TPairedExtrema MakePairedExtrema(const TIndex firstIdx, const float firstValue, const TIndex secondIdx, const float secondValue)
+{
+	TPairedExtrema pair = TPairedExtrema(); 
+		
+	//There might be a potential bug here, todo (we're checking data, not sorted data)
+	//example case: 1 1 1 1 1 1 -5 might remove if after else
+	if (firstValue > secondValue)
+	{
+		pair.MaxIndex = firstIdx; 
+		pair.MinIndex = secondIdx;
+		pair.Persistence = firstValue - secondValue;
+	}
+	else if (secondValue > firstValue)
+	{
+		pair.MaxIndex = secondIdx; 
+		pair.MinIndex = firstIdx;
+		pair.Persistence = secondValue - firstValue;
+	}
+	//both values are equal, choose the left one as the min
+	else 
+	{
+		pair.MinIndex = std::min(firstIdx, secondIdx);
+		pair.MaxIndex = std::max(firstIdx, secondIdx);
+		pair.Persistence = 0;
+	}
+
+	return pair;
+}
+
+
+/*!
+	64-bit FNV-1a hash of a buffer, e.g. to identify data in caches and snapshots.
+
+	@param[in] data		Pointer to buffer.
+	@param[in] size		Size of buffer in bytes.
+	@param[in] hash		Hash of preceding data, to hash data in parts.
+*/
+inline unsigned long long HashBytes(const void * data, const size_t size, unsigned long long hash = 14695981039346656037ULL)
+{
+	const unsigned char * bytes = (const unsigned char *)data;
+	for (size_t i = 0; i != size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+/*!
+	Returns a key of a float value whose unsigned order is the order of values, for radix sorting: 
+	the sign bit is flipped for positive values, all bits are flipped for negative values.
+	-0 has the key of 0, since they are equal.
+*/
+inline unsigned int GetRadixKey(const float value)
+{
+	unsigned int bits;
+	const float canonical = (value == 0) ? 0.0f : value;
+	memcpy(&bits, &canonical, sizeof(bits));
+	return (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+}
+
+/*!
+	Default visitor of Persistence1D::RunPersistence - does nothing.
+	
+	A visitor is notified of events during the run, as soon as they happen.
+	Custom visitors should provide the same functions. They are called directly, not via virtual functions,
+	so empty or short functions are inlined.
+*/
+struct TNullVisitor
+{
+	///Called when a component is created at a local minimum.
+	void ComponentCreated(const TIndex /*minIdx*/, const float /*minValue*/) 
+	{
+	}
+
+	///Called when two components are merged at a local maximum. The component with the larger minimum is destroyed.
+	void ComponentsMerged(const TIndex /*survivorMinIdx*/, const TIndex /*destroyedMinIdx*/, const TIndex /*maxIdx*/) 
+	{
+	}
+
+	///Called when a pair is created. Pairs below the persistence threshold of the run are not reported.
+	void PairCreated(const TPairedExtrema& /*pair*/) 
+	{
+	}
+};
+
+
+/*!
+	Visitor which accumulates summary statistics of the persistence of all pairs while they are created.
+	
+	Pass it to Persistence1D::RunPersistence, optionally with storePairs set to false.
+	Only paired extrema are included - the global minimum is not.
+
+	All statistics are updated in constant time per pair. The median needs all persistence values, 
+	so they are stored only if it was requested. 
+*/
+class PersistenceSummary : public TNullVisitor
+{
+public:
+	/*!
+		@param[in] p				Exponent of the p-norm.
+		@param[in] numBins			Number of bins of the persistence histogram, 0 for no histogram.
+		@param[in] histogramMax		Upper limit of the histogram. Bins are equally sized in [0, histogramMax]. 
+									Larger values are added to the last bin. If it is not positive and finite, there is no histogram.
+		@param[in] computeMedian	Set this to true to store persistence values for GetMedianPersistence.
+	*/
+	PersistenceSummary(const float p = 2, const int numBins = 0, const float histogramMax = 1, const bool computeMedian = false)
+		: P(p), HistogramMax(histogramMax), ComputeMedian(computeMedian), 
+		  Histogram((numBins > 0 && histogramMax > 0 && histogramMax <= std::numeric_limits<float>::max()) ? numBins : 0)
+	{
+		Clear();
+	}
+
+	///Resets all statistics, e.g. before the next run.
+	void Clear()
+	{
+		NumberOfPairs = 0;
+		TotalPersistence = 0;
+		SumOfPowers = 0;
+		SumOfEntropyTerms = 0;
+		MaxPersistence = 0;
+		Persistence.clear();
+		std::fill(Histogram.begin(), Histogram.end(), 0);
+	}
+
+	void PairCreated(const TPairedExtrema& pair)
+	{
+		const double persistence = pair.Persistence;
+
+		NumberOfPairs++;
+		TotalPersistence += persistence;
+		SumOfPowers += pow(persistence, (double)P);
+		if (persistence > 0) SumOfEntropyTerms += persistence * log(persistence);
+		if (pair.Persistence > MaxPersistence) MaxPersistence = pair.Persistence;
+		
+		if (!Histogram.empty())
+		{
+			//compared before the cast, which is undefined for values beyond int
+			const double position = persistence / HistogramMax * Histogram.size();
+			Histogram[(position < (double)Histogram.size()) ? (size_t)position : Histogram.size() - 1]++;
+		}
+
+		if (ComputeMedian) Persistence.push_back(pair.Persistence);
+	}
+
+	TIndex GetNumberOfPairs() const { return NumberOfPairs; }
+	double GetTotalPersistence() const { return TotalPersistence; }
+	float GetMaxPersistence() const { return MaxPersistence; }
+
+	double GetMeanPersistence() const 
+	{ 
+		if (NumberOfPairs == 0) return 0;
+		return TotalPersistence / NumberOfPairs; 
+	}
+
+	///Returns the p-norm of the persistence of all pairs, (sum(persistence^p))^(1/p).
+	double GetPNorm() const 
+	{ 
+		return pow(SumOfPowers, 1.0 / P); 
+	}
+
+	/*!
+		Returns persistent entropy: -sum(p_i/L * log(p_i/L)), where L is the total persistence.
+		Computed from the running sums as log(L) - sum(p_i * log(p_i)) / L.
+	*/
+	double GetPersistentEntropy() const 
+	{ 
+		if (TotalPersistence <= 0) return 0;
+		return log(TotalPersistence) - SumOfEntropyTerms / TotalPersistence; 
+	}
+
+	/*!
+		Returns the median persistence, or 0 if computeMedian was not set.
+		Reorders the stored persistence values in linear time.
+	*/
+	float GetMedianPersistence()
+	{
+		if (Persistence.empty()) return 0;
+
+		std::vector<float>::iterator middle = Persistence.begin() + Persistence.size()/2;
+		std::nth_element(Persistence.begin(), middle, Persistence.end());
+		if (Persistence.size() % 2 == 1) return *middle;
+
+		//even number of values - average with the largest value below middle
+		return (*middle + *std::max_element(Persistence.begin(), middle)) / 2;
+	}
+
+	///Returns the number of pairs in each histogram bin.
+	const std::vector<TIndex>& GetHistogram() const { return Histogram; }
+
+protected:
+	float P;
+	float HistogramMax;
+	bool ComputeMedian;
+
+	TIndex NumberOfPairs;
+	double TotalPersistence;
+	double SumOfPowers;
+	double SumOfEntropyTerms;
+	float MaxPersistence;
+	std::vector<float> Persistence;
+	std::vector<TIndex> Histogram;
+};
+
+
+
+/*!
+	Finds the pair of a data index in constant time: "is this vertex an extremum, and which pair is it in?"
+
+	Build marks the paired extrema and the global minimum in a bit vector with one bit per data value, 
+	and stores the pair of each marked vertex in index order. The pair of a vertex is at the rank of its bit - 
+	the number of marked vertices before it - which is the count stored for its 64-bit word plus one population count.
+
+	Memory is one bit per data value for the bits, sizeof(TIndex) per 64 data values for the counts,
+	and sizeof(TIndex) per extremum. For 32-bit indices, this is 1.5 bits per data value plus 4 bytes per extremum.
+	Queries do not change the lookup, so any number of threads can query it at once.
+*/
+class PairLookup
+{
+public:
+	PairLookup():NumberOfSamples(0)
+	{
+	}
+
+	/*!
+		Builds the lookup. Takes linear time in the number of data values.
+
+		@param[in] pairs			Paired extrema, e.g. of Persistence1D::GetPairedExtrema without Matlab indexing.
+		@param[in] globalMinIndex	Index of the global minimum, or -1 if there is none.
+		@param[in] numberOfSamples	Number of data values. All indices must be smaller.
+	*/
+	void Build(const std::vector<TPairedExtrema>& pairs, const TIndex globalMinIndex, const size_t numberOfSamples)
+	{
+		NumberOfSamples = numberOfSamples;
+		Bits.assign((numberOfSamples + 63) / 64, 0);
+		for (std::vector<TPairedExtrema>::const_iterator p = pairs.begin(); p != pairs.end(); p++)
+		{
+			SetBit((*p).MinIndex);
+			SetBit((*p).MaxIndex);
+		}
+		if (globalMinIndex != -1) SetBit(globalMinIndex);
+
+		Ranks.resize(Bits.size());
+		TIndex rank = 0;
+		for (size_t w = 0; w != Bits.size(); w++)
+		{
+			Ranks[w] = rank;
+			rank += PopCount(Bits[w]);
+		}
+
+		Slots.resize(rank);
+		for (size_t p = 0; p != pairs.size(); p++)
+		{
+			Slots[GetRank(pairs[p].MinIndex)] = (TIndex)p;
+			Slots[GetRank(pairs[p].MaxIndex)] = (TIndex)p;
+		}
+		if (globalMinIndex != -1) Slots[GetRank(globalMinIndex)] = LOOKUP_GLOBAL_MINIMUM;
+	}
+
+	/*!
+		Returns the position in the pairs given to Build of the pair of a data index,
+		LOOKUP_GLOBAL_MINIMUM for the global minimum, and LOOKUP_NOT_PAIRED for any other index,
+		including extrema of pairs below the persistence threshold of the run, and indices outside the data.
+	*/
+	TIndex FindPair(const TIndex index) const
+	{
+		if (index < 0 || (size_t)index >= NumberOfSamples || !GetBit(index)) return LOOKUP_NOT_PAIRED;
+		return Slots[GetRank(index)];
+	}
+
+	///Returns the number of paired extrema, plus one for the global minimum.
+	size_t GetNumberOfExtrema() const
+	{
+		return Slots.size();
+	}
+
+protected:
+	std::vector<unsigned long long> Bits;
+	std::vector<TIndex> Ranks;		//number of set bits before each word of Bits.
+	std::vector<TIndex> Slots;		//pairs of the set bits, in index order.
+	size_t NumberOfSamples;
+
+	void SetBit(const TIndex index)
+	{
+		Bits[index / 64] |= 1ULL << (index % 64);
+	}
+
+	bool GetBit(const TIndex index) const
+	{
+		return ((Bits[index / 64] >> (index % 64)) & 1) != 0;
+	}
+
+	///Returns the number of set bits before index.
+	TIndex GetRank(const TIndex index) const
+	{
+		const unsigned long long below = (1ULL << (index % 64)) - 1;
+		return Ranks[index / 64] + PopCount(Bits[index / 64] & below);
+	}
+
+	static TIndex PopCount(unsigned long long word)
+	{
+#ifdef P1D_POPCOUNT64
+		return (TIndex)P1D_POPCOUNT64(word);
+#else
+		TIndex count = 0;
+		for (; word != 0; word &= word - 1) count++;
+		return count;
+#endif
+	}
+};
+
+
+/*!
+	Results of a run, separate from the data and working memory of the run.
+
+	Results are taken from Persistence1D::TakeResult, which moves the pairs instead of copying them.
+	A result never changes afterwards, so any number of threads can query it at once,
+	e.g. while a new result is computed (see ResultPublisher in persistence1d_publisher.hpp).
+	Queries are the same as those of Persistence1D, and GetPairs returns all pairs without copying them.
+	FindPair finds the pair of a data index in constant time, with a PairLookup built by the first query.
+*/
+class PersistenceResult
+{
+public:
+	PersistenceResult():GlobalMinIndex(-1),GlobalMinValue(0),NumberOfSamples(0),Lookup(NULL)
+	{
+	}
+
+	/*!
+		@param[in] pairs			Paired extrema, sorted according to persistence. Moved into the result.
+		@param[in] globalMinIndex	Index of the global minimum, or -1 if there is no data.
+		@param[in] globalMinValue	Value of the global minimum.
+		@param[in] numberOfSamples	Number of data values.
+	*/
+	PersistenceResult(std::vector<TPairedExtrema>&& pairs, const TIndex globalMinIndex, const float globalMinValue, const size_t numberOfSamples)
+		:PairedExtrema(std::move(pairs)),GlobalMinIndex(globalMinIndex),GlobalMinValue(globalMinValue),NumberOfSamples(numberOfSamples),Lookup(NULL)
+	{
+	}
+
+	///Copies the results. The lookup of FindPair is built again when needed.
+	PersistenceResult(const PersistenceResult& other)
+		:PairedExtrema(other.PairedExtrema),GlobalMinIndex(other.GlobalMinIndex),GlobalMinValue(other.GlobalMinValue),NumberOfSamples(other.NumberOfSamples),Lookup(NULL)
+	{
+	}
+
+	PersistenceResult(PersistenceResult&& other)
+		:PairedExtrema(std::move(other.PairedExtrema)),GlobalMinIndex(other.GlobalMinIndex),GlobalMinValue(other.GlobalMinValue),NumberOfSamples(other.NumberOfSamples),
+		Lookup(other.Lookup.exchange(NULL))
+	{
+		other.PairedExtrema.clear();
+		other.GlobalMinIndex = -1;
+		other.NumberOfSamples = 0;
+	}
+
+	PersistenceResult& operator=(PersistenceResult other)
+	{
+		PairedExtrema.swap(other.PairedExtrema);
+		GlobalMinIndex = other.GlobalMinIndex;
+		GlobalMinValue = other.GlobalMinValue;
+		NumberOfSamples = other.NumberOfSamples;
+		other.Lookup.store(Lookup.exchange(other.Lookup.load()));
+		return *this;
+	}
+
+	~PersistenceResult()
+	{
+		delete Lookup.load();
+	}
+
+	///Same as Persistence1D::GetPairedExtrema.
+	bool GetPairedExtrema(std::vector<TPairedExtrema> & pairs, const float threshold = 0, const bool matlabIndexing = false) const
+	{
+		pairs.clear();
+		if (PairedExtrema.empty() || threshold < 0.0) return false;
+
+		const size_t first = FindFirstPair(threshold);
+		if (first == PairedExtrema.size()) return false;
+
+		pairs.assign(PairedExtrema.begin() + first, PairedExtrema.end());
+		if (matlabIndexing)
+		{
+			for (std::vector<TPairedExtrema>::iterator p = pairs.begin(); p != pairs.end(); p++)
+			{
+				(*p).MinIndex += MATLAB_INDEX_FACTOR;
+				(*p).MaxIndex += MATLAB_INDEX_FACTOR;
+			}
+		}
+		return true;
+	}
+
+	///Same as Persistence1D::GetExtremaIndices.
+	bool GetExtremaIndices(std::vector<TIndex> & min, std::vector<TIndex> & max, const float threshold = 0, const bool matlabIndexing = false) const
+	{
+		min.clear();
+		max.clear();
+		if (PairedExtrema.empty() || threshold < 0.0) return false;
+
+		const TIndex matlabIndexFactor = matlabIndexing ? MATLAB_INDEX_FACTOR : 0;
+		for (size_t p = FindFirstPair(threshold); p != PairedExtrema.size(); p++)
+		{
+			min.push_back(PairedExtrema[p].MinIndex + matlabIndexFactor);
+			max.push_back(PairedExtrema[p].MaxIndex + matlabIndexFactor);
+		}
+		return true;
+	}
+
+	///Returns all paired extrema, sorted according to persistence.
+	const std::vector<TPairedExtrema>& GetPairs() const
+	{
+		return PairedExtrema;
+	}
+
+	///Returns the index in GetPairs of the first pair whose persistence is at least threshold, or the number of pairs.
+	size_t FindFirstPair(const float threshold) const
+	{
+		if (threshold <= 0) return 0;
+
+		TPairedExtrema searchPair;
+		searchPair.Persistence = threshold;
+		searchPair.MaxIndex = 0;
+		searchPair.MinIndex = 0;
+		return std::lower_bound(PairedExtrema.begin(), PairedExtrema.end(), searchPair) - PairedExtrema.begin();
+	}
+
+	size_t GetNumberOfPairs() const
+	{
+		return PairedExtrema.size();
+	}
+
+	///Same as Persistence1D::GetGlobalMinimumIndex.
+	TIndex GetGlobalMinimumIndex(const bool matlabIndexing = false) const
+	{
+		if (GlobalMinIndex == -1) return -1;
+		return GlobalMinIndex + (matlabIndexing ? MATLAB_INDEX_FACTOR : 0);
+	}
+
+	float GetGlobalMinimumValue() const
+	{
+		return GlobalMinValue;
+	}
+
+	size_t GetNumberOfSamples() const
+	{
+		return NumberOfSamples;
+	}
+
+	/*!
+		Returns the index in GetPairs of the pair of a data index, LOOKUP_GLOBAL_MINIMUM for the global minimum,
+		or LOOKUP_NOT_PAIRED. Takes constant time, after the first query, which builds the lookup in linear time.
+	*/
+	TIndex FindPair(const TIndex index) const
+	{
+		return GetLookup().FindPair(index);
+	}
+
+	/*!
+		Gets the pair of a data index, with its partner and persistence. 
+		Returns false if the index is not a paired extremum (e.g. the global minimum).
+	*/
+	bool GetPairOf(const TIndex index, TPairedExtrema& pair) const
+	{
+		const TIndex slot = FindPair(index);
+		if (slot < 0) return false;
+		pair = PairedExtrema[slot];
+		return true;
+	}
+
+	/*!
+		Returns the lookup of FindPair, and builds it if this is the first query.
+		Threads which query at the same time may each build a lookup, but only the first one is published and kept.
+	*/
+	const PairLookup& GetLookup() const
+	{
+		PairLookup * lookup = Lookup.load(std::memory_order_acquire);
+		if (lookup != NULL) return *lookup;
+
+		PairLookup * built = new PairLookup();
+		built->Build(PairedExtrema, GlobalMinIndex, NumberOfSamples);
+		if (Lookup.compare_exchange_strong(lookup, built, std::memory_order_acq_rel, std::memory_order_acquire)) return *built;
+
+		delete built;
+		return *lookup;
+	}
+
+protected:
+	std::vector<TPairedExtrema> PairedExtrema;
+	TIndex GlobalMinIndex;
+	float GlobalMinValue;
+	size_t NumberOfSamples;
+	mutable std::atomic<PairLookup*> Lookup;
+};
+
+
 
 /*! Finds extrema and their persistence in one-dimensional data.
 
@@ -106,11 +694,11 @@ struct TPairedExtrema
 class Persistence1D
 {
 public:
-	Persistence1D()
+	Persistence1D():TotalComponents(0),MinPersistence(0),StorePairs(true),NumberOfSamples(0),SortMethod(SORT_COMPARISON)
 	{
 	}
 
-	~Persistence1D()
+	virtual ~Persistence1D()
 	{
 	}
 			
@@ -123,26 +711,317 @@ public:
 		
 		Use PrintResults, GetPairedExtrema or GetExtremaIndices to get results of the function.
 
-		@param[in] InputData Vector of data to find features on, ordered according to its axis.
+		If minPersistence is set, pairs whose persistence is smaller than minPersistence are dropped
+		as soon as they are created. They are neither stored nor sorted, and cannot be retrieved later
+		with a smaller threshold. Results are identical to filtering a full run with the same threshold.
+
+		@param[in] InputData		Vector of data to find features on, ordered according to its axis.
+		@param[in] minPersistence	Minimal persistence of stored pairs. If left to default, all pairs are stored.
 	*/
-	bool RunPersistence(const std::vector<float>& InputData)
+	bool RunPersistence(const std::vector<float>& InputData, const float minPersistence = 0)
 	{	
 		Data = InputData; 
-		Init();
+		return ComputePersistence(minPersistence);
+	}
 
-		//If a user runs this on an empty vector, then they should not get the results of the previous run.
-		if (Data.empty()) return false;
+	/*!
+		Same as RunPersistence with a data vector, for data in a buffer 
+		(e.g., memory owned by another application). The buffer is copied once.
 
-		CreateIndexValueVector();
-		Watershed();
-		SortPairedExtrema();
+		@param[in] InputData		Pointer to data to find features on, ordered according to its axis.
+		@param[in] size				Number of data values.
+		@param[in] minPersistence	Minimal persistence of stored pairs. If left to default, all pairs are stored.
+	*/
+	bool RunPersistence(const float * InputData, const size_t size, const float minPersistence = 0)
+	{	
+		Data.assign(InputData, InputData + size); 
+		return ComputePersistence(minPersistence);
+	}
+
+	/*!
+		Same as RunPersistence, and notifies a visitor of each created component, merge and pair as soon as it happens.
+		See TNullVisitor for the functions a visitor has to provide.
+
+		Pairs are reported in the order they are created, not sorted according to persistence. 
+		If storePairs is false, pairs are only reported to the visitor, and are not stored nor sorted.
+		The global minimum is available in either case.
+
+		@param[in]		InputData		Vector of data to find features on, ordered according to its axis.
+		@param[in,out]	visitor			Visitor to notify.
+		@param[in]		storePairs		Set this to false to skip storing pairs.
+		@param[in]		minPersistence	Minimal persistence of reported and stored pairs.
+	*/
+	template <class TVisitor>
+	bool RunPersistence(const std::vector<float>& InputData, TVisitor& visitor, const bool storePairs = true, const float minPersistence = 0)
+	{	
+		Data = InputData; 
+		return ComputePersistence(minPersistence, visitor, storePairs);
+	}
+
+	/*!
+		Same as RunPersistence with a visitor, for data in a buffer.
+	*/
+	template <class TVisitor>
+	bool RunPersistence(const float * InputData, const size_t size, TVisitor& visitor, const bool storePairs = true, const float minPersistence = 0)
+	{	
+		Data.assign(InputData, InputData + size); 
+		return ComputePersistence(minPersistence, visitor, storePairs);
+	}
+
+	/*!
+		Same as RunPersistence for data in a buffer, using as little memory as possible. Results are identical.
+
+		The data is not copied, and is read directly from the buffer during the run.
+		Instead of sorting and coloring all vertices, only local minima and maxima are found:
+		Between two neighboring minima, there is exactly one maximum. Maxima are sorted, and merge the
+		sets of minima on both sides of them (union-find), from the smallest maximum to the largest.
+
+		Working memory is 4 bytes per local extremum (sizeof(TIndex)) for the indices of minima, maxima, and union-find parents.
+		This is at most 6 bytes per data value, about 4 bytes per value for noise, and much less for smooth data. 
+		The results themselves take 12 bytes per pair, like a regular run.
+		A regular run needs about 16 bytes per data value in addition to the results.
+
+		Since data is not kept, UpdateValues cannot be used after this run.
+
+		With P1D_PAIR_ATTRIBUTES, each set of minima also keeps the edges and the sum of values of its basin.
+		They are only grown when a maximum merges the set, up to the level of that maximum, so each vertex is added once.
+		This takes another 16 bytes per local minimum (24 with P1D_64BIT_INDICES).
+
+		@param[in] InputData		Pointer to data to find features on, ordered according to its axis.
+		@param[in] size				Number of data values.
+		@param[in] minPersistence	Minimal persistence of stored pairs. If left to default, all pairs are stored.
+	*/
+	bool RunPersistenceLowMemory(const float * InputData, const size_t size, const float minPersistence = 0)
+	{
+		//release memory of previous runs
+		std::vector<float>().swap(Data);
+		std::vector<TIdxAndData>().swap(SortedData);
+		std::vector<TIndex>().swap(Colors);
+		std::vector<TComponent>().swap(Components);
+		std::vector<TPairedExtrema>().swap(PairedExtrema);
+
+		TotalComponents = 0;
+		AliveComponentsVerified = false;
+		MinPersistence = minPersistence;
+		StorePairs = true;
+		NumberOfSamples = size;
+
+		if (size == 0) return false;
+		if (size - 1 > (size_t)std::numeric_limits<TIndex>::max()) return false;
+
+		//count extrema first, so vectors are allocated at their final size
+		const TVertexLess less(InputData);
+		size_t numMinima = 0, numMaxima = 0;
+		for (size_t i = 0; i != size; i++)
+		{
+			numMinima += IsLocalMinimum(less, i, size);
+			numMaxima += IsLocalMaximum(less, i, size);
+		}
+
+		std::vector<TIndex> minima, maxima;
+		minima.reserve(numMinima);
+		maxima.reserve(numMaxima);
+		for (size_t i = 0; i != size; i++)
+		{
+			if (IsLocalMinimum(less, i, size)) minima.push_back((TIndex)i);
+			else if (IsLocalMaximum(less, i, size)) maxima.push_back((TIndex)i);
+		}
 #ifdef _DEBUG
-		VerifyAliveComponents();	
+		assert(minima.size() == maxima.size() + 1);
 #endif
+
+		std::sort(maxima.begin(), maxima.end(), less);
+
+		//each set of minima is represented by its smallest minimum
+		std::vector<TIndex> parent(minima.size());
+		for (size_t i = 0; i != parent.size(); i++)
+		{
+			parent[i] = (TIndex)i;
+		}
+
+#ifdef P1D_PAIR_ATTRIBUTES
+		//basin of each set, valid for its representative
+		std::vector<TIndex> leftEdges(minima), rightEdges(minima);
+		std::vector<double> sums(minima.size());
+		for (size_t i = 0; i != sums.size(); i++)
+		{
+			sums[i] = InputData[minima[i]];
+		}
+#endif
+
+		PairedExtrema.reserve(maxima.size());
+		for (std::vector<TIndex>::const_iterator max = maxima.begin(); max != maxima.end(); max++)
+		{
+			//the maximum is between the minima at position right-1 and right
+			TIndex right = (TIndex)(std::upper_bound(minima.begin(), minima.end(), *max) - minima.begin());
+			TIndex leftSet = FindSet(parent, right - 1);
+			TIndex rightSet = FindSet(parent, right);
+
+			//the set with the larger minimum is destroyed, as in MergeComponents
+			TIndex survivor = leftSet, destroyed = rightSet;
+			if (less(minima[rightSet], minima[leftSet])) std::swap(survivor, destroyed);
+			parent[destroyed] = survivor;
+
+			TPairedExtrema pair = MakePairedExtrema(minima[destroyed], InputData[minima[destroyed]], *max, InputData[*max]);
+#ifdef P1D_PAIR_ATTRIBUTES
+			//both basins grow up to the maximum - the slopes between them and the next maxima are monotone
+			GrowBasin(less, size, *max, leftEdges[leftSet], rightEdges[leftSet], sums[leftSet]);
+			GrowBasin(less, size, *max, leftEdges[rightSet], rightEdges[rightSet], sums[rightSet]);
+			pair.Width = rightEdges[destroyed] - leftEdges[destroyed] + 1;
+			pair.Area = sums[destroyed];
+
+			//the merged basin includes the maximum, as in MergeComponents
+			const double sum = sums[leftSet] + sums[rightSet] + InputData[*max];
+			leftEdges[survivor] = leftEdges[leftSet];
+			rightEdges[survivor] = rightEdges[rightSet];
+			sums[survivor] = sum;
+#endif
+			if (pair.Persistence >= MinPersistence) PairedExtrema.push_back(pair);
+		}
+
+		TComponent globalMinimum;
+		globalMinimum.MinIndex = minima[FindSet(parent, 0)];
+		globalMinimum.MinValue = InputData[globalMinimum.MinIndex];
+		globalMinimum.LeftEdgeIndex = 0;
+		globalMinimum.RightEdgeIndex = (TIndex)size - 1;
+		globalMinimum.Alive = true;
+		Components.push_back(globalMinimum);
+		TotalComponents = 1;
+
+		SortPairedExtrema();
 		return true;
 	}
 
 
+	/*!
+		Changes a single data value and updates the results of the last RunPersistence accordingly. 
+		See UpdateValues.
+
+		@param[in] index	Index of the changed vertex in the data vector.
+		@param[in] value	New data value.
+	*/
+	bool UpdateValue(const TIndex index, const float value)
+	{
+		return UpdateValues(std::vector<TIndex>(1, index), std::vector<float>(1, value));
+	}
+
+	/*!
+		Changes data values and updates the results of the last RunPersistence accordingly, 
+		as if RunPersistence was called again on the changed data.
+		
+		Only the neighborhood of the changed vertices is recomputed: the smallest interval around them
+		which is bounded by larger vertices (before and after the change) and whose minimum did not change.
+		Pairs inside such an interval do not depend on data outside of it, and pairs outside of it 
+		only depend on its minimum. 
+		If the interval grows to the whole domain (e.g., when the global minimum changes), 
+		persistence is run again on all data.
+
+		With P1D_PAIR_ATTRIBUTES, persistence is always run again on all data, 
+		since a change changes the attributes of all pairs whose basins contain it.
+
+		Returns false if no data was processed yet, the last run did not store pairs, or an index is out of range. 
+		Data is not changed in this case.
+
+		@param[in] indices	Indices of changed vertices. If an index appears more than once, its last value is used.
+		@param[in] values	New data values, one per index.
+	*/
+	bool UpdateValues(const std::vector<TIndex>& indices, const std::vector<float>& values)
+	{
+		if (Data.empty() || !StorePairs || indices.size() != values.size()) return false;
+
+		for (std::vector<TIndex>::const_iterator it = indices.begin(); it != indices.end(); it++)
+		{
+			if (*it < 0 || *it >= (TIndex)Data.size()) return false;
+		}
+
+		//remember the original values of the changed vertices, then change them
+		std::vector<TIdxAndData> oldValues;
+		oldValues.reserve(indices.size());
+		for (std::vector<TIndex>::size_type i = 0; i != indices.size(); i++)
+		{
+			TIdxAndData oldValue;
+			oldValue.Idx = indices[i];
+			oldValue.Data = Data[indices[i]];
+			oldValues.push_back(oldValue);
+
+			Data[indices[i]] = values[i];
+		}
+#ifdef P1D_PAIR_ATTRIBUTES
+		return ComputePersistence(MinPersistence);
+#else
+		std::stable_sort(oldValues.begin(), oldValues.end(), IdxLess);
+		oldValues.erase(std::unique(oldValues.begin(), oldValues.end(), IdxEqual), oldValues.end());
+
+		//find disjoint intervals which contain all changes
+		std::vector<TUpdateInterval> intervals;
+		for (std::vector<TIdxAndData>::const_iterator it = oldValues.begin(); it != oldValues.end(); it++)
+		{
+			if (!intervals.empty() && (*it).Idx <= intervals.back().Last) continue;
+
+			TUpdateInterval interval;
+			interval.First = interval.Last = (*it).Idx;
+			interval.Max = GetVertex((*it).Idx, oldValues, true);
+			interval.OldMin = interval.Max;
+			interval.NewMin = GetVertex((*it).Idx, oldValues, false);
+			AddToInterval(interval, (*it).Idx, oldValues);
+			ExpandInterval(interval, oldValues);
+
+			while (!intervals.empty() && interval.First <= intervals.back().Last)
+			{
+				const TUpdateInterval& previous = intervals.back();
+				interval.First = std::min(interval.First, previous.First);
+				if (interval.Max < previous.Max) interval.Max = previous.Max;
+				if (previous.OldMin < interval.OldMin) interval.OldMin = previous.OldMin;
+				if (previous.NewMin < interval.NewMin) interval.NewMin = previous.NewMin;
+				intervals.pop_back();
+				ExpandInterval(interval, oldValues);
+			}
+
+			if (interval.First == 0 && interval.Last == (TIndex)Data.size() - 1)
+			{
+				return ComputePersistence(MinPersistence);
+			}
+			intervals.push_back(interval);
+		}
+
+		//compute the new pairs inside the intervals
+		Persistence1D local;
+		std::vector<float> localData;
+		std::vector<TPairedExtrema> localPairs, newPairs;
+		float maxPersistence = 0;
+		for (std::vector<TUpdateInterval>::const_iterator it = intervals.begin(); it != intervals.end(); it++)
+		{
+			localData.assign(Data.begin() + (*it).First, Data.begin() + (*it).Last + 1);
+			local.RunPersistence(localData, MinPersistence);
+			local.GetPairedExtrema(localPairs);
+
+			for (std::vector<TPairedExtrema>::iterator p = localPairs.begin(); p != localPairs.end(); p++)
+			{
+				(*p).MinIndex += (*it).First;
+				(*p).MaxIndex += (*it).First;
+				newPairs.push_back(*p);
+			}
+
+			//pairs inside an interval cannot be more persistent than its range
+			maxPersistence = std::max(maxPersistence, (*it).Max.Data - std::min((*it).OldMin.Data, (*it).NewMin.Data));
+		}
+		std::sort(newPairs.begin(), newPairs.end());
+
+		//remove the old pairs inside the intervals - all of them are found before maxPersistence
+		size_t scanned = 0, kept = 0;
+		for (; scanned != PairedExtrema.size() && PairedExtrema[scanned].Persistence <= maxPersistence; scanned++)
+		{
+			if (!IsInsideInterval(PairedExtrema[scanned], intervals)) PairedExtrema[kept++] = PairedExtrema[scanned];
+		}
+		PairedExtrema.erase(PairedExtrema.begin() + kept, PairedExtrema.begin() + scanned);
+
+		PairedExtrema.insert(PairedExtrema.begin() + kept, newPairs.begin(), newPairs.end());
+		std::inplace_merge(PairedExtrema.begin(), PairedExtrema.begin() + kept, PairedExtrema.begin() + kept + newPairs.size());
+		return true;
+#endif
+	}
+
+
 
 	/*!
 		Prints the contents of the TPairedExtrema vector.
@@ -238,7 +1117,7 @@ public:
 	@param[in]	threshold		Return only indices for pairs whose persistence is greater than or equal to threshold. 
 	@param[in]	matlabIndexing	Set this to true to change all indices to match Matlab's 1-indexing.
 */
-	bool GetExtremaIndices(std::vector<int> & min, std::vector<int> & max, const float threshold = 0, const bool matlabIndexing = false) const
+	bool GetExtremaIndices(std::vector<TIndex> & min, std::vector<TIndex> & max, const float threshold = 0, const bool matlabIndexing = false) const
 	{
 		//before doing anything, make sure the user does not use old results
 		min.clear();
@@ -261,12 +1140,115 @@ public:
 		}
 		return true;
 	}
+
+	/*!
+		Computes the number of paired extrema for many thresholds at once, e.g. to plot
+		the number of features against the threshold.
+		
+		For each threshold, counts[i] is the number of pairs whose persistence is greater than or equal to thresholds[i],
+		and offsets[i] is the index of the first of these pairs in the results of GetPairedExtrema with threshold 0, 
+		i.e. offsets[i] + counts[i] is the total number of pairs. The global minimum is not counted.
+
+		All thresholds are handled in a single pass over the sorted pairs, and nothing is allocated.
+		Returns false if thresholds are not sorted in ascending order, without writing any output.
+
+		@param[in]	thresholds		Thresholds, sorted in ascending order.
+		@param[in]	numThresholds	Number of thresholds.
+		@param[out] counts			Number of pairs per threshold. Must have room for numThresholds values. Ignored if NULL.
+		@param[out]	offsets			Index of first pair per threshold. Must have room for numThresholds values. Ignored if NULL.
+	*/
+	bool GetPersistenceCurve(const float * thresholds, const size_t numThresholds, TIndex * counts, TIndex * offsets = NULL) const
+	{
+		if (!std::is_sorted(thresholds, thresholds + numThresholds)) return false;
+
+		const TIndex numPairs = (TIndex)PairedExtrema.size();
+		TIndex first = 0;
+		
+		for (size_t t = 0; t < numThresholds; t++)
+		{
+			//same as FilterByPersistence, but continues from the previous threshold
+			while (first < numPairs && PairedExtrema[first].Persistence < thresholds[t]) first++;
+
+			if (counts != NULL) counts[t] = numPairs - first;
+			if (offsets != NULL) offsets[t] = first;
+		}
+		return true;
+	}
+
+	/*!
+		Writes a simplified version of the data, whose only extrema are the global minimum and the paired extrema 
+		with persistence greater than or equal to threshold. All other pairs are flattened.
+
+		Between two neighboring kept extrema, the output is monotone: the average of the running maximum from one side
+		and the running minimum from the other side, clamped to the values of the two extrema. 
+		Kept extrema keep their values, and no value changes by more than threshold/2.
+		Runs of equal output values may add pairs with persistence 0, otherwise a run on the output finds the kept pairs.
+
+		Takes linear time and 1 byte of working memory per data value. 
+		Not available after RunPersistenceLowMemory, or if pairs below threshold were dropped by minPersistence.
+		For smooth reconstructions, see Reconstruct1D.
+
+		@param[in]	threshold	Minimal persistence of kept pairs.
+		@param[out]	out			Simplified data. Must have room for GetNumberOfSamples() values.
+	*/
+	bool Simplify(const float threshold, float * out) const
+	{
+		return Simplify(&threshold, 1, &out);
+	}
+
+	/*!
+		Same as Simplify, for many thresholds sorted in descending order. 
+		Each output starts as a copy of the previous one, and only the parts of data between extrema
+		around newly kept pairs are computed again.
+
+		@param[in]	thresholds		Thresholds, sorted in descending order.
+		@param[in]	numThresholds	Number of thresholds.
+		@param[out]	outs			Simplified data per threshold, each with room for GetNumberOfSamples() values.
+	*/
+	bool Simplify(const float * thresholds, const size_t numThresholds, float * const * outs) const
+	{
+		const TIndex globalMinIdx = GetGlobalMinimumIndex();
+		if (Data.empty() || !StorePairs || globalMinIdx < 0) return false;
+		for (size_t t = 0; t < numThresholds; t++)
+		{
+			if (thresholds[t] < 0 || thresholds[t] < MinPersistence) return false;
+			if (t > 0 && thresholds[t] > thresholds[t-1]) return false;
+		}
+
+		//SIMPLIFY_KEPT_OLD for extrema of previous outputs, SIMPLIFY_KEPT_NEW for extrema added by the current threshold
+		std::vector<unsigned char> kept(Data.size(), 0);
+		kept[globalMinIdx] = SIMPLIFY_KEPT_NEW;
+		std::vector<TIndex> added(1, globalMinIdx);
+
+		std::vector<TPairedExtrema>::const_iterator previous = PairedExtrema.end();
+		for (size_t t = 0; t < numThresholds; t++)
+		{
+			std::vector<TPairedExtrema>::const_iterator first = FilterByPersistence(thresholds[t]);
+			for (std::vector<TPairedExtrema>::const_iterator p = first; p != previous; p++)
+			{
+				kept[(*p).MinIndex] = kept[(*p).MaxIndex] = SIMPLIFY_KEPT_NEW;
+				added.push_back((*p).MinIndex);
+				added.push_back((*p).MaxIndex);
+			}
+			previous = first;
+
+			if (t > 0) std::copy(outs[t-1], outs[t-1] + Data.size(), outs[t]);
+			for (std::vector<TIndex>::const_iterator it = added.begin(); it != added.end(); it++)
+			{
+				//extrema already handled with another extremum in the same region are SIMPLIFY_KEPT_OLD now
+				if (kept[*it] == SIMPLIFY_KEPT_NEW) SimplifyRegion(*it, kept, outs[t]);
+			}
+			added.clear();
+		}
+		return true;
+	}
+
 	/*!
 		Returns the index of the global minimum. 
 		The global minimum does not get paired and is not returned 
 		via GetPairedExtrema and GetExtremaIndices.
 	*/
-	int GetGlobalMinimumIndex(const bool matlabIndexing = false) const
+	TIndex GetGlobalMinimumIndex(const bool matlabIndexing = false) const
 	{
 		if (Components.empty()) return -1;
 
@@ -291,6 +1273,65 @@ public:
 		assert(Components.front().Alive);
 		return Components.front().MinValue;
 	}
+
+	///Returns the number of data values of the last run.
+	size_t GetNumberOfSamples() const
+	{
+		return NumberOfSamples;
+	}
+
+	/*!
+		Sets how RunPersistence sorts data values. Results are identical for all methods.
+
+		- SORT_COMPARISON: std::sort. The default.
+		- SORT_RADIX: least significant digit radix sort on the bits of the values, RADIX_BITS bits per pass.
+		  Passes over bits which are equal in all values are skipped, e.g. the high bits of small integers.
+		  Needs memory for a second copy of the sorted values.
+		- SORT_CUSTOM: sortFunction, e.g. ParallelSort of persistence1d_dispatch.hpp on several threads.
+		- SORT_WARM_START: starts from the sorted order of the previous run, with the new values, and repairs it 
+		  with an insertion sort, in time proportional to the number of values plus the number of pairs of values 
+		  whose order changed. Fast for data which changes little between runs, e.g. frames or parameter sweeps.
+		  If more than WARM_START_MAX_MOVES moves per value are needed, the rest is sorted with std::sort and merged.
+		  The first run, and runs on data of a different size, sort from scratch.
+
+		See PersistenceDispatcher (persistence1d_dispatch.hpp) to choose the method automatically.
+
+		@param[in] method		One of SORT_COMPARISON, SORT_RADIX, SORT_CUSTOM and SORT_WARM_START.
+		@param[in] sortFunction	Sort of SORT_CUSTOM. Required for SORT_CUSTOM, ignored otherwise.
+	*/
+	bool SetSortMethod(const int method, const TSortFunction& sortFunction = TSortFunction())
+	{
+		if (method != SORT_COMPARISON && method != SORT_RADIX && method != SORT_CUSTOM && method != SORT_WARM_START) return false;
+		if (method == SORT_CUSTOM && !sortFunction) return false;
+		SortMethod = method;
+		SortFunction = (method == SORT_CUSTOM) ? sortFunction : TSortFunction();
+		return true;
+	}
+
+	int GetSortMethod() const
+	{
+		return SortMethod;
+	}
+
+	///Returns the sort of SORT_CUSTOM, or an empty function for other methods.
+	const TSortFunction& GetSortFunction() const
+	{
+		return SortFunction;
+	}
+
+	/*!
+		Moves the results of the last run into a PersistenceResult, without copying the pairs.
+		Afterwards, this object holds no results and no data, as if it ran on empty data,
+		but keeps its working memory for the next run. UpdateValues needs a new run.
+	*/
+	PersistenceResult TakeResult()
+	{
+		PersistenceResult result(std::move(PairedExtrema), GetGlobalMinimumIndex(), GetGlobalMinimumValue(), NumberOfSamples);
+		std::vector<float>().swap(Data);
+		Init();
+		return result;
+	}
+
 	/*!
 		Runs basic sanity checks on results of RunPersistence: 
 		- Number of unique minima = number of unique maxima - 1 (Morse property)
@@ -304,12 +1345,12 @@ public:
 	bool VerifyResults() 
 	{
 		bool flag = true; 
-		std::vector<int> min, max;
-		std::vector<int> combinedIndices;
+		std::vector<TIndex> min, max;
+		std::vector<TIndex> combinedIndices;
 		
 		GetExtremaIndices(min, max);
 
-		int globalMinIdx = GetGlobalMinimumIndex();
+		TIndex globalMinIdx = GetGlobalMinimumIndex();
 				
 		std::sort(min.begin(), min.end());
 		std::sort(max.begin(), max.end());
@@ -323,11 +1364,11 @@ public:
 		   flag = false;
 		}
 
-		if ((globalMinIdx > (int)Data.size()-1) || (globalMinIdx < -1)) flag = false;
+		if ((globalMinIdx > (TIndex)NumberOfSamples-1) || (globalMinIdx < -1)) flag = false;
 		if (globalMinIdx == -1 && min.size() != 0) flag = false;
 		
-		std::vector<int>::iterator minUniqueEnd = std::unique(min.begin(), min.end());
-		std::vector<int>::iterator maxUniqueEnd = std::unique(max.begin(), max.end());
+		std::vector<TIndex>::iterator minUniqueEnd = std::unique(min.begin(), min.end());
+		std::vector<TIndex>::iterator maxUniqueEnd = std::unique(max.begin(), max.end());
 				
 		if (minUniqueEnd != min.end() ||
 			maxUniqueEnd != max.end() ||
@@ -353,11 +1394,12 @@ protected:
 
 
 	/*!
-		Contains the Component assignment for each vertex in Data. 
+		Contains the Component assignment for each vertex in Data, shifted by one: the color of vertex i is Colors[i+1].
+		The first and last entries are always NO_COLOR, so vertices at the boundary need no special case.
 		Only edges of destroyed components are updated to the new component color.
 		The Component values in this vector are invalid at the end of the algorithm.
 	*/
-	std::vector<int> Colors;		//need to init to empty
+	std::vector<TIndex> Colors;		//need to init to empty
 
 
 	/*!
@@ -373,10 +1415,91 @@ protected:
 	std::vector<TPairedExtrema> PairedExtrema;
 	
 		
-	unsigned int TotalComponents;	//keeps track of component vector size and newest component "color"
+	/*!
+		An interval of data around changed vertices, used by UpdateValues.
+	*/
+	struct TUpdateInterval
+	{
+		TIndex First;
+		TIndex Last;
+
+		///The largest vertex inside the interval, before or after the change.
+		TIdxAndData Max;
+
+		///The smallest vertex inside the interval before the change.
+		TIdxAndData OldMin;
+
+		///The smallest vertex inside the interval after the change.
+		TIdxAndData NewMin;
+	};
+
+	TIndex TotalComponents;			//keeps track of component vector size and newest component "color"
+	float MinPersistence;			//pairs below this persistence are not stored, see RunPersistence
+	bool StorePairs;				//false if pairs are only reported to a visitor
 	bool AliveComponentsVerified;	//Index of global minimum in Data vector. This minimum is never paired.
+	size_t NumberOfSamples;			//size of data of the last run, Data is empty after RunPersistenceLowMemory
+	int SortMethod;					//see SetSortMethod
+	TSortFunction SortFunction;		//sort of SORT_CUSTOM
 	
 	
+	/*!
+		Runs the algorithm on Data, see RunPersistence.
+	*/
+	bool ComputePersistence(const float minPersistence)
+	{
+		TNullVisitor visitor;
+		return ComputePersistence(minPersistence, visitor, true);
+	}
+
+	template <class TVisitor>
+	bool ComputePersistence(const float minPersistence, TVisitor& visitor, const bool storePairs)
+	{
+		PhaseStarted(PHASE_RUN);
+		Init();
+		MinPersistence = minPersistence;
+		StorePairs = storePairs;
+
+		//If a user runs this on an empty vector, then they should not get the results of the previous run.
+		//Indices of vertices, and of their padded colors up to Data.size() + 1, must also fit in TIndex.
+		if (Data.empty() || Data.size() + 1 > (size_t)std::numeric_limits<TIndex>::max())
+		{
+			PhaseFinished(PHASE_RUN);
+			return false;
+		}
+
+		PhaseStarted(PHASE_CREATE_INDEX_VALUE_VECTOR);
+		CreateIndexValueVector();
+		PhaseFinished(PHASE_CREATE_INDEX_VALUE_VECTOR);
+
+		PhaseStarted(PHASE_WATERSHED);
+		Watershed(visitor);
+		PhaseFinished(PHASE_WATERSHED);
+
+		PhaseStarted(PHASE_SORT_PAIRED_EXTREMA);
+		SortPairedExtrema();
+		PhaseFinished(PHASE_SORT_PAIRED_EXTREMA);
+#ifdef _DEBUG
+		VerifyAliveComponents();	
+#endif
+		PhaseFinished(PHASE_RUN);
+		return true;
+	}
+
+	/*!
+		Called by every run at the start of each phase: PHASE_RUN around the whole run, 
+		then PHASE_CREATE_INDEX_VALUE_VECTOR, PHASE_WATERSHED and PHASE_SORT_PAIRED_EXTREMA in turn.
+		Does nothing. Derived classes override it to measure phases, see TracedPersistence1D.
+	*/
+	virtual void PhaseStarted(const int /*phase*/)
+	{
+	}
+
+	///Called by every run at the end of each phase, see PhaseStarted.
+	virtual void PhaseFinished(const int /*phase*/)
+	{
+	}
+
+
 	/*!
 		Merges two components by doing the following:
 
@@ -385,10 +1508,13 @@ protected:
 		- Updates the destroyed component's edge vertex colors to the survivor's color in Colors[].
 
 		@param[in] firstIdx,secondIdx	Indices of components to be merged. Their order does not matter. 
+		@param[in] maxIdx				Index of the local maximum which merges the components.
+		@param[in,out] visitor			Visitor to notify of the merge.
 	*/
-	void MergeComponents(const int firstIdx, const int secondIdx)
+	template <class TVisitor>
+	void MergeComponents(const TIndex firstIdx, const TIndex secondIdx, const TIndex maxIdx, TVisitor& visitor)
 	{
-		int survivorIdx, destroyedIdx;
+		TIndex survivorIdx, destroyedIdx;
 		//survivor - component whose hub is bigger
 		if (Components[firstIdx].MinValue < Components[secondIdx].MinValue)
 		{
@@ -414,10 +1540,14 @@ protected:
 
 		//survivor and destroyed are decided, now destroy!
 		Components[destroyedIdx].Alive = false;
+#ifdef P1D_PAIR_ATTRIBUTES
+		Components[survivorIdx].Sum += Components[destroyedIdx].Sum + Data[maxIdx];
+#endif
+		visitor.ComponentsMerged(Components[survivorIdx].MinIndex, Components[destroyedIdx].MinIndex, maxIdx);
 
 		//Update the color of the edges of the destroyed component to the color of the surviving component.
-		Colors[Components[destroyedIdx].RightEdgeIndex] = survivorIdx;
-		Colors[Components[destroyedIdx].LeftEdgeIndex] = survivorIdx;
+		Colors[Components[destroyedIdx].RightEdgeIndex + 1] = survivorIdx;
+		Colors[Components[destroyedIdx].LeftEdgeIndex + 1] = survivorIdx;
 
 		//Update the relevant edge index of surviving component, such that it contains the destroyed component's region.
 		if (Components[survivorIdx].MinIndex > Components[destroyedIdx].MinIndex) //destroyed index to the left of survivor, update left edge
@@ -432,42 +1562,32 @@ protected:
 	
 	/*!
 		Creates a new PairedExtrema from the two indices, and adds it to PairedFeatures.
+		Pairs whose persistence is smaller than MinPersistence are discarded.
+		Pairs are added only if StorePairs is set, but always reported to the visitor.
 
 		@param[in] firstIdx, secondIdx Indices of vertices to be paired. Order does not matter. 
+		@param[in,out] visitor			Visitor to notify of the pair.
 	*/
-	void CreatePairedExtrema(const int firstIdx, const int secondIdx)
+	template <class TVisitor>
+	void CreatePairedExtrema(const TIndex firstIdx, const TIndex secondIdx, TVisitor& visitor)
 	{
-		TPairedExtrema pair; 
-		
-		//There might be a potential bug here, todo (we're checking data, not sorted data)
-		//example case: 1 1 1 1 1 1 -5 might remove if after else
-		if (Data[firstIdx] > Data[secondIdx])
-		{
-			pair.MaxIndex = firstIdx; 
-			pair.MinIndex = secondIdx;
-		}
-		else if (Data[secondIdx] > Data[firstIdx])
-		{
-			pair.MaxIndex = secondIdx; 
-			pair.MinIndex = firstIdx;
-		}
-		//both values are equal, choose the left one as the min
-		else if (firstIdx < secondIdx)
-		{
-			pair.MinIndex = firstIdx;
-			pair.MaxIndex = secondIdx;
-		}
-		else 
-		{
-			pair.MinIndex = secondIdx;
-			pair.MaxIndex = firstIdx;
-		}
-				
-		pair.Persistence = Data[pair.MaxIndex] - Data[pair.MinIndex];
+		TPairedExtrema pair = MakePairedExtrema(firstIdx, Data[firstIdx], secondIdx, Data[secondIdx]); 
 
 #ifdef _DEBUG
 		assert(pair.Persistence >= 0);
 #endif
+		if (pair.Persistence < MinPersistence) return;
+
+#ifdef P1D_PAIR_ATTRIBUTES
+		//firstIdx is the minimum of the destroyed component. The component is still alive, so its minimum keeps its color.
+		const TComponent& destroyed = Components[Colors[firstIdx + 1]];
+		pair.Width = destroyed.RightEdgeIndex - destroyed.LeftEdgeIndex + 1;
+		pair.Area = destroyed.Sum;
+#endif
+
+		visitor.PairCreated(pair);
+		if (!StorePairs) return;
+
 		if (PairedExtrema.capacity() == PairedExtrema.size()) 
 		{
 			PairedExtrema.reserve(PairedExtrema.size() * 2 + 1);
@@ -484,11 +1604,13 @@ protected:
 	Neighboring vertices are assumed to have no color.
 	- Adds a new component to the components vector, 
 	- Initializes its edges and minimum index to minIdx.
-	- Updates Colors[minIdx] to the component's color.
+	- Updates the color of minIdx to the component's color.
 
 	@param[in]	minIdx Index of a local minimum. 
+	@param[in,out] visitor Visitor to notify of the new component.
 	*/
-	void CreateComponent(const int minIdx)
+	template <class TVisitor>
+	void CreateComponent(const TIndex minIdx, TVisitor& visitor)
 	{
 		TComponent comp;
 		comp.Alive = true;
@@ -496,16 +1618,21 @@ protected:
 		comp.RightEdgeIndex = minIdx;
 		comp.MinIndex = minIdx;
 		comp.MinValue = Data[minIdx];
+#ifdef P1D_PAIR_ATTRIBUTES
+		comp.Sum = Data[minIdx];
+#endif
 
 		//place at the end of component vector and get the current size
-		if (Components.capacity() <= TotalComponents)
+		if (Components.capacity() <= (size_t)TotalComponents)
 		{	
 			Components.reserve(2 * TotalComponents + 1);
 		}
 
 		Components.push_back(comp);
-		Colors[minIdx] = TotalComponents;
+		Colors[minIdx + 1] = TotalComponents;
 		TotalComponents++;
+
+		visitor.ComponentCreated(minIdx, comp.MinValue);
 	}
 
 
@@ -513,37 +1640,30 @@ protected:
 		Extends the component's region by one vertex:
 			
 		- Updates the matching component's edge to dataIdx..
-		- updates Colors[dataIdx] to the component's color.
+		- updates the color of dataIdx to the component's color.
 
-		@param[in]	componentIdx	Index of component (the value of a neighboring vertex in Colors[]).
+		Both edges are written with conditional moves instead of a branch on the side of the vertex,
+		which is as unpredictable as the data.
+
+		@param[in]	componentIdx	Index of component (the color of a neighboring vertex).
 		@param[in] 	dataIdx			Index of vertex which the component is extended to.
 	*/
-	void ExtendComponent(const int componentIdx, const int dataIdx)
+	void ExtendComponent(const TIndex componentIdx, const TIndex dataIdx)
 	{
-#ifdef _DEUBG
-		assert(Components[componentIdx].Alive == true)
+		TComponent& component = Components[componentIdx];
+#ifdef _DEBUG
+		assert(component.Alive);
+		assert(dataIdx + 1 == component.LeftEdgeIndex || dataIdx - 1 == component.RightEdgeIndex);
 #endif 
 
-		//extend to the left
-		if (dataIdx + 1 == Components[componentIdx].LeftEdgeIndex)
-		{
-			Components[componentIdx].LeftEdgeIndex = dataIdx;
-		}
-		//extend to the right
-		else if (dataIdx - 1 == Components[componentIdx].RightEdgeIndex) 
-		{
-			Components[componentIdx].RightEdgeIndex = dataIdx;
-		}
-		else
-		{
-#ifdef _DEUBG
-			std::string errorMessage = "ExtendComponent: index mismatch. Data index: ";
-			errorMessage += std::to_string((long long)dataIdx);
-			throw (errorMessage);
-#endif 
-		}
+		const bool extendLeft = (dataIdx + 1 == component.LeftEdgeIndex);
+		component.LeftEdgeIndex = extendLeft ? dataIdx : component.LeftEdgeIndex;
+		component.RightEdgeIndex = extendLeft ? component.RightEdgeIndex : dataIdx;
 
-		Colors[dataIdx] = componentIdx;
+#ifdef P1D_PAIR_ATTRIBUTES
+		component.Sum += Data[dataIdx];
+#endif
+		Colors[dataIdx + 1] = componentIdx;
 	}
 
 
@@ -556,14 +1676,15 @@ protected:
 	*/
 	void Init()
 	{
-		SortedData.clear();
+		//a warm start needs the order of the previous run
+		if (SortMethod != SORT_WARM_START) SortedData.clear();
 		SortedData.reserve(Data.size());
 		
 		Colors.clear();
-		Colors.resize(Data.size());
+		Colors.resize(Data.size() + 2);
 		std::fill(Colors.begin(), Colors.end(), NO_COLOR);
 		
-		int vectorSize = (int)(Data.size()/RESIZE_FACTOR) + 1; //starting reserved size >= 1 at least
+		size_t vectorSize = Data.size()/RESIZE_FACTOR + 1; //starting reserved size >= 1 at least
 		
 		Components.clear();
 		Components.reserve(vectorSize);
@@ -573,6 +1694,9 @@ protected:
 
 		TotalComponents = 0;
 		AliveComponentsVerified = false;
+		MinPersistence = 0;
+		StorePairs = true;
+		NumberOfSamples = Data.size();
 	}
 
 
@@ -583,19 +1707,103 @@ protected:
 	void CreateIndexValueVector()
 	{
 		if (Data.size()==0) return;
-				
+
+		//SortedData holds every index once, in the order of the previous run
+		if (SortMethod == SORT_WARM_START && SortedData.size() == Data.size())
+		{
+			for (std::vector<TIdxAndData>::iterator v = SortedData.begin(); v != SortedData.end(); v++)
+			{
+				(*v).Data = Data[(*v).Idx];
+			}
+			WarmStartSort();
+			return;
+		}
+
+		SortedData.clear();
 		for (std::vector<float>::size_type i = 0; i != Data.size(); i++)
 		{
 			TIdxAndData dataidxpair; 
 
 			//this is going to make problems
 			dataidxpair.Data = Data[i]; 
-			dataidxpair.Idx = (int)i; 
+			dataidxpair.Idx = (TIndex)i; 
 
 			SortedData.push_back(dataidxpair);
 		}
 
-		std::sort(SortedData.begin(), SortedData.end());
+		switch (SortMethod)
+		{
+		case SORT_RADIX:
+			RadixSort();
+			break;
+		case SORT_CUSTOM:
+			SortFunction(SortedData);
+			break;
+		default:
+			std::sort(SortedData.begin(), SortedData.end());
+		}
+	}
+
+	/*!
+		Sorts SortedData with a least significant digit radix sort on the keys of the values. 
+		SortedData is in index order before, and every pass is stable, so equal values stay in index order, as with TIdxAndData::operator<.
+	*/
+	void RadixSort()
+	{
+		const size_t numBuckets = (size_t)1 << RADIX_BITS;
+		std::vector<TIdxAndData> buffer(SortedData.size());
+		std::vector<size_t> offsets(numBuckets);
+		for (unsigned int shift = 0; shift < 32; shift += RADIX_BITS)
+		{
+			std::fill(offsets.begin(), offsets.end(), 0);
+			for (std::vector<TIdxAndData>::const_iterator v = SortedData.begin(); v != SortedData.end(); v++)
+			{
+				offsets[(GetRadixKey((*v).Data) >> shift) & (numBuckets - 1)]++;
+			}
+			if (*std::max_element(offsets.begin(), offsets.end()) == SortedData.size()) continue;	//all values in one bucket
+
+			size_t offset = 0;
+			for (size_t b = 0; b != numBuckets; b++)
+			{
+				const size_t count = offsets[b];
+				offsets[b] = offset;
+				offset += count;
+			}
+			for (std::vector<TIdxAndData>::const_iterator v = SortedData.begin(); v != SortedData.end(); v++)
+			{
+				buffer[offsets[(GetRadixKey((*v).Data) >> shift) & (numBuckets - 1)]++] = *v;
+			}
+			SortedData.swap(buffer);
+		}
+	}
+
+	/*!
+		Sorts SortedData, which is close to sorted, with an insertion sort. 
+		Once it moved more than WARM_START_MAX_MOVES values per value, the rest is sorted with std::sort 
+		and merged with the sorted beginning.
+	*/
+	void WarmStartSort()
+	{
+		const size_t maxMoves = WARM_START_MAX_MOVES * SortedData.size();
+		size_t moves = 0;
+		for (size_t i = 1; i < SortedData.size(); i++)
+		{
+			const TIdxAndData vertex = SortedData[i];
+			size_t j = i;
+			for (; j > 0 && vertex < SortedData[j - 1]; j--)
+			{
+				SortedData[j] = SortedData[j - 1];
+			}
+			SortedData[j] = vertex;
+
+			moves += i - j;
+			if (moves > maxMoves)
+			{
+				std::sort(SortedData.begin() + i + 1, SortedData.end());
+				std::inplace_merge(SortedData.begin(), SortedData.begin() + i + 1, SortedData.end());
+				return;
+			}
+		}
 	}
 
 
@@ -608,79 +1816,51 @@ protected:
 		- Creates a segment for each local minima
 		- Extends a segment is data has only one neighboring component
 		- Merges segments and creates new PairedExtrema when a vertex has two neighboring components. 
+
+		@param[in,out] visitor	Visitor to notify of new components, merges and pairs.
 	*/
-	void Watershed()
+	template <class TVisitor>
+	void Watershed(TVisitor& visitor)
 	{
-		if (SortedData.size()==1)
-		{
-			CreateComponent(0);
-			return;
-		}
+		const TIdxAndData * sorted = SortedData.empty() ? NULL : &SortedData[0];
+		const TIndex size = (TIndex)SortedData.size();
 
-		for (std::vector<TIdxAndData>::iterator p = SortedData.begin(); p != SortedData.end(); p++)
+		for (TIndex p = 0; p < size; p++)
 		{
-			int i = (*p).Idx;
-
-			//left most vertex - no left neighbor
-			//two options - either local minimum, or extend component
-			if (i==0)
-			{
-				if (Colors[i+1] == NO_COLOR) 
-				{
-					CreateComponent(i);
-				}
-				else
-				{
-					ExtendComponent(Colors[i+1], i);  //in this case, local max as well
-				}
-				
-				continue;
-			}
-			else if (i == Colors.size()-1) //right most vertex - look only to the left
+			//the colors of vertices are random accesses - fetch them ahead
+			if (p + WATERSHED_PREFETCH_DISTANCE < size)
 			{
-				if (Colors[i-1] == NO_COLOR) 
-				{
-					CreateComponent(i);
-				}
-				else
-				{
-					ExtendComponent(Colors[i-1], i);
-				}				
-				continue;
+				P1D_PREFETCH(&Colors[sorted[p + WATERSHED_PREFETCH_DISTANCE].Idx]);
 			}
 
-			//look left and right
-			if (Colors[i-1] == NO_COLOR && Colors[i+1] == NO_COLOR) //local minimum - create new component
-			{
-				CreateComponent(i);
-			}
-			else if (Colors[i-1] != NO_COLOR && Colors[i+1] == NO_COLOR) //single neighbor on the left - extnd
-			{
-				ExtendComponent(Colors[i-1], i);
-			}
-			else if (Colors[i-1] == NO_COLOR && Colors[i+1] != NO_COLOR) //single component on the right - extend
-			{
-				ExtendComponent(Colors[i+1], i);
-			}
-			else if (Colors[i-1] != NO_COLOR && Colors[i+1] != NO_COLOR) //local maximum - merge components
+			const TIndex i = sorted[p].Idx;
+			const TIndex leftComp = Colors[i];		//color of i-1, NO_COLOR at the boundary
+			const TIndex rightComp = Colors[i+2];	//color of i+1, NO_COLOR at the boundary
+
+			//bit 0 if the left neighbor is colored, bit 1 if the right one is: 
+			//none - local minimum, one - extend, both - local maximum
+			switch ((leftComp != NO_COLOR) | ((rightComp != NO_COLOR) << 1))
 			{
-				int leftComp, rightComp; 
+			case 0: 
+				CreateComponent(i, visitor);
+				break;
 
-				leftComp = Colors[i-1];
-				rightComp = Colors[i+1]; 
+			case 1:
+				ExtendComponent(leftComp, i);
+				break;
 
-				//choose component with smaller hub destroyed component
-				if (Components[rightComp].MinValue < Components[leftComp].MinValue) //left component has smaller hub
-				{
-					CreatePairedExtrema(Components[leftComp].MinIndex, i);
-				}
-				else	//either right component has smaller hub, or hubs are equal - destroy right component. 
+			case 2:
+				ExtendComponent(rightComp, i);
+				break;
+
+			default:
 				{
-					CreatePairedExtrema(Components[rightComp].MinIndex, i);
+					//destroy the component with the larger minimum, or the right one if minima are equal
+					const TIndex destroyedComp = (Components[rightComp].MinValue < Components[leftComp].MinValue) ? leftComp : rightComp;
+					CreatePairedExtrema(Components[destroyedComp].MinIndex, i, visitor);
+					MergeComponents(leftComp, rightComp, i, visitor);
+					Colors[i+1] = Colors[i]; //color should be correct at both sides at this point
 				}
-					
-				MergeComponents(leftComp, rightComp);
-				Colors[i] = Colors[i-1]; //color should be correct at both sides at this point
 			}
 		}
 	}
@@ -712,6 +1892,247 @@ protected:
 		searchPair.MinIndex = 0;
 		return(lower_bound(PairedExtrema.begin(), PairedExtrema.end(), searchPair));
 	}
+	/*!
+		Computes the output of Simplify between the extrema of previous outputs which enclose a new extremum,
+		and marks all new extrema in between as old.
+	*/
+	void SimplifyRegion(const TIndex idx, std::vector<unsigned char>& kept, float * out) const
+	{
+		const TIndex size = (TIndex)Data.size();
+		TIndex first = idx, last = idx;
+		while (first > 0 && kept[first] != SIMPLIFY_KEPT_OLD) first--;
+		while (last < size - 1 && kept[last] != SIMPLIFY_KEPT_OLD) last++;
+
+		TIndex previous = (kept[first] != 0) ? first : -1;
+		if (previous == -1) 
+		{
+			previous = first + 1;
+			while (kept[previous] == 0) previous++;
+			SimplifySegment(0, previous, false, true, out);
+		}
+		kept[previous] = SIMPLIFY_KEPT_OLD;
+		out[previous] = Data[previous];
+
+		for (TIndex i = previous + 1; i <= last; i++)
+		{
+			if (kept[i] == 0) continue;
+			SimplifySegment(previous, i, true, true, out);
+			kept[i] = SIMPLIFY_KEPT_OLD;
+			previous = i;
+		}
+		if (previous < last) SimplifySegment(previous, last, true, false, out);
+	}
+
+	/*!
+		Computes the output of Simplify between first and last.
+		If first (last) is not an extremum, i.e. the start (end) of data, the output is not clamped to its value.
+	*/
+	void SimplifySegment(const TIndex first, const TIndex last, const bool firstIsExtremum, const bool lastIsExtremum, float * out) const
+	{
+		//the segment goes up if the first vertex is smaller, or if it starts at the global minimum
+		TIdxAndData firstVertex, lastVertex;
+		firstVertex.Idx = first;
+		firstVertex.Data = Data[first];
+		lastVertex.Idx = last;
+		lastVertex.Data = Data[last];
+		const bool ascending = lastIsExtremum ? (firstIsExtremum && firstVertex < lastVertex) : true;
+
+		const float infinity = std::numeric_limits<float>::infinity();
+		const float low = ascending ? (firstIsExtremum ? Data[first] : -infinity) : Data[last];
+		const float high = ascending ? (lastIsExtremum ? Data[last] : infinity) : (firstIsExtremum ? Data[first] : infinity);
+
+		//running maximum (minimum) from the lower (upper) end, then the average with the running minimum (maximum) from the other end
+		float running = Data[first];
+		for (TIndex i = first; i <= last; i++)
+		{
+			running = ascending ? std::max(running, Data[i]) : std::min(running, Data[i]);
+			out[i] = std::min(std::max(running, low), high);
+		}
+		running = Data[last];
+		for (TIndex i = last; i >= first; i--)
+		{
+			running = ascending ? std::min(running, Data[i]) : std::max(running, Data[i]);
+			out[i] = (out[i] + std::min(std::max(running, low), high)) / 2;
+		}
+	}
+
+	/*!
+		Returns a vertex with its value after the change, or before the change if it is listed in oldValues.
+
+		@param[in] idx			Index of the vertex.
+		@param[in] oldValues	Original values of changed vertices, sorted according to their indices.
+		@param[in] beforeChange	Set to true to get the value before the change.
+	*/
+	TIdxAndData GetVertex(const TIndex idx, const std::vector<TIdxAndData>& oldValues, const bool beforeChange) const
+	{
+		TIdxAndData vertex;
+		vertex.Idx = idx;
+		vertex.Data = Data[idx];
+
+		if (beforeChange)
+		{
+			std::vector<TIdxAndData>::const_iterator it = std::lower_bound(oldValues.begin(), oldValues.end(), vertex, IdxLess);
+			if (it != oldValues.end() && (*it).Idx == idx) vertex.Data = (*it).Data;
+		}
+		return vertex;
+	}
+
+	/*!
+		Returns true if a vertex is larger than the maximum of the interval, both before and after the change.
+	*/
+	bool IsIntervalBound(const TIndex idx, const TUpdateInterval& interval, const std::vector<TIdxAndData>& oldValues) const
+	{
+		return (interval.Max < GetVertex(idx, oldValues, true) && interval.Max < GetVertex(idx, oldValues, false));
+	}
+
+	/*!
+		Updates the interval maximum and minima with a vertex which was added to it. 
+	*/
+	void AddToInterval(TUpdateInterval& interval, const TIndex idx, const std::vector<TIdxAndData>& oldValues) const
+	{
+		TIdxAndData before = GetVertex(idx, oldValues, true);
+		TIdxAndData after = GetVertex(idx, oldValues, false);
+
+		if (interval.Max < before) interval.Max = before;
+		if (interval.Max < after) interval.Max = after;
+		if (before < interval.OldMin) interval.OldMin = before;
+		if (after < interval.NewMin) interval.NewMin = after;
+	}
+
+	/*!
+		Grows an interval until it is bounded by larger vertices on both sides, and its minimum 
+		is the same before and after the change - or until it covers the whole domain.
+	*/
+	void ExpandInterval(TUpdateInterval& interval, const std::vector<TIdxAndData>& oldValues) const
+	{
+		const TIndex last = (TIndex)Data.size() - 1;
+
+		for (;;)
+		{
+			bool bounded = false;
+			while (!bounded)
+			{
+				bounded = true;
+				while (interval.First > 0 && !IsIntervalBound(interval.First - 1, interval, oldValues))
+				{
+					AddToInterval(interval, --interval.First, oldValues);
+					bounded = false;
+				}
+				while (interval.Last < last && !IsIntervalBound(interval.Last + 1, interval, oldValues))
+				{
+					AddToInterval(interval, ++interval.Last, oldValues);
+					bounded = false;
+				}
+			}
+
+			if (interval.First == 0 && interval.Last == last) return;
+			if (interval.OldMin.Idx == interval.NewMin.Idx && interval.OldMin.Data == interval.NewMin.Data) return;
+
+			//the minimum changed, so pairs outside may change as well - grow beyond the smaller bound
+			bool growRight = (interval.First == 0);
+			if (interval.First > 0 && interval.Last < last)
+			{
+				TIdxAndData left = std::max(GetVertex(interval.First - 1, oldValues, true), GetVertex(interval.First - 1, oldValues, false));
+				TIdxAndData right = std::max(GetVertex(interval.Last + 1, oldValues, true), GetVertex(interval.Last + 1, oldValues, false));
+				growRight = (right < left);
+			}
+
+			if (growRight) AddToInterval(interval, ++interval.Last, oldValues);
+			else AddToInterval(interval, --interval.First, oldValues);
+		}
+	}
+
+	/*!
+		Returns true if both extrema of a pair are inside one of the intervals.
+
+		@param[in] pair			Pair to check.
+		@param[in] intervals	Disjoint intervals, sorted according to their position.
+	*/
+	bool IsInsideInterval(const TPairedExtrema& pair, const std::vector<TUpdateInterval>& intervals) const
+	{
+		size_t first = 0, last = intervals.size();
+		while (first < last)
+		{
+			size_t middle = first + (last - first) / 2;
+			if (intervals[middle].Last < pair.MinIndex) first = middle + 1;
+			else last = middle;
+		}
+
+		return (first != intervals.size() &&
+				intervals[first].First <= pair.MinIndex && pair.MinIndex <= intervals[first].Last &&
+				intervals[first].First <= pair.MaxIndex && pair.MaxIndex <= intervals[first].Last);
+	}
+
+	/*!
+		Compares vertices by their values in a data buffer, and by their indices if values are equal - like TIdxAndData.
+	*/
+	struct TVertexLess
+	{
+		TVertexLess(const float * data):Data(data){}
+
+		bool operator()(const TIndex first, const TIndex second) const
+		{
+			if (Data[first] < Data[second]) return true;
+			if (Data[first] > Data[second]) return false;
+			return (first < second);
+		}
+
+		const float * Data;
+	};
+
+	///Returns true if a vertex is smaller than both of its neighbors - Watershed creates a component there.
+	static bool IsLocalMinimum(const TVertexLess& less, const size_t i, const size_t size)
+	{
+		return ((i == 0 || less((TIndex)i, (TIndex)i - 1)) && (i + 1 == size || less((TIndex)i, (TIndex)i + 1)));
+	}
+
+	///Returns true if an inner vertex is larger than both of its neighbors - Watershed merges components there.
+	static bool IsLocalMaximum(const TVertexLess& less, const size_t i, const size_t size)
+	{
+		return (i != 0 && i + 1 != size && less((TIndex)i - 1, (TIndex)i) && less((TIndex)i + 1, (TIndex)i));
+	}
+
+#ifdef P1D_PAIR_ATTRIBUTES
+	/*!
+		Grows a basin of RunPersistenceLowMemory by all vertices next to its edges which are smaller than a maximum,
+		and adds their values to its sum.
+	*/
+	static void GrowBasin(const TVertexLess& less, const size_t size, const TIndex maxIdx, TIndex& leftEdge, TIndex& rightEdge, double& sum)
+	{
+		while (leftEdge > 0 && less(leftEdge - 1, maxIdx))
+		{
+			leftEdge--;
+			sum += less.Data[leftEdge];
+		}
+		while ((size_t)rightEdge + 1 < size && less(rightEdge + 1, maxIdx))
+		{
+			rightEdge++;
+			sum += less.Data[rightEdge];
+		}
+	}
+#endif
+
+	///Union-find: returns the representative of the set of a minimum, and shortens paths on the way.
+	static TIndex FindSet(std::vector<TIndex>& parent, TIndex i)
+	{
+		while (parent[i] != i)
+		{
+			parent[i] = parent[parent[i]];
+			i = parent[i];
+		}
+		return i;
+	}
+
+	static bool IdxLess(const TIdxAndData& first, const TIdxAndData& second)
+	{
+		return (first.Idx < second.Idx);
+	}
+
+	static bool IdxEqual(const TIdxAndData& first, const TIdxAndData& second)
+	{
+		return (first.Idx == second.Idx);
+	}
+
 	/*!
 		Runs at the end of RunPersistence, after Watershed. 
 		Algorithm results should be as followed: 
@@ -0,0 +1,261 @@
+/*! \file persistence1d_approximate.hpp
+    Approximate persistence of very large data, from the minima and maxima of blocks, with a bound on the error.
+*/
+
+#ifndef PERSISTENCE_APPROXIMATE_H
+#define PERSISTENCE_APPROXIMATE_H
+
+#include "persistence1d.hpp"
+
+#include <stdint.h>
+#include <atomic>
+#include <limits>
+#include <thread>
+
+//Number of data values per block, unless given otherwise
+#define APPROXIMATE_DEFAULT_BLOCK_SIZE 1024
+//Size of a cache line in bytes, which threads finding the envelope do not share
+#define APPROXIMATE_CACHE_LINE_SIZE 64
+
+namespace p1d
+{
+
+/*!
+	Largest range of the blocks of one thread, padded to a whole cache line.
+*/
+struct TThreadRange
+{
+	float Range;
+	char Padding[APPROXIMATE_CACHE_LINE_SIZE - sizeof(float)];
+};
+
+/*!
+	Approximates the paired extrema of data by running Persistence1D on an envelope of it:
+	the smallest and largest value of each block of data, in the order they appear.
+	Indices of results are indices of the whole data, and all values of results are data values at these indices.
+
+	Error bound: let w be the largest difference between the largest and smallest value of any block (GetErrorBound).
+	Changing each data value to the next kept value of its block (or its last kept value, if there is none after it)
+	changes no value by more than w, and gives data with exactly the results of the envelope.
+	By the stability of persistence diagrams, their bottleneck distance to the exact results is at most w:
+	- each exact pair with persistence above 2w has an approximate pair whose minimum and maximum values are off by at most w each,
+	  so its persistence is off by at most 2w,
+	- each approximate pair with persistence above 2w has such an exact pair,
+	- all other pairs have persistence of at most 2w.
+	GetCandidatePairs returns a match for every exact pair above a given persistence.
+	The global minimum is always exact. With a block size of 1, all results are exact.
+
+	The envelope is found in one pass over the data, with blocks spread over threads. 
+	Persistence1D then runs on at most 2*size/blockSize values.
+	BenchmarkApproximate compares the run to a plain pass over the data.
+	The data is not copied. Memory is about 60 bytes per block during the run, and 12 bytes per pair afterwards.
+	Data with 2^31 values or more needs P1D_64BIT_INDICES, and Run fails for it otherwise.
+
+	With P1D_PAIR_ATTRIBUTES, the attributes of pairs are not computed (Width is -1):
+	basins are only known up to whole blocks.
+*/
+class Persistence1DApproximate
+{
+public:
+	Persistence1DApproximate() : NumberOfSamples(0), ErrorBound(0), GlobalMinIndex(-1), GlobalMinValue(0)
+	{
+	}
+
+	/*!
+		Approximates the paired extrema of data.
+
+		@param[in] InputData		Vector of data, ordered according to its axis.
+		@param[in] blockSize		Number of data values per block. Larger blocks are faster, and usually have a larger error.
+		@param[in] minPersistence	Minimal approximate persistence of stored pairs, see Persistence1D::RunPersistence.
+		@param[in] numThreads		Number of threads finding the envelope. If 0, one per hardware thread.
+	*/
+	bool Run(const std::vector<float>& InputData, const size_t blockSize = APPROXIMATE_DEFAULT_BLOCK_SIZE,
+			 const float minPersistence = 0, unsigned int numThreads = 0)
+	{
+		return Run(InputData.empty() ? NULL : &InputData[0], InputData.size(), blockSize, minPersistence, numThreads);
+	}
+
+	/*!
+		Same as Run with a data vector, for data in a buffer. The buffer is not copied.
+	*/
+	bool Run(const float * InputData, const size_t size, const size_t blockSize = APPROXIMATE_DEFAULT_BLOCK_SIZE,
+			 const float minPersistence = 0, unsigned int numThreads = 0)
+	{
+		PairedExtrema.clear();
+		NumberOfSamples = 0;
+		ErrorBound = 0;
+		GlobalMinIndex = -1;
+		GlobalMinValue = 0;
+		if (size == 0 || blockSize == 0) return false;
+		if (size - 1 > (size_t)std::numeric_limits<TIndex>::max()) return false;
+
+		std::vector<float> envelope;
+		std::vector<TIndex> indices;
+		FindEnvelope(InputData, size, blockSize, numThreads, envelope, indices);
+
+		Persistence1D p;
+		p.RunPersistence(envelope, minPersistence);
+		std::vector<float>().swap(envelope);
+
+		p.GetPairedExtrema(PairedExtrema);
+		for (std::vector<TPairedExtrema>::iterator pair = PairedExtrema.begin(); pair != PairedExtrema.end(); pair++)
+		{
+			//kept indices increase, so the order of pairs stays the same
+			(*pair).MinIndex = indices[(*pair).MinIndex];
+			(*pair).MaxIndex = indices[(*pair).MaxIndex];
+#ifdef P1D_PAIR_ATTRIBUTES
+			(*pair).Width = -1;
+			(*pair).Area = 0;
+#endif
+		}
+		GlobalMinIndex = indices[p.GetGlobalMinimumIndex()];
+		GlobalMinValue = p.GetGlobalMinimumValue();
+		NumberOfSamples = size;
+		return true;
+	}
+
+	/*!
+		Returns the largest difference between values in one block - the bound on the error of the minimum
+		and maximum value of any pair. Persistence is off by at most twice this value.
+	*/
+	float GetErrorBound() const
+	{
+		return ErrorBound;
+	}
+
+	size_t GetNumberOfSamples() const
+	{
+		return NumberOfSamples;
+	}
+
+	/*!
+		Returns approximate paired extrema with approximate persistence of at least threshold,
+		sorted as in Persistence1D::GetPairedExtrema.
+	*/
+	bool GetPairedExtrema(std::vector<TPairedExtrema> & pairs, const float threshold = 0, const bool matlabIndexing = false) const
+	{
+		pairs.clear();
+		if (PairedExtrema.empty() || threshold < 0.0) return false;
+
+		TPairedExtrema searchPair;
+		searchPair.Persistence = threshold;
+		searchPair.MaxIndex = 0;
+		searchPair.MinIndex = 0;
+		std::vector<TPairedExtrema>::const_iterator first = (threshold == 0) ? PairedExtrema.begin() :
+			std::lower_bound(PairedExtrema.begin(), PairedExtrema.end(), searchPair);
+		if (first == PairedExtrema.end()) return false;
+
+		pairs.assign(first, PairedExtrema.end());
+		if (matlabIndexing)
+		{
+			for (std::vector<TPairedExtrema>::iterator p = pairs.begin(); p != pairs.end(); p++)
+			{
+				(*p).MinIndex += MATLAB_INDEX_FACTOR;
+				(*p).MaxIndex += MATLAB_INDEX_FACTOR;
+			}
+		}
+		return true;
+	}
+
+	/*!
+		Returns approximate paired extrema which contain a match for every exact pair with persistence of at least threshold:
+		all pairs with approximate persistence of at least threshold - 2*GetErrorBound().
+		Exact pairs with persistence of at most 2*GetErrorBound() may have no match at all, so threshold should be larger.
+		Pairs stored by Run must not have been dropped by its minPersistence.
+	*/
+	bool GetCandidatePairs(std::vector<TPairedExtrema> & pairs, const float threshold, const bool matlabIndexing = false) const
+	{
+		return GetPairedExtrema(pairs, std::max(threshold - 2 * ErrorBound, 0.0f), matlabIndexing);
+	}
+
+	///Returns the index of the global minimum, which is exact.
+	TIndex GetGlobalMinimumIndex(const bool matlabIndexing = false) const
+	{
+		if (GlobalMinIndex == -1) return -1;
+		return GlobalMinIndex + (matlabIndexing ? MATLAB_INDEX_FACTOR : 0);
+	}
+
+	float GetGlobalMinimumValue() const
+	{
+		return GlobalMinValue;
+	}
+
+protected:
+	size_t NumberOfSamples;
+	float ErrorBound;
+	std::vector<TPairedExtrema> PairedExtrema;
+	TIndex GlobalMinIndex;
+	float GlobalMinValue;
+
+	/*!
+		Finds the smallest and largest vertex of each block (in the order of TIdxAndData),
+		and stores their values and indices in the order they appear. Sets ErrorBound.
+	*/
+	void FindEnvelope(const float * InputData, const size_t size, const size_t blockSize, unsigned int numThreads,
+					  std::vector<float>& envelope, std::vector<TIndex>& indices)
+	{
+		const size_t numBlocks = (size - 1) / blockSize + 1;
+
+		if (numThreads == 0) numThreads = std::thread::hardware_concurrency();
+		if (numThreads == 0) numThreads = 1;
+		if (numThreads > numBlocks) numThreads = (unsigned int)numBlocks;
+
+		//two kept indices per block, the second one is -1 if both are the same vertex
+		std::vector<TIndex> kept(2 * numBlocks);
+
+		//one slot per thread, each on its own cache line
+		std::vector<TThreadRange> slots(numThreads + 1);
+		TThreadRange * ranges = (TThreadRange *)(((uintptr_t)&slots[0] + APPROXIMATE_CACHE_LINE_SIZE - 1) & ~(uintptr_t)(APPROXIMATE_CACHE_LINE_SIZE - 1));
+
+		std::atomic<size_t> next(0);
+		std::vector<std::thread> threads;
+		for (unsigned int t = 0; t < numThreads; t++)
+		{
+			threads.push_back(std::thread([&, t]()
+			{
+				float range = 0;
+				for (size_t b = next++; b < numBlocks; b = next++)
+				{
+					const size_t first = b * blockSize;
+					const size_t last = std::min(first + blockSize, size);
+
+					size_t minIdx = first, maxIdx = first;
+					float minValue = InputData[first], maxValue = InputData[first];
+					for (size_t i = first + 1; i != last; i++)
+					{
+						const float value = InputData[i];
+						if (value < minValue) { minValue = value; minIdx = i; }
+						if (value >= maxValue) { maxValue = value; maxIdx = i; }
+					}
+
+					kept[2*b] = (TIndex)std::min(minIdx, maxIdx);
+					kept[2*b + 1] = (minIdx == maxIdx) ? -1 : (TIndex)std::max(minIdx, maxIdx);
+					range = std::max(range, maxValue - minValue);
+				}
+				ranges[t].Range = range;
+			}));
+		}
+		for (size_t t = 0; t < threads.size(); t++)
+		{
+			threads[t].join();
+		}
+		ErrorBound = 0;
+		for (unsigned int t = 0; t < numThreads; t++)
+		{
+			ErrorBound = std::max(ErrorBound, ranges[t].Range);
+		}
+
+		envelope.clear();
+		indices.clear();
+		envelope.reserve(kept.size());
+		indices.reserve(kept.size());
+		for (size_t k = 0; k != kept.size(); k++)
+		{
+			if (kept[k] == -1) continue;
+			indices.push_back(kept[k]);
+			envelope.push_back(InputData[kept[k]]);
+		}
+	}
+};
+}
+#endif
@@ -0,0 +1,394 @@
+/*! \file persistence1d_columns.hpp
+    Persistence of many columns of a delimited text file (CSV, TSV), parsed in one pass over the mapped file and computed in parallel.
+*/
+
+#ifndef PERSISTENCE_COLUMNS_H
+#define PERSISTENCE_COLUMNS_H
+
+#include "persistence1d.hpp"
+#include "persistence1d_mapping.hpp"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <string>
+#include <thread>
+
+//Longest field which is parsed as a number. Longer fields are not numbers.
+#define COLUMNS_MAX_FIELD_LENGTH 63
+//Number of parts the file is split into per parsing thread, so threads which finish early take more
+#define COLUMNS_CHUNKS_PER_THREAD 4
+
+namespace p1d
+{
+
+/*!
+	Parsed values of the selected columns in one part of the file.
+*/
+struct TColumnChunk
+{
+	///Start and end of the part of the file. Both are at the start of a line.
+	size_t Begin, End;
+
+	///Values of each selected column, one per accepted line.
+	std::vector<std::vector<float> > Values;
+
+	///Number of non-empty lines which were not accepted.
+	size_t SkippedLines;
+};
+
+/*!
+	Runs Persistence1D on selected columns of a delimited text file, e.g. a CSV file with a timestamp and many numeric columns.
+
+	Run has two stages. The parsing stage maps the file and splits it into parts at line starts.
+	Threads take the next part when done, and parse all selected columns of a line at once into buffers of that part,
+	so the file is read only once. The compute stage starts when all parts are parsed, since persistence needs whole columns.
+	Threads take the next column when done, join its buffers, run Persistence1D and keep the results.
+	Buffers of a column are released once it is joined, and each thread reuses its Persistence1D object.
+
+	A line is accepted if all selected fields are numbers. Other non-empty lines are skipped in all columns,
+	like the single column input of persistence1d_driver, so all columns have the same indices.
+	If the first line is not accepted (or has no numbers, if no columns are selected), it is the header, 
+	and its fields are the names of the columns. If no columns are selected, all fields which are numbers 
+	in the first line after the header are selected, e.g. not a timestamp.
+	Fields are not quoted. Lines end with "\n" or "\r\n".
+
+	Usage:
+	\code
+	Persistence1DColumns columns;
+	columns.Run("data.csv", ',');
+	for (size_t c = 0; c < columns.GetNumberOfColumns(); c++)
+	{
+		columns.GetResult(c).GetPairedExtrema(pairs, threshold);
+	}
+	\endcode
+*/
+class Persistence1DColumns
+{
+public:
+	Persistence1DColumns():NumberOfRows(0),SkippedLines(0)
+	{
+	}
+
+	/*!
+		Maps a file and runs persistence on its selected columns.
+
+		@param[in] filename			Name of the delimited text file.
+		@param[in] delimiter		Field delimiter, e.g. ',' or '\\t'.
+		@param[in] columns			Zero based positions of the selected fields in a line. Results are in order of position. 
+									If empty, all fields which are numbers in the first line after the header are selected.
+		@param[in] minPersistence	Minimal persistence of stored pairs, see Persistence1D::RunPersistence.
+		@param[in] numThreads		Number of threads. If 0, one per hardware thread.
+	*/
+	bool Run(const char * filename, const char delimiter, const std::vector<size_t>& columns = std::vector<size_t>(),
+		const float minPersistence = 0, unsigned int numThreads = 0)
+	{
+		Clear();
+
+		void * mapping = NULL;
+		size_t size = 0;
+		if (!MapFile(filename, mapping, size, true)) return false;	//every part is read once, in order
+
+		const bool result = Run((const char *)mapping, size, delimiter, columns, minPersistence, numThreads);
+		UnmapFile(mapping, size);
+		return result;
+	}
+
+	/*!
+		Same as Run with a file name, for text in a buffer. The buffer is not copied, and need not be null terminated.
+	*/
+	bool Run(const char * text, const size_t size, const char delimiter, const std::vector<size_t>& columns = std::vector<size_t>(),
+		const float minPersistence = 0, unsigned int numThreads = 0)
+	{
+		Clear();
+		if (size == 0) return false;
+
+		if (numThreads == 0) numThreads = std::thread::hardware_concurrency();
+		if (numThreads == 0) numThreads = 1;
+
+		if (!SelectColumns(text, size, delimiter, columns)) return false;
+
+		std::vector<TColumnChunk> chunks;
+		SplitIntoChunks(text, size, (size_t)numThreads * COLUMNS_CHUNKS_PER_THREAD, chunks);
+
+		//parsing stage
+		std::atomic<size_t> next(0);
+		std::vector<std::thread> threads;
+		for (unsigned int t = 0; t < numThreads && t < chunks.size(); t++)
+		{
+			threads.push_back(std::thread([&]()
+			{
+				std::vector<float> values(Columns.size());
+				for (size_t c = next++; c < chunks.size(); c = next++)
+				{
+					ParseChunk(text, delimiter, chunks[c], values);
+				}
+			}));
+		}
+		JoinAll(threads);
+
+		for (size_t c = 0; c != chunks.size(); c++)
+		{
+			NumberOfRows += chunks[c].Values[0].size();
+			SkippedLines += chunks[c].SkippedLines;
+		}
+
+		//compute stage
+		Results.resize(Columns.size());
+		next = 0;
+		for (unsigned int t = 0; t < numThreads && t < Columns.size(); t++)
+		{
+			threads.push_back(std::thread([&]()
+			{
+				std::vector<float> data;
+				Persistence1D p;
+				for (size_t c = next++; c < Columns.size(); c = next++)
+				{
+					data.clear();
+					data.reserve(NumberOfRows);
+					for (size_t k = 0; k != chunks.size(); k++)
+					{
+						data.insert(data.end(), chunks[k].Values[c].begin(), chunks[k].Values[c].end());
+						std::vector<float>().swap(chunks[k].Values[c]);
+					}
+
+					p.RunPersistence(data, minPersistence);
+					Results[c] = p.TakeResult();
+				}
+			}));
+		}
+		JoinAll(threads);
+		return true;
+	}
+
+	///Returns the number of selected columns.
+	size_t GetNumberOfColumns() const
+	{
+		return Columns.size();
+	}
+
+	///Returns the position of a selected column in a line.
+	size_t GetColumnPosition(const size_t column) const
+	{
+		return Columns[column];
+	}
+
+	///Returns the name of a selected column in the header, or an empty string if the file has no header.
+	const std::string& GetColumnName(const size_t column) const
+	{
+		return Names[column];
+	}
+
+	///Returns the results of a selected column.
+	const PersistenceResult& GetResult(const size_t column) const
+	{
+		return Results[column];
+	}
+
+	///Returns the number of accepted lines, which is the number of values of each column.
+	size_t GetNumberOfRows() const
+	{
+		return NumberOfRows;
+	}
+
+	///Returns the number of non-empty lines which were skipped, including the header.
+	size_t GetNumberOfSkippedLines() const
+	{
+		return SkippedLines;
+	}
+
+	/*!
+		Parses a field as a float. Returns false if the field is empty, too long, not finite, or has anything but a number and surrounding spaces.
+	*/
+	static bool ParseField(const char * begin, const char * end, float& value)
+	{
+		while (begin != end && (*begin == ' ' || *begin == '\t')) begin++;
+		while (end != begin && (end[-1] == ' ' || end[-1] == '\t')) end--;
+		if (begin == end || end - begin > COLUMNS_MAX_FIELD_LENGTH) return false;
+
+		//the text is not null terminated
+		char field[COLUMNS_MAX_FIELD_LENGTH + 1];
+		memcpy(field, begin, end - begin);
+		field[end - begin] = '\0';
+
+		//infinity and NaN are not numbers Persistence1D can sort
+		char * parsedEnd;
+		value = strtof(field, &parsedEnd);
+		return (parsedEnd == field + (end - begin) && fabs(value) <= std::numeric_limits<float>::max());
+	}
+
+protected:
+	std::vector<size_t> Columns;
+	std::vector<std::string> Names;
+	std::vector<PersistenceResult> Results;
+	size_t NumberOfRows;
+	size_t SkippedLines;
+
+	void Clear()
+	{
+		Columns.clear();
+		Names.clear();
+		Results.clear();
+		NumberOfRows = 0;
+		SkippedLines = 0;
+	}
+
+	static void JoinAll(std::vector<std::thread>& threads)
+	{
+		for (size_t t = 0; t < threads.size(); t++)
+		{
+			threads[t].join();
+		}
+		threads.clear();
+	}
+
+	///Returns the end of the line which starts at begin, without "\r".
+	static const char * FindLineEnd(const char * begin, const char * end)
+	{
+		const char * lineEnd = (const char *)memchr(begin, '\n', end - begin);
+		if (lineEnd == NULL) lineEnd = end;
+		if (lineEnd != begin && lineEnd[-1] == '\r') lineEnd--;
+		return lineEnd;
+	}
+
+	///Splits a line into the start and end of each field.
+	static void SplitLine(const char * begin, const char * end, const char delimiter, std::vector<std::pair<const char *, const char *> >& fields)
+	{
+		fields.clear();
+		for (;;)
+		{
+			const char * fieldEnd = (const char *)memchr(begin, delimiter, end - begin);
+			if (fieldEnd == NULL) break;
+			fields.push_back(std::make_pair(begin, fieldEnd));
+			begin = fieldEnd + 1;
+		}
+		fields.push_back(std::make_pair(begin, end));
+	}
+
+	/*!
+		Reads the header and the first line after it, and selects the columns.
+		Fails if a selected column is not a number in the first line after the header.
+	*/
+	bool SelectColumns(const char * text, const size_t size, const char delimiter, const std::vector<size_t>& columns)
+	{
+		const char * end = text + size;
+		std::vector<std::pair<const char *, const char *> > header, fields;
+		float value;
+
+		const char * line = text;
+		for (bool first = true; line < end; line = FindNextLine(line, end))
+		{
+			const char * lineEnd = FindLineEnd(line, end);
+			if (lineEnd == line) continue;
+
+			SplitLine(line, lineEnd, delimiter, fields);
+			if (!first) break;
+			first = false;
+
+			//the first line is the header if it is not accepted, or - without selected columns - if it has no numbers
+			bool isHeader = true;
+			for (size_t f = 0; f != fields.size() && isHeader; f++)
+			{
+				if (ParseField(fields[f].first, fields[f].second, value)) isHeader = false;
+			}
+			for (size_t c = 0; c != columns.size(); c++)
+			{
+				if (columns[c] >= fields.size() || !ParseField(fields[columns[c]].first, fields[columns[c]].second, value)) isHeader = true;
+			}
+			if (!isHeader) break;
+
+			header.swap(fields);
+			fields.clear();
+		}
+		if (fields.empty()) return false;
+
+		Columns = columns;
+		if (Columns.empty())
+		{
+			for (size_t f = 0; f != fields.size(); f++)
+			{
+				if (ParseField(fields[f].first, fields[f].second, value)) Columns.push_back(f);
+			}
+		}
+		std::sort(Columns.begin(), Columns.end());
+		Columns.erase(std::unique(Columns.begin(), Columns.end()), Columns.end());
+		if (Columns.empty()) return false;
+
+		for (size_t c = 0; c != Columns.size(); c++)
+		{
+			if (Columns[c] >= fields.size() || !ParseField(fields[Columns[c]].first, fields[Columns[c]].second, value)) return false;
+			Names.push_back(Columns[c] < header.size() ? std::string(header[Columns[c]].first, header[Columns[c]].second) : std::string());
+		}
+		return true;
+	}
+
+	static const char * FindNextLine(const char * line, const char * end)
+	{
+		const char * newline = (const char *)memchr(line, '\n', end - line);
+		return (newline == NULL) ? end : newline + 1;
+	}
+
+	///Splits the text into about numChunks parts, each starting at the start of a line.
+	void SplitIntoChunks(const char * text, const size_t size, const size_t numChunks, std::vector<TColumnChunk>& chunks) const
+	{
+		const size_t chunkSize = size / numChunks + 1;
+		size_t begin = 0;
+		while (begin < size)
+		{
+			TColumnChunk chunk;
+			chunk.Begin = begin;
+			chunk.End = (size - begin <= chunkSize) ? size : (size_t)(FindNextLine(text + begin + chunkSize, text + size) - text);
+			chunk.Values.resize(Columns.size());
+			chunk.SkippedLines = 0;
+			chunks.push_back(chunk);
+			begin = chunk.End;
+		}
+	}
+
+	/*!
+		Parses all lines of a chunk. values is a buffer for the selected fields of one line.
+	*/
+	void ParseChunk(const char * text, const char delimiter, TColumnChunk& chunk, std::vector<float>& values) const
+	{
+		const char * end = text + chunk.End;
+		for (const char * line = text + chunk.Begin; line < end; line = FindNextLine(line, end))
+		{
+			const char * lineEnd = FindLineEnd(line, end);
+			if (lineEnd == line) continue;
+
+			//walk the fields once, taking the selected ones in order of their position
+			size_t column = 0, position = 0;
+			bool accepted = true;
+			const char * field = line;
+			for (size_t c = 0; c != Columns.size() && accepted; c++)
+			{
+				for (; position < Columns[c] && field != NULL; position++)
+				{
+					field = (const char *)memchr(field, delimiter, lineEnd - field);
+					if (field != NULL) field++;
+				}
+				if (field == NULL || position != Columns[c])
+				{
+					accepted = false;
+					break;
+				}
+
+				const char * fieldEnd = (const char *)memchr(field, delimiter, lineEnd - field);
+				accepted = ParseField(field, fieldEnd ? fieldEnd : lineEnd, values[column++]);
+			}
+
+			if (!accepted)
+			{
+				chunk.SkippedLines++;
+				continue;
+			}
+			for (size_t c = 0; c != Columns.size(); c++)
+			{
+				chunk.Values[c].push_back(values[c]);
+			}
+		}
+	}
+};
+}
+#endif
@@ -0,0 +1,423 @@
+/*! \file persistence1d_dispatch.hpp
+    Choice of the fastest way to run Persistence1D on given data, from a sample of the data and a calibrated cost model.
+
+	Unlike persistence1d.hpp, this header uses threads (for ParallelSort), so programs which include it need to link with them.
+*/
+
+#ifndef PERSISTENCE_DISPATCH_H
+#define PERSISTENCE_DISPATCH_H
+
+#include "persistence1d.hpp"
+
+#include <math.h>
+#include <chrono>
+#include <ostream>
+#include <random>
+#include <thread>
+
+#define ENGINE_AUTOMATIC -1
+#define ENGINE_COMPARISON_SORT 0
+#define ENGINE_RADIX_SORT 1
+#define ENGINE_PARALLEL_SORT 2
+#define ENGINE_CRITICAL_POINTS 3
+#define NUMBER_OF_ENGINES 4
+
+//Number of windows of consecutive values which are sampled, and their size
+#define DISPATCH_SAMPLE_WINDOWS 64
+#define DISPATCH_WINDOW_SIZE 64
+//Number of values of calibration data, unless given otherwise
+#define DISPATCH_CALIBRATION_SIZE (1 << 20)
+
+namespace p1d
+{
+
+/*!
+	Properties of data estimated from a sample, see PersistenceDispatcher::ProfileInput.
+*/
+struct TInputProfile
+{
+	size_t Size;
+
+	///Fraction of sampled values which are local minima or maxima.
+	float ExtremaFraction;
+
+	///Smallest and largest sampled value.
+	float MinValue, MaxValue;
+
+	///Number of radix sort passes over bits which are not equal in all sampled values.
+	int RadixPasses;
+};
+
+/*!
+	Sorts vertices with std::sort on equal parts in parallel, then merges neighboring parts in parallel, 
+	doubling their size in each round. Used with SORT_CUSTOM by ENGINE_PARALLEL_SORT.
+
+	@param[in,out] vertices		Vertices to sort, see TSortFunction.
+	@param[in] numThreads		Number of threads. If 0, one per hardware thread.
+*/
+inline void ParallelSort(std::vector<TIdxAndData>& vertices, const unsigned int numThreads = 0)
+{
+	size_t numParts = numThreads ? numThreads : std::thread::hardware_concurrency();
+	numParts = std::max<size_t>(1, std::min<size_t>(numParts, vertices.size()));
+
+	std::vector<size_t> bounds;
+	for (size_t t = 0; t <= numParts; t++)
+	{
+		bounds.push_back(vertices.size() * t / numParts);
+	}
+
+	std::vector<std::thread> threads;
+	for (size_t t = 0; t < numParts; t++)
+	{
+		threads.push_back(std::thread([&vertices, &bounds, t]()
+		{
+			std::sort(vertices.begin() + bounds[t], vertices.begin() + bounds[t + 1]);
+		}));
+	}
+	for (size_t t = 0; t < threads.size(); t++)
+	{
+		threads[t].join();
+	}
+
+	for (size_t width = 1; width < numParts; width *= 2)
+	{
+		threads.clear();
+		for (size_t t = 0; t + width < numParts; t += 2 * width)
+		{
+			const size_t first = bounds[t], middle = bounds[t + width], last = bounds[std::min(t + 2 * width, numParts)];
+			threads.push_back(std::thread([&vertices, first, middle, last]()
+			{
+				std::inplace_merge(vertices.begin() + first, vertices.begin() + middle, vertices.begin() + last);
+			}));
+		}
+		for (size_t t = 0; t < threads.size(); t++)
+		{
+			threads[t].join();
+		}
+	}
+}
+
+/*!
+	Estimates the time of each engine from the profile of data.
+	Each coefficient is in nanoseconds per unit of work, where the work of an engine is a function of the profile:
+
+	- ENGINE_COMPARISON_SORT: n*log2(n), sorting dominates.
+	- ENGINE_RADIX_SORT: n*(passes + 2), one pass for each radix pass, plus copying and Watershed.
+	- ENGINE_PARALLEL_SORT: n*log2(n/t)/t + n*log2(t) + 2n for sorting, merging, copying and Watershed with t threads,
+	  plus a fixed cost per thread.
+	- ENGINE_CRITICAL_POINTS: n + m*log2(m), finding the m local maxima and sorting them.
+
+	Default coefficients are rounded results of Calibrate on a single core of a server.
+	Use Calibrate to fit them to the computer the program runs on, e.g. once at startup.
+*/
+struct TCostModel
+{
+	double ComparisonSort;
+	double RadixSort;
+	double ParallelSort;
+	double ThreadStart;
+	double CriticalPoints;
+
+	TCostModel():ComparisonSort(10),RadixSort(18),ParallelSort(8),ThreadStart(50000),CriticalPoints(20)
+	{
+	}
+
+	///Returns the work of an engine on data with a profile, for numThreads threads.
+	static double GetWork(const int engine, const TInputProfile& profile, const unsigned int numThreads)
+	{
+		const double n = (double)std::max<size_t>(profile.Size, 2);
+		const double t = std::max(1.0, std::min((double)numThreads, n));
+		const double m = std::max(2.0, n * profile.ExtremaFraction / 2);
+		switch (engine)
+		{
+		case ENGINE_COMPARISON_SORT: return n * log2(n);
+		case ENGINE_RADIX_SORT: return n * (profile.RadixPasses + 2);
+		case ENGINE_PARALLEL_SORT: return n * std::max(1.0, log2(n / t)) / t + n * log2(t) + 2 * n;
+		case ENGINE_CRITICAL_POINTS: return n + m * log2(m);
+		}
+		return 0;
+	}
+
+	///Returns the estimated time of an engine in nanoseconds.
+	double Estimate(const int engine, const TInputProfile& profile, const unsigned int numThreads) const
+	{
+		const double work = GetWork(engine, profile, numThreads);
+		switch (engine)
+		{
+		case ENGINE_COMPARISON_SORT: return ComparisonSort * work;
+		case ENGINE_RADIX_SORT: return RadixSort * work;
+		case ENGINE_PARALLEL_SORT: return ParallelSort * work + ThreadStart * numThreads;
+		case ENGINE_CRITICAL_POINTS: return CriticalPoints * work;
+		}
+		return 0;
+	}
+
+	/*!
+		Microbenchmark which sets the coefficients: runs each engine on uniform noise of the given size,
+		and divides its time by its work. Takes about a second for the default size.
+	*/
+	void Calibrate(const size_t size = DISPATCH_CALIBRATION_SIZE, const unsigned int numThreads = 0);
+};
+
+/*!
+	Runs Persistence1D with the engine which is estimated to be fastest for the data:
+
+	- ENGINE_COMPARISON_SORT: RunPersistence with SORT_COMPARISON.
+	- ENGINE_RADIX_SORT: RunPersistence with SORT_RADIX, fast when values share high bits, e.g. small integers.
+	- ENGINE_PARALLEL_SORT: RunPersistence with ParallelSort as SORT_CUSTOM, fast for large data on many cores.
+	- ENGINE_CRITICAL_POINTS: RunPersistenceLowMemory, which sorts only local maxima. Fast for smooth data,
+	  but the data is not kept, so UpdateValues and Simplify cannot be used afterwards. Only chosen if SetKeepData(false) was called.
+
+	Results are identical for all engines. The choice takes constant time: ProfileInput samples
+	DISPATCH_SAMPLE_WINDOWS windows of DISPATCH_WINDOW_SIZE values, spread evenly over the data,
+	and the cost model estimates the time of each engine from the profile.
+
+	Usage:
+	\code
+	PersistenceDispatcher dispatcher;
+	dispatcher.SetLog(&std::cerr);
+	dispatcher.RunPersistence(p, data);
+	p.GetPairedExtrema(pairs);
+	\endcode
+*/
+class PersistenceDispatcher
+{
+public:
+	PersistenceDispatcher():Override(ENGINE_AUTOMATIC),NumThreads(0),KeepData(true),Log(NULL),LastEngine(ENGINE_AUTOMATIC)
+	{
+		LastProfile = ProfileInput(NULL, 0);
+	}
+
+	void SetModel(const TCostModel& model)
+	{
+		Model = model;
+	}
+
+	const TCostModel& GetModel() const
+	{
+		return Model;
+	}
+
+	/*!
+		Sets an engine which is used for all runs, or ENGINE_AUTOMATIC to choose again.
+		Returns false for unknown engines.
+	*/
+	bool SetOverride(const int engine)
+	{
+		if (engine < ENGINE_AUTOMATIC || engine >= NUMBER_OF_ENGINES) return false;
+		Override = engine;
+		return true;
+	}
+
+	///Sets the number of threads of ENGINE_PARALLEL_SORT. If 0, one per hardware thread.
+	void SetThreads(const unsigned int numThreads)
+	{
+		NumThreads = numThreads;
+	}
+
+	///Set this to false to allow ENGINE_CRITICAL_POINTS, which does not keep the data in Persistence1D.
+	void SetKeepData(const bool keepData)
+	{
+		KeepData = keepData;
+	}
+
+	///Sets a stream which gets one line for each run, with the profile, the estimates and the chosen engine. NULL for no log.
+	void SetLog(std::ostream * log)
+	{
+		Log = log;
+	}
+
+	/*!
+		Same as Persistence1D::RunPersistence, with the engine chosen by ChooseEngine.
+
+		@param[out] p				Object which runs, and holds the results afterwards.
+		@param[in] InputData		Vector of data to find features on, ordered according to its axis.
+		@param[in] minPersistence	Minimal persistence of stored pairs, see Persistence1D::RunPersistence.
+	*/
+	bool RunPersistence(Persistence1D& p, const std::vector<float>& InputData, const float minPersistence = 0)
+	{
+		return RunPersistence(p, InputData.empty() ? NULL : &InputData[0], InputData.size(), minPersistence);
+	}
+
+	/*!
+		Same as RunPersistence with a data vector, for data in a buffer.
+		The sort method of p is the same afterwards as before.
+	*/
+	bool RunPersistence(Persistence1D& p, const float * InputData, const size_t size, const float minPersistence = 0)
+	{
+		LastProfile = ProfileInput(InputData, size);
+		LastEngine = (Override == ENGINE_AUTOMATIC) ? ChooseEngine(LastProfile) : Override;
+		if (Log) WriteLog(*Log);
+
+		const int previousSortMethod = p.GetSortMethod();
+		const TSortFunction previousSortFunction = p.GetSortFunction();
+		const unsigned int numThreads = GetThreads();
+		bool result;
+		switch (LastEngine)
+		{
+		case ENGINE_CRITICAL_POINTS:
+			return p.RunPersistenceLowMemory(InputData, size, minPersistence);
+		case ENGINE_RADIX_SORT:
+			p.SetSortMethod(SORT_RADIX);
+			break;
+		case ENGINE_PARALLEL_SORT:
+			p.SetSortMethod(SORT_CUSTOM, [numThreads](std::vector<TIdxAndData>& vertices) { ParallelSort(vertices, numThreads); });
+			break;
+		default:
+			p.SetSortMethod(SORT_COMPARISON);
+		}
+		result = p.RunPersistence(InputData, size, minPersistence);
+		p.SetSortMethod(previousSortMethod, previousSortFunction);
+		return result;
+	}
+
+	///Returns the engine with the smallest estimated time for data with a profile, among the allowed engines.
+	int ChooseEngine(const TInputProfile& profile) const
+	{
+		int best = ENGINE_COMPARISON_SORT;
+		for (int engine = 0; engine < NUMBER_OF_ENGINES; engine++)
+		{
+			if (IsAllowed(engine) && Model.Estimate(engine, profile, GetThreads()) < Model.Estimate(best, profile, GetThreads())) best = engine;
+		}
+		return best;
+	}
+
+	///Returns the engine of the last run.
+	int GetLastEngine() const
+	{
+		return LastEngine;
+	}
+
+	///Returns the profile of the data of the last run.
+	const TInputProfile& GetLastProfile() const
+	{
+		return LastProfile;
+	}
+
+	///Returns the name of an engine, for logs.
+	static const char * GetEngineName(const int engine)
+	{
+		switch (engine)
+		{
+		case ENGINE_COMPARISON_SORT: return "comparison sort";
+		case ENGINE_RADIX_SORT: return "radix sort";
+		case ENGINE_PARALLEL_SORT: return "parallel sort";
+		case ENGINE_CRITICAL_POINTS: return "critical points";
+		}
+		return "automatic";
+	}
+
+	/*!
+		Estimates the properties of data from DISPATCH_SAMPLE_WINDOWS windows of DISPATCH_WINDOW_SIZE consecutive values,
+		spread evenly over the data. Small data is sampled completely.
+		Extrema are counted among the inner values of each window, like Persistence1D finds them.
+	*/
+	static TInputProfile ProfileInput(const float * InputData, const size_t size)
+	{
+		TInputProfile profile;
+		profile.Size = size;
+		profile.ExtremaFraction = 0;
+		profile.MinValue = profile.MaxValue = 0;
+		profile.RadixPasses = 0;
+		if (size == 0) return profile;
+
+		const size_t numWindows = (size <= DISPATCH_SAMPLE_WINDOWS * DISPATCH_WINDOW_SIZE) ? 1 : DISPATCH_SAMPLE_WINDOWS;
+		const size_t windowSize = (numWindows == 1) ? size : DISPATCH_WINDOW_SIZE;
+
+		size_t inner = 0, extrema = 0;
+		unsigned int differentBits = 0;
+		const unsigned int firstKey = GetRadixKey(InputData[0]);
+		profile.MinValue = profile.MaxValue = InputData[0];
+		for (size_t w = 0; w != numWindows; w++)
+		{
+			const size_t first = (numWindows == 1) ? 0 : (size - windowSize) * w / (numWindows - 1);
+			for (size_t i = first; i != first + windowSize; i++)
+			{
+				const float value = InputData[i];
+				differentBits |= GetRadixKey(value) ^ firstKey;
+				profile.MinValue = std::min(profile.MinValue, value);
+				profile.MaxValue = std::max(profile.MaxValue, value);
+
+				if (i == first || i + 1 == first + windowSize) continue;
+
+				//ties are broken by index, as in Persistence1D
+				const bool aboveLeft = (value >= InputData[i - 1]), aboveRight = (value > InputData[i + 1]);
+				inner++;
+				extrema += (aboveLeft == aboveRight);
+			}
+		}
+
+		profile.ExtremaFraction = inner ? (float)extrema / inner : 0;
+		for (unsigned int shift = 0; shift < 32; shift += RADIX_BITS)
+		{
+			profile.RadixPasses += ((differentBits >> shift) & ((1u << RADIX_BITS) - 1)) != 0;
+		}
+		return profile;
+	}
+
+protected:
+	TCostModel Model;
+	int Override;
+	unsigned int NumThreads;
+	bool KeepData;
+	std::ostream * Log;
+	int LastEngine;
+	TInputProfile LastProfile;
+
+	unsigned int GetThreads() const
+	{
+		unsigned int numThreads = NumThreads ? NumThreads : std::thread::hardware_concurrency();
+		return numThreads ? numThreads : 1;
+	}
+
+	bool IsAllowed(const int engine) const
+	{
+		if (engine == ENGINE_CRITICAL_POINTS && KeepData) return false;
+		if (engine == ENGINE_PARALLEL_SORT && GetThreads() == 1) return false;
+		return true;
+	}
+
+	void WriteLog(std::ostream& log) const
+	{
+		log << "Persistence1D dispatcher: n=" << LastProfile.Size << ", extrema " << LastProfile.ExtremaFraction
+			<< ", range [" << LastProfile.MinValue << ", " << LastProfile.MaxValue << "], radix passes " << LastProfile.RadixPasses << ". Estimates:";
+		for (int engine = 0; engine < NUMBER_OF_ENGINES; engine++)
+		{
+			if (IsAllowed(engine)) log << " " << GetEngineName(engine) << " " << Model.Estimate(engine, LastProfile, GetThreads()) / 1e6 << " ms";
+		}
+		log << ". Engine: " << GetEngineName(LastEngine) << (Override == ENGINE_AUTOMATIC ? "" : " (override)") << std::endl;
+	}
+};
+
+inline void TCostModel::Calibrate(const size_t size, const unsigned int numThreads)
+{
+	//a local generator with a fixed seed does not change the rand() sequence of the program, and calibrates on the same data each time
+	std::minstd_rand generator;
+	std::uniform_real_distribution<float> uniform(0, 1);
+	std::vector<float> data(std::max<size_t>(size, 2));
+	for (size_t i = 0; i != data.size(); i++)
+	{
+		data[i] = uniform(generator);
+	}
+
+	PersistenceDispatcher dispatcher;
+	dispatcher.SetThreads(numThreads);
+	dispatcher.SetKeepData(false);
+	const TInputProfile profile = PersistenceDispatcher::ProfileInput(&data[0], data.size());
+	const unsigned int threads = numThreads ? numThreads : std::max(1u, std::thread::hardware_concurrency());
+
+	double * coefficients[NUMBER_OF_ENGINES] = { &ComparisonSort, &RadixSort, &ParallelSort, &CriticalPoints };
+	Persistence1D p;
+	for (int engine = 0; engine < NUMBER_OF_ENGINES; engine++)
+	{
+		dispatcher.SetOverride(engine);
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		dispatcher.RunPersistence(p, data);
+		const double time = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+		if (engine == ENGINE_PARALLEL_SORT) *coefficients[engine] = std::max(0.0, time - ThreadStart * threads) / GetWork(engine, profile, threads);
+		else *coefficients[engine] = time / GetWork(engine, profile, threads);
+	}
+}
+}
+#endif
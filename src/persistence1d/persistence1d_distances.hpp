@@ -0,0 +1,567 @@
+/*! \file persistence1d_distances.hpp
+    Bottleneck and Wasserstein distances between persistence diagrams of Persistence1D results.
+*/
+
+#ifndef PERSISTENCE_DISTANCES_H
+#define PERSISTENCE_DISTANCES_H
+
+#include "persistence1d.hpp"
+
+#include <math.h>
+#include <atomic>
+#include <limits>
+#include <thread>
+
+namespace p1d
+{
+
+/*!
+	Point of a persistence diagram: the value of a paired minimum (birth) and of its paired maximum (death).
+*/
+struct TDiagramPoint
+{
+	double Birth;
+	double Death;
+	double Persistence;	//Death - Birth
+
+	bool operator<(const TDiagramPoint& other) const
+	{
+		return (Persistence < other.Persistence);
+	}
+};
+
+
+/*!
+	Persistence diagram of a Persistence1D run.
+
+	Finite points are created from paired extrema and kept sorted according to persistence.
+	The global minimum is never paired. It is the only essential (never dying) point of the diagram,
+	and is stored separately.
+*/
+class PersistenceDiagram
+{
+public:
+	PersistenceDiagram():HasEssentialPoint(false),EssentialBirth(0)
+	{
+	}
+
+	/*!
+		Creates the diagram of the results of the last RunPersistence call.
+
+		@param[in] p		Persistence1D object, after RunPersistence.
+		@param[in] data		Data used for RunPersistence.
+	*/
+	bool Create(const Persistence1D& p, const std::vector<float>& data)
+	{
+		std::vector<TPairedExtrema> pairs;
+		p.GetPairedExtrema(pairs);
+
+		if (p.GetGlobalMinimumIndex() < 0)
+		{
+			Clear();
+			return false;
+		}
+		return Create(pairs, &data[0], p.GetGlobalMinimumValue());
+	}
+
+	/*!
+		Creates a diagram from paired extrema, e.g. from GetPairedExtrema, and the global minimum.
+
+		@param[in] pairs			Paired extrema. Sorting them according to persistence saves a sort.
+		@param[in] data				Data values, to look up values of paired extrema.
+		@param[in] globalMinValue	Value of the global minimum.
+	*/
+	bool Create(const std::vector<TPairedExtrema>& pairs, const float * data, const float globalMinValue)
+	{
+		Clear();
+		Points.reserve(pairs.size());
+
+		for (std::vector<TPairedExtrema>::const_iterator p = pairs.begin(); p != pairs.end(); p++)
+		{
+			TDiagramPoint point;
+			point.Birth = data[(*p).MinIndex];
+			point.Death = data[(*p).MaxIndex];
+			point.Persistence = point.Death - point.Birth;
+			Points.push_back(point);
+		}
+
+		//results of GetPairedExtrema are already sorted
+		if (!std::is_sorted(Points.begin(), Points.end())) std::sort(Points.begin(), Points.end());
+
+		HasEssentialPoint = true;
+		EssentialBirth = globalMinValue;
+		return true;
+	}
+
+	void Clear()
+	{
+		Points.clear();
+		HasEssentialPoint = false;
+		EssentialBirth = 0;
+	}
+
+	///Finite points, sorted according to persistence.
+	const std::vector<TDiagramPoint>& GetPoints() const { return Points; }
+
+	///Returns true if the diagram has a global minimum. False for empty data.
+	bool GetHasEssentialPoint() const { return HasEssentialPoint; }
+
+	///Birth value of the essential point, i.e. the value of the global minimum.
+	double GetEssentialBirth() const { return EssentialBirth; }
+
+protected:
+	std::vector<TDiagramPoint> Points;
+	bool HasEssentialPoint;
+	double EssentialBirth;
+};
+
+
+/*!
+	Computes exact distances between persistence diagrams.
+
+	The distance between two points is the L-infinity distance, max(|b1 - b2|, |d1 - d2|).
+	A point may be matched to the diagonal, at half its persistence.
+	The essential points (global minima) are always matched to each other. If only one diagram has an essential point,
+	the distance is infinite.
+
+	- Bottleneck distance: the largest distance in the best matching.
+	  Found by a search over candidate distances, each checked by a maximum bipartite matching (Hopcroft-Karp).
+	  Points are sorted according to persistence, so neighbors of a point can be found by binary search:
+	  points within distance r differ in persistence by at most 2r. Distances to the diagonal are searched first,
+	  so only distances between points which are in the remaining interval and close in persistence are candidates.
+	- p-Wasserstein distance: the p-th root of the sum of all distances to the power of p in the best matching.
+	  Found by the Hungarian algorithm in O((n+m)^3) for diagrams with n and m points.
+
+	An object keeps its working memory between calls. Use one object per thread.
+*/
+class PersistenceDiagramDistance
+{
+public:
+	/*!
+		Returns the bottleneck distance between two diagrams.
+	*/
+	double Bottleneck(const PersistenceDiagram& first, const PersistenceDiagram& second)
+	{
+		double essential = GetEssentialDistance(first, second);
+		if (essential == std::numeric_limits<double>::infinity()) return essential;
+
+		const std::vector<TDiagramPoint>& A = first.GetPoints();
+		const std::vector<TDiagramPoint>& B = second.GetPoints();
+
+		//matching all points to the diagonal is always possible - the most persistent points are last.
+		double upper = 0;
+		if (!A.empty()) upper = std::max(upper, GetDiagonalDistance(A.back()));
+		if (!B.empty()) upper = std::max(upper, GetDiagonalDistance(B.back()));
+		if (upper <= essential) return essential;
+
+		//the result is the distance of the essential points, one of the distances between points, or between a point
+		//and the diagonal. There are only O(n+m) candidates of the first and last kind, so they are searched first.
+		Candidates.clear();
+		Candidates.push_back(essential);
+		Candidates.push_back(upper);
+		AddDiagonalCandidates(A, essential, upper);
+		AddDiagonalCandidates(B, essential, upper);
+		double infeasible;
+		upper = FindSmallestFeasibleCandidate(A, B, infeasible);
+		if (upper <= essential) return essential;
+
+		//the remaining candidates are distances between points in (infeasible, upper)
+		Candidates.clear();
+		Candidates.push_back(upper);
+		AddPointCandidates(A, B, infeasible, upper);
+		return std::max(essential, FindSmallestFeasibleCandidate(A, B, infeasible));
+	}
+
+	/*!
+		Returns the p-Wasserstein distance between two diagrams.
+
+		@param[in] p	Exponent, greater than or equal to 1.
+	*/
+	double Wasserstein(const PersistenceDiagram& first, const PersistenceDiagram& second, const double p = 2)
+	{
+		double essential = GetEssentialDistance(first, second);
+		if (essential == std::numeric_limits<double>::infinity()) return essential;
+
+		const std::vector<TDiagramPoint>& A = first.GetPoints();
+		const std::vector<TDiagramPoint>& B = second.GetPoints();
+
+		return pow(pow(essential, p) + GetMinimalMatchingCost(A, B, p), 1.0 / p);
+	}
+
+	/*!
+		Returns the p-Wasserstein distance, or the bottleneck distance if p is infinite.
+	*/
+	double Distance(const PersistenceDiagram& first, const PersistenceDiagram& second, const double p)
+	{
+		if (p == std::numeric_limits<double>::infinity()) return Bottleneck(first, second);
+		return Wasserstein(first, second, p);
+	}
+
+	/*!
+		Computes distances from one diagram to many diagrams in parallel.
+
+		@param[in]	query			Diagram to compare.
+		@param[in]	references		Diagrams to compare to.
+		@param[out] distances		Distance to each reference diagram.
+		@param[in]	p				Wasserstein exponent. Set to infinity for bottleneck distances.
+		@param[in]	numThreads		Number of threads. Set to 0 to use all cores.
+	*/
+	static void ComputeDistances(const PersistenceDiagram& query, const std::vector<PersistenceDiagram>& references,
+								 std::vector<double>& distances,
+								 const double p = std::numeric_limits<double>::infinity(),
+								 unsigned int numThreads = 0)
+	{
+		distances.assign(references.size(), 0);
+
+		if (numThreads == 0) numThreads = std::thread::hardware_concurrency();
+		if (numThreads == 0) numThreads = 1;
+		if (numThreads > references.size()) numThreads = (unsigned int)references.size();
+
+		//diagrams differ in size, so threads take the next reference when done instead of fixed ranges
+		std::atomic<size_t> next(0);
+		std::vector<std::thread> threads;
+		for (unsigned int t = 0; t < numThreads; t++)
+		{
+			threads.push_back(std::thread([&]()
+			{
+				PersistenceDiagramDistance workspace;
+				for (size_t r = next++; r < references.size(); r = next++)
+				{
+					distances[r] = workspace.Distance(query, references[r], p);
+				}
+			}));
+		}
+		for (size_t t = 0; t < threads.size(); t++)
+		{
+			threads[t].join();
+		}
+	}
+
+protected:
+	std::vector<double> Candidates;
+
+	//Hopcroft-Karp
+	std::vector<int> Adjacency;			//neighbors of all left vertices
+	std::vector<int> AdjacencyBegin;	//first neighbor of each left vertex in Adjacency
+	std::vector<int> MatchLeft;
+	std::vector<int> MatchRight;
+	std::vector<int> Layer;
+	std::vector<int> Queue;
+	std::vector<int> NextNeighbor;		//next neighbor to try in Augment
+
+	//Hungarian
+	std::vector<double> PotentialRow;
+	std::vector<double> PotentialColumn;
+	std::vector<double> MinSlack;
+	std::vector<int> RowOfColumn;
+	std::vector<int> Way;
+	std::vector<char> Used;
+
+	static double GetDistance(const TDiagramPoint& a, const TDiagramPoint& b)
+	{
+		return std::max(fabs(a.Birth - b.Birth), fabs(a.Death - b.Death));
+	}
+
+	static double GetDiagonalDistance(const TDiagramPoint& a)
+	{
+		return a.Persistence / 2;
+	}
+
+	static double GetEssentialDistance(const PersistenceDiagram& first, const PersistenceDiagram& second)
+	{
+		if (first.GetHasEssentialPoint() != second.GetHasEssentialPoint()) return std::numeric_limits<double>::infinity();
+		if (!first.GetHasEssentialPoint()) return 0;
+		return fabs(first.GetEssentialBirth() - second.GetEssentialBirth());
+	}
+
+	void AddDiagonalCandidates(const std::vector<TDiagramPoint>& points, const double lower, const double upper)
+	{
+		for (size_t i = 0; i < points.size(); i++)
+		{
+			double d = GetDiagonalDistance(points[i]);
+			if (d > lower && d < upper) Candidates.push_back(d);
+		}
+	}
+
+	/*!
+		Adds the distances between points of A and B in (lower, upper) which are smaller than the distance 
+		of one of the points to the diagonal - otherwise matching both points to the diagonal is at least as good.
+		Such points differ in persistence by less than 2*upper, so only this range of B is searched, as in CoversFarPoints.
+	*/
+	void AddPointCandidates(const std::vector<TDiagramPoint>& A, const std::vector<TDiagramPoint>& B, const double lower, const double upper)
+	{
+		TDiagramPoint bound;
+		for (size_t i = 0; i < A.size(); i++)
+		{
+			const TDiagramPoint& point = A[i];
+
+			//slack for rounding errors of Persistence, the exact distance is checked below
+			const double range = 2 * upper + 1e-9 * (fabs(point.Birth) + fabs(point.Death) + upper);
+			bound.Persistence = point.Persistence - range;
+			//if point is within lower of the diagonal, the other point has to be further from it
+			if (GetDiagonalDistance(point) <= lower) bound.Persistence = std::max(bound.Persistence, 2 * lower);
+
+			std::vector<TDiagramPoint>::const_iterator j = std::lower_bound(B.begin(), B.end(), bound);
+			for (; j != B.end() && (*j).Persistence <= point.Persistence + range; j++)
+			{
+				double d = GetDistance(point, *j);
+				if (d > lower && d < upper && d < std::max(GetDiagonalDistance(point), GetDiagonalDistance(*j)))
+				{
+					Candidates.push_back(d);
+				}
+			}
+		}
+	}
+
+	/*!
+		Returns the smallest candidate for which a matching is possible, by binary search with selection 
+		instead of sorting all candidates. The largest candidate must be feasible.
+
+		@param[out] infeasible	Largest candidate below the result, for which no matching is possible. -1 if there is none.
+	*/
+	double FindSmallestFeasibleCandidate(const std::vector<TDiagramPoint>& A, const std::vector<TDiagramPoint>& B, double& infeasible)
+	{
+		std::vector<double>::iterator begin = Candidates.begin(), end = Candidates.end();
+		while (end - begin > 1)
+		{
+			std::vector<double>::iterator middle = begin + (end - begin - 1)/2;
+			std::nth_element(begin, middle, end);
+			if (IsMatchingPossible(A, B, *middle)) end = middle + 1;
+			else begin = middle + 1;
+		}
+
+		//candidates before begin are all at most an infeasible candidate
+		infeasible = -1;
+		for (std::vector<double>::const_iterator it = Candidates.begin(); it != begin; it++)
+		{
+			infeasible = std::max(infeasible, *it);
+		}
+		return *begin;
+	}
+
+	/*!
+		Returns true if there is a matching in which all distances are at most radius.
+
+		Points closer than radius to the diagonal can always be matched to it. The others have to be matched to points
+		of the other diagram. By the Mendelsohn-Dulmage theorem, a matching which covers the far points of both diagrams
+		exists if there is one which covers the far points of A, and one which covers the far points of B.
+	*/
+	bool IsMatchingPossible(const std::vector<TDiagramPoint>& A, const std::vector<TDiagramPoint>& B, const double radius)
+	{
+		return CoversFarPoints(A, B, radius) && CoversFarPoints(B, A, radius);
+	}
+
+	/*!
+		Returns true if all points of left which are further than radius from the diagonal can be matched
+		to points of right within radius.
+	*/
+	bool CoversFarPoints(const std::vector<TDiagramPoint>& left, const std::vector<TDiagramPoint>& right, const double radius)
+	{
+		//far points are a suffix of the sorted points
+		size_t firstFar = left.size();
+		while (firstFar > 0 && GetDiagonalDistance(left[firstFar - 1]) > radius) firstFar--;
+
+		const int numLeft = (int)(left.size() - firstFar);
+		if (numLeft == 0) return true;
+		if (numLeft > (int)right.size()) return false;
+
+		//neighbors differ in persistence by at most 2*radius, search only in this range of right
+		Adjacency.clear();
+		AdjacencyBegin.resize(numLeft + 1);
+		TDiagramPoint bound;
+		for (int i = 0; i < numLeft; i++)
+		{
+			const TDiagramPoint& point = left[firstFar + i];
+			AdjacencyBegin[i] = (int)Adjacency.size();
+
+			//slack for rounding errors of Persistence, the exact distance is checked below
+			const double range = 2 * radius + 1e-9 * (fabs(point.Birth) + fabs(point.Death) + radius);
+			bound.Persistence = point.Persistence - range;
+			std::vector<TDiagramPoint>::const_iterator j = std::lower_bound(right.begin(), right.end(), bound);
+			for (; j != right.end() && (*j).Persistence <= point.Persistence + range; j++)
+			{
+				if (GetDistance(point, *j) <= radius) Adjacency.push_back((int)(j - right.begin()));
+			}
+			if (Adjacency.size() == (size_t)AdjacencyBegin[i]) return false;
+		}
+		AdjacencyBegin[numLeft] = (int)Adjacency.size();
+
+		return (GetMaximumMatchingSize(numLeft, (int)right.size()) == numLeft);
+	}
+
+	/*!
+		Hopcroft-Karp maximum bipartite matching on Adjacency.
+	*/
+	int GetMaximumMatchingSize(const int numLeft, const int numRight)
+	{
+		MatchLeft.assign(numLeft, -1);
+		MatchRight.assign(numRight, -1);
+		Layer.resize(numLeft);
+		NextNeighbor.resize(numLeft);
+
+		int size = 0;
+		while (BuildLayers(numLeft))
+		{
+			for (int i = 0; i < numLeft; i++)
+			{
+				NextNeighbor[i] = AdjacencyBegin[i];
+			}
+			for (int i = 0; i < numLeft; i++)
+			{
+				if (MatchLeft[i] == -1 && Augment(i)) size++;
+			}
+		}
+		return size;
+	}
+
+	/*!
+		Breadth first search from all unmatched left vertices along alternating paths.
+		Returns true if an augmenting path exists.
+	*/
+	bool BuildLayers(const int numLeft)
+	{
+		Queue.clear();
+		for (int i = 0; i < numLeft; i++)
+		{
+			if (MatchLeft[i] == -1)
+			{
+				Layer[i] = 0;
+				Queue.push_back(i);
+			}
+			else Layer[i] = -1;
+		}
+
+		bool found = false;
+		for (size_t q = 0; q < Queue.size(); q++)
+		{
+			int i = Queue[q];
+			for (int a = AdjacencyBegin[i]; a != AdjacencyBegin[i+1]; a++)
+			{
+				int matched = MatchRight[Adjacency[a]];
+				if (matched == -1) found = true;
+				else if (Layer[matched] == -1)
+				{
+					Layer[matched] = Layer[i] + 1;
+					Queue.push_back(matched);
+				}
+			}
+		}
+		return found;
+	}
+
+	/*!
+		Depth first search for an augmenting path along the layers. Depth is bounded by the length of shortest augmenting paths.
+	*/
+	bool Augment(const int i)
+	{
+		for (int& a = NextNeighbor[i]; a != AdjacencyBegin[i+1]; a++)
+		{
+			int j = Adjacency[a];
+			int matched = MatchRight[j];
+			if (matched == -1 || (Layer[matched] == Layer[i] + 1 && Augment(matched)))
+			{
+				MatchLeft[i] = j;
+				MatchRight[j] = i;
+				return true;
+			}
+		}
+		Layer[i] = -1;
+		return false;
+	}
+
+	/*!
+		Cost of matching row to column in the (n+m)x(n+m) assignment problem of the Wasserstein distance.
+		Rows are the n points of A, followed by m diagonal copies of B.
+		Columns are the m points of B, followed by n diagonal copies of A.
+		All diagonal copies are equivalent, so any point can take any diagonal copy.
+	*/
+	static double GetCost(const std::vector<TDiagramPoint>& A, const std::vector<TDiagramPoint>& B,
+						  const int row, const int column, const double p)
+	{
+		const int n = (int)A.size(), m = (int)B.size();
+		double d;
+		if (row < n && column < m) d = GetDistance(A[row], B[column]);
+		else if (row < n) d = GetDiagonalDistance(A[row]);
+		else if (column < m) d = GetDiagonalDistance(B[column]);
+		else return 0;
+
+		if (p == 1) return d;
+		if (p == 2) return d * d;
+		return pow(d, p);
+	}
+
+	/*!
+		Hungarian algorithm with potentials (shortest augmenting paths), O(N^3) for N = n+m.
+		Returns the sum of costs of a minimal matching.
+	*/
+	double GetMinimalMatchingCost(const std::vector<TDiagramPoint>& A, const std::vector<TDiagramPoint>& B, const double p)
+	{
+		const int N = (int)(A.size() + B.size());
+		const double infinity = std::numeric_limits<double>::infinity();
+		if (N == 0) return 0;
+
+		//1-indexed, row and column 0 are auxiliary
+		PotentialRow.assign(N + 1, 0);
+		PotentialColumn.assign(N + 1, 0);
+		RowOfColumn.assign(N + 1, 0);
+		Way.assign(N + 1, 0);
+
+		for (int row = 1; row <= N; row++)
+		{
+			RowOfColumn[0] = row;
+			int column = 0;
+			MinSlack.assign(N + 1, infinity);
+			Used.assign(N + 1, 0);
+
+			do
+			{
+				Used[column] = 1;
+				int currentRow = RowOfColumn[column], nextColumn = 0;
+				double delta = infinity;
+				for (int j = 1; j <= N; j++)
+				{
+					if (Used[j]) continue;
+
+					double slack = GetCost(A, B, currentRow - 1, j - 1, p) - PotentialRow[currentRow] - PotentialColumn[j];
+					if (slack < MinSlack[j])
+					{
+						MinSlack[j] = slack;
+						Way[j] = column;
+					}
+					if (MinSlack[j] < delta)
+					{
+						delta = MinSlack[j];
+						nextColumn = j;
+					}
+				}
+				for (int j = 0; j <= N; j++)
+				{
+					if (Used[j])
+					{
+						PotentialRow[RowOfColumn[j]] += delta;
+						PotentialColumn[j] -= delta;
+					}
+					else MinSlack[j] -= delta;
+				}
+				column = nextColumn;
+			} while (RowOfColumn[column] != 0);
+
+			//flip the augmenting path
+			do
+			{
+				int previous = Way[column];
+				RowOfColumn[column] = RowOfColumn[previous];
+				column = previous;
+			} while (column != 0);
+		}
+
+		double cost = 0;
+		for (int j = 1; j <= N; j++)
+		{
+			cost += GetCost(A, B, RowOfColumn[j] - 1, j - 1, p);
+		}
+		return cost;
+	}
+};
+}
+#endif
@@ -4,11 +4,19 @@
  * This file contains a sample code for using Persistence1D on data in text files, and 
  * can be used to directly run Persistence1D on data in a single text file.
  *
- *  Command line: persistence1d_driver.exe	\<filename\> [threshold] [-MATLAB]
+ *  Command line: persistence1d_driver.exe	\<filename\> [threshold] [-MATLAB] [-TRACE \<trace file\>] [-CSV | -TSV] [-COLUMNS \<columns\>]
  *			- filename is the path to a data text file.
  *			  Data is assumed to be formatted as a single float-compatible value per row. 
  *			- [Optional] threshold is a floating point value. Acceptable threshold value >= 0
  *			- [Optional] -MATLAB - output indices match Matlab 1-indexing convention.
+ *			- [Optional] -TRACE - writes a timeline of reading, parsing, each phase of Persistence1D, 
+ *			  filtering and writing to a Chrome trace JSON file, with hardware counters for the Watershed phase 
+ *			  where available. See persistence1d_trace.hpp.
+ *			- [Optional] -CSV or -TSV - data is a comma or tab delimited file with many columns, e.g. a timestamp 
+ *			  and numeric columns, and an optional header line. Persistence runs on every selected column in parallel. 
+ *			  See persistence1d_columns.hpp.
+ *			- [Optional] -COLUMNS - zero based positions of the selected columns, separated by commas, e.g. 1,2,5.
+ *			  By default, all numeric columns are selected.
  *  Output:	- Indices of extrema, written to a text file, one value per row.
 			  Indices of paired extrema are written in following rows. 
  *			  Indices are ordered according to their persistence, from most to least persistence. 
@@ -16,16 +24,36 @@
  *			  Odd rows contain indices of maxima.
  *			  Global minimum is not paired and is not written to file.
  *			  Output filename: \<filename\>_res.txt
+ *			  With -CSV or -TSV, one file per selected column: \<filename\>_col\<position\>_res.txt
+ *
+ *  Server mode: persistence1d_driver.exe -SERVER \<socket\> [cache size]
+ *			- Listens on a Unix domain socket and answers requests until killed. Not supported on Windows.
+ *			- [Optional] cache size is the number of cached results, SERVER_DEFAULT_CACHE_SIZE by default.
+ *			  See persistence1d_server.hpp for the protocol.
  *
  */
 
 
 #include "persistence1d.hpp"
+#include "persistence1d_columns.hpp"
+#include "persistence1d_server.hpp"
+#include "persistence1d_trace.hpp"
 
+#include <ctype.h>
+#include <errno.h>
+#include <stdlib.h>
 #include <fstream>
+#include <iterator>
+#include <memory>
+#include <sstream>
 #include <string>
 
 #define MATLAB "-MATLAB"
+#define SERVER "-SERVER"
+#define TRACE "-TRACE"
+#define CSV "-CSV"
+#define TSV "-TSV"
+#define COLUMNS "-COLUMNS"
 
 using namespace std;
 using namespace p1d;
@@ -42,8 +70,10 @@ using namespace p1d;
 
 	@param[in] filename		Name of input file with float data.
 	@param[out] data		Data is written to this vector.
+	@param[in] trace		If set, the file is read at once and then parsed, with an event for each.
+	@param[in] traceArgs	Arguments of trace events.
 */
-bool ReadFileToVector (char * filename, vector<float> & data);
+bool ReadFileToVector (char * filename, vector<float> & data, TraceRecorder * trace = NULL, const string & traceArgs = string());
 /*!
 	Writes indices of extrema features to file, sorted according to their persistence. 
 
@@ -56,11 +86,27 @@ bool ReadFileToVector (char * filename, vector<float> & data);
 	
 */
 void WriteMinMaxPairsToFile (char * filename, vector<TPairedExtrema> pairs);
+/*!
+	Runs persistence on the columns of a delimited file, and writes the results of each column 
+	to a file called basename_col<position>_res.txt, like WriteMinMaxPairsToFile.
+
+	@param[in] filename			Name of input file.
+	@param[in] basename			Input file name without extension.
+	@param[in] delimiter		Field delimiter.
+	@param[in] columns			Selected columns, or empty for all numeric columns.
+	@param[in] threshold		Threshold of written pairs.
+	@param[in] matlabIndexing	Set this to true to write Matlab indices.
+	@param[in] trace			If set, adds events for the run and for writing.
+	@param[in] traceArgs		Arguments of trace events.
+*/
+bool ProcessColumns(char * filename, const string & basename, const char delimiter, const vector<size_t> & columns, 
+					const float threshold, const bool matlabIndexing, TraceRecorder * trace, const string & traceArgs);
 /*!
 	Parses user command line.
-	Checks if the user set a threshold value or wants MATLAB indexing.
+	Checks if the user set a threshold value, wants MATLAB indexing, a trace file, or delimited input and its columns.
+	delimiter is set to 0 for data with one value per line.
 */
-bool ParseCmdLine(int argc, char* argv[], float &threshold, bool & matlabIndexing);
+bool ParseCmdLine(int argc, char* argv[], float &threshold, bool & matlabIndexing, char * & traceFilename, char & delimiter, vector<size_t> & columns);
 
 /*!
 	Main function - reads a file specified as a command line argument. runs persistence, 
@@ -77,15 +123,28 @@ int main(int argc, char* argv[])
 	float threshold;
 	vector <TPairedExtrema> pairs;
 	bool matlabIndexing;
+	char * traceFilename;
 	Persistence1D p;
 
 	if (argc < 2) 
 	{
 		cout << "No filename" << endl;
-		cout << "Usage: " << argv[0] << " <filename> [threshold] [-MATLAB]" << endl;
+		cout << "Usage: " << argv[0] << " <filename> [threshold] [-MATLAB] [-TRACE <trace file>] [-CSV | -TSV] [-COLUMNS <columns>]" << endl;
+		cout << "       " << argv[0] << " -SERVER <socket> [cache size]" << endl;
 		return false;
 	}
 
+	if (strcmp(argv[1], SERVER) == 0)
+	{
+		if (argc < 3)
+		{
+			cout << "Usage: " << argv[0] << " -SERVER <socket> [cache size]" << endl;
+			return -1;
+		}
+		size_t cacheSize = (argc > 3) ? (size_t)atoi(argv[3]) : SERVER_DEFAULT_CACHE_SIZE;
+		return RunServer(argv[2], cacheSize) ? 0 : -3;
+	}
+
 	//filename processing, easier done here.
 	char * filename = argv[1];
 	char * outfilename = new char[strlen(filename) + strlen("_res.txt")];
@@ -94,28 +153,64 @@ int main(int argc, char* argv[])
 	outfilename[strlen(filename)-4] = '\0';
 	strcat(outfilename, "_res.txt");
 	
-	if (!ParseCmdLine(argc, argv, threshold, matlabIndexing))
+	char delimiter;
+	vector<size_t> columns;
+	if (!ParseCmdLine(argc, argv, threshold, matlabIndexing, traceFilename, delimiter, columns))
 	{
-		cout << "Usage: " << argv[0] << " <filename> [threshold] [-MATLAB]" << endl;
+		cout << "Usage: " << argv[0] << " <filename> [threshold] [-MATLAB] [-TRACE <trace file>] [-CSV | -TSV] [-COLUMNS <columns>]" << endl;
 		return -1; 
 	}
-	
-	if(!ReadFileToVector(filename, data))
+
+	//without -TRACE, trace is NULL and all trace events do nothing
+	TraceRecorder recorder;
+	TraceRecorder * trace = traceFilename ? &recorder : NULL;
+	const string traceArgs = "\"file\":\"" + EscapeJson(filename) + "\"";
+	if (delimiter)
 	{
-		cout << "Error reading data to file." << endl; 
-		return -2;
+		ScopedTraceEvent fileEvent(trace, "ProcessFile", "driver", traceArgs);
+
+		if (!ProcessColumns(filename, string(filename, strlen(filename) - 4), delimiter, columns, threshold, matlabIndexing, trace, traceArgs))
+		{
+			cout << "Error reading columns of file." << endl; 
+			return -2;
+		}
+	}
+	else
+	{
+		ScopedTraceEvent fileEvent(trace, "ProcessFile", "driver", traceArgs);
+
+		if(!ReadFileToVector(filename, data, trace, traceArgs))
+		{
+			cout << "Error reading data to file." << endl; 
+			return -2;
+		}
+
+		//the traced run only exists with -TRACE, and gets its events from the phase hooks of Persistence1D
+		unique_ptr<TracedPersistence1D> traced;
+		if (trace) traced.reset(new TracedPersistence1D(recorder, traceArgs));
+		Persistence1D & results = trace ? *traced : p;
+		results.RunPersistence(data);
+		{
+			ScopedTraceEvent event(trace, "FilterByPersistence", "driver", traceArgs);
+			results.GetPairedExtrema(pairs, threshold , matlabIndexing);
+		}
+		{
+			ScopedTraceEvent event(trace, "WriteResults", "driver", traceArgs);
+			WriteMinMaxPairsToFile(outfilename, pairs);
+		}
+	}
+
+	if (trace && !recorder.WriteJson(traceFilename))
+	{
+		cout << "Cannot open file " << traceFilename << " for writing." << endl;
 	}
-	
-	p.RunPersistence(data);
-	p.GetPairedExtrema(pairs, threshold , matlabIndexing);
-	WriteMinMaxPairsToFile(outfilename, pairs);
 
 	delete outfilename;
 		
 	return 0;
 }
 
-bool ReadFileToVector (char * filename, vector<float> & data)
+bool ReadFileToVector (char * filename, vector<float> & data, TraceRecorder * trace, const string & traceArgs)
 {
 	ifstream datafile;
 	
@@ -131,6 +226,23 @@ bool ReadFileToVector (char * filename, vector<float> & data)
 
 	float currdata;
 
+	if (trace)
+	{
+		string contents;
+		{
+			ScopedTraceEvent event(trace, "ReadFile", "driver", traceArgs);
+			contents.assign(istreambuf_iterator<char>(datafile), istreambuf_iterator<char>());
+		}
+		ScopedTraceEvent event(trace, "ParseData", "driver", traceArgs);
+		istringstream stream(contents);
+		while(stream >> currdata)
+		{
+			data.push_back(currdata);
+		}
+		datafile.close();
+		return true;
+	}
+
 	while(datafile >> currdata)
 	{
 		data.push_back(currdata);
@@ -158,17 +270,84 @@ void WriteMinMaxPairsToFile (char * filename, vector<TPairedExtrema> pairs)
 
 	datafile.close();
 }
-bool ParseCmdLine(int argc, char* argv[], float &threshold, bool & matlabIndexing)
+bool ProcessColumns(char * filename, const string & basename, const char delimiter, const vector<size_t> & columns, 
+					const float threshold, const bool matlabIndexing, TraceRecorder * trace, const string & traceArgs)
+{
+	Persistence1DColumns results;
+	{
+		ScopedTraceEvent event(trace, "RunColumns", "driver", traceArgs);
+		if (!results.Run(filename, delimiter, columns)) return false;
+		event.AddArgs("\"columns\":" + to_string((unsigned long long)results.GetNumberOfColumns()) + 
+			",\"rows\":" + to_string((unsigned long long)results.GetNumberOfRows()));
+	}
+
+	ScopedTraceEvent event(trace, "WriteResults", "driver", traceArgs);
+	vector<TPairedExtrema> pairs;
+	for (size_t c = 0; c != results.GetNumberOfColumns(); c++)
+	{
+		results.GetResult(c).GetPairedExtrema(pairs, threshold, matlabIndexing);
+		string outfilename = basename + "_col" + to_string((unsigned long long)results.GetColumnPosition(c)) + "_res.txt";
+		WriteMinMaxPairsToFile(&outfilename[0], pairs);
+	}
+	return true;
+}
+bool ParseCmdLine(int argc, char* argv[], float &threshold, bool & matlabIndexing, char * & traceFilename, char & delimiter, vector<size_t> & columns)
 {	
 	bool noErrors = true;
 		
 	threshold = 0.0;
 	matlabIndexing = false;
+	traceFilename = NULL;
+	delimiter = 0;
+	columns.clear();
 	
-	//now let's find out if anyone wants MATLAB indexing or threshold values
+	//now let's find out if anyone wants MATLAB indexing, a trace, delimited input or threshold values
 	for (int counter = 2; counter < argc ; counter ++)
 	{
-		if (argv[counter][0]=='-' && matlabIndexing == false)
+		if (strcmp(argv[counter], TRACE) == 0)
+		{
+			if (counter + 1 == argc)
+			{
+				cout << "Missing trace file name." << endl;
+				noErrors = false;
+			}
+			else
+			{
+				traceFilename = argv[++counter];
+			}
+		}
+		else if (strcmp(argv[counter], CSV) == 0 || strcmp(argv[counter], TSV) == 0)
+		{
+			delimiter = (strcmp(argv[counter], CSV) == 0) ? ',' : '\t';
+		}
+		else if (strcmp(argv[counter], COLUMNS) == 0)
+		{
+			if (counter + 1 == argc)
+			{
+				cout << "Missing columns." << endl;
+				noErrors = false;
+				continue;
+			}
+
+			istringstream list(argv[++counter]);
+			string column;
+			while (getline(list, column, ','))
+			{
+				char * end = NULL;
+				errno = 0;
+				const long position = strtol(column.c_str(), &end, 10);
+
+				//strtol also takes leading spaces and signs
+				if (column.empty() || !isdigit((unsigned char)column[0]) || end != column.c_str() + column.size() || errno == ERANGE)
+				{
+					cout << "Columns should be zero based positions separated by commas, e.g. 1,2,5." << endl;
+					noErrors = false;
+					break;
+				}
+				columns.push_back((size_t)position);
+			}
+		}
+		else if (argv[counter][0]=='-' && matlabIndexing == false)
 		{
 			if (strcmp(argv[counter],"-MATLAB") == 0 || 
 				strcmp(argv[counter],"-Matlab") == 0 || 
@@ -219,5 +398,10 @@ bool ParseCmdLine(int argc, char* argv[], float &threshold, bool & matlabIndexin
 		}
 				
 	}
+	if (!columns.empty() && delimiter == 0)
+	{
+		cout << "-COLUMNS needs -CSV or -TSV." << endl;
+		noErrors = false;
+	}
 	return noErrors;
 }
@@ -0,0 +1,315 @@
+/*! \file persistence1d_fixed.hpp
+    Variant of Persistence1D for data of a fixed, small size known at compile time.
+*/
+
+#ifndef PERSISTENCE_FIXED_H
+#define PERSISTENCE_FIXED_H
+
+#include "persistence1d.hpp"
+
+#include <array>
+
+//Up to this size, data is sorted by counting smaller values for each value
+#define FIXED_RANK_SORT_SIZE 64
+//Above FIXED_RANK_SORT_SIZE, blocks of this size are sorted by insertion sort, and then merged
+#define FIXED_INSERTION_SORT_SIZE 16
+
+namespace p1d
+{
+
+/*!
+	Persistence1D for exactly N data values, e.g. for sliding windows.
+
+	All memory is held in fixed size arrays, no memory is allocated on the heap.
+	Small data is sorted by computing the rank of each value with branch-free comparisons to all other values, 
+	larger data by insertion sort of small blocks and bottom-up merging. 
+	All loops run over N, so the compiler may unroll and vectorize them. With C++17, all functions are constexpr.
+
+	Results are identical to Persistence1D.
+
+	Usage:
+	\code
+	Persistence1DFixed<64> p;
+	p.RunPersistence(window);	//pointer to 64 float values, or std::array<float, 64>
+	for (int i = 0; i < p.GetNumberOfPairs(); i++)
+	{
+		TPairedExtrema pair = p.GetPairedExtrema(i);
+	}
+	\endcode
+*/
+template <int N>
+class Persistence1DFixed
+{
+	static_assert(N >= 1, "Persistence1DFixed needs at least one data value");
+
+public:
+	P1D_CONSTEXPR Persistence1DFixed()
+		: SortedData(), Scratch(), Colors(), LeftEdgeIndex(), RightEdgeIndex(), MinIndex(), MinValue(), 
+#ifdef P1D_PAIR_ATTRIBUTES
+		  Sum(),
+#endif
+		  PairedExtrema(), NumberOfPairs(0), TotalComponents(0)
+	{
+	}
+
+	/*!
+		Finds extrema and their pairing on N data values.
+
+		@param[in] InputData	Pointer to N data values.
+	*/
+	P1D_CONSTEXPR void RunPersistence(const float * InputData)
+	{
+		NumberOfPairs = 0;
+		TotalComponents = 0;
+
+		CreateIndexValueVector(InputData);
+		Watershed();
+		SortPairedExtrema();
+	}
+
+	P1D_CONSTEXPR void RunPersistence(const std::array<float, N>& InputData)
+	{
+		RunPersistence(InputData.data());
+	}
+
+	///Returns the number of paired extrema.
+	P1D_CONSTEXPR int GetNumberOfPairs() const
+	{
+		return NumberOfPairs;
+	}
+
+	/*!
+		Returns a pair of extrema. Pairs are sorted according to persistence, from least to most persistent.
+
+		@param[in] i	Index of pair, smaller than GetNumberOfPairs().
+	*/
+	P1D_CONSTEXPR TPairedExtrema GetPairedExtrema(const int i) const
+	{
+		return PairedExtrema[i];
+	}
+
+	///Returns the index of the global minimum.
+	P1D_CONSTEXPR int GetGlobalMinimumIndex(const bool matlabIndexing = false) const
+	{
+		return MinIndex[0] + (matlabIndexing ? MATLAB_INDEX_FACTOR : 0);
+	}
+
+	///Returns the value of the global minimum.
+	P1D_CONSTEXPR float GetGlobalMinimumValue() const
+	{
+		return MinValue[0];
+	}
+
+protected:
+	//There are at most (N+1)/2 minima, all but one are paired
+	static const int MaxComponents = N/2 + 1;
+
+	std::array<TIdxAndData, N> SortedData;
+	std::array<TIdxAndData, N> Scratch;
+
+	///Colors of vertices, shifted by one. The first and last entries are always NO_COLOR,
+	///so vertices at the boundary need no special case.
+	std::array<int, N + 2> Colors;
+
+	std::array<int, MaxComponents> LeftEdgeIndex;
+	std::array<int, MaxComponents> RightEdgeIndex;
+	std::array<int, MaxComponents> MinIndex;
+	std::array<float, MaxComponents> MinValue;
+#ifdef P1D_PAIR_ATTRIBUTES
+	std::array<double, MaxComponents> Sum;
+#endif
+
+	std::array<TPairedExtrema, MaxComponents> PairedExtrema;
+	int NumberOfPairs;
+	int TotalComponents;
+
+	/*!
+		Sorts data according to values and indices, see TIdxAndData.
+	*/
+	P1D_CONSTEXPR void CreateIndexValueVector(const float * InputData)
+	{
+		if (N <= FIXED_RANK_SORT_SIZE)
+		{
+			for (int i = 0; i < N; i++)
+			{
+				//vertices on the left with equal values are smaller
+				int rank = 0;
+				for (int j = 0; j < i; j++)
+				{
+					rank += (InputData[j] <= InputData[i]);
+				}
+				for (int j = i + 1; j < N; j++)
+				{
+					rank += (InputData[j] < InputData[i]);
+				}
+				SortedData[rank].Idx = i;
+				SortedData[rank].Data = InputData[i];
+			}
+			return;
+		}
+
+		for (int i = 0; i < N; i++)
+		{
+			SortedData[i].Idx = i;
+			SortedData[i].Data = InputData[i];
+		}
+
+		for (int first = 0; first < N; first += FIXED_INSERTION_SORT_SIZE)
+		{
+			const int last = (first + FIXED_INSERTION_SORT_SIZE < N) ? first + FIXED_INSERTION_SORT_SIZE : N;
+			for (int i = first + 1; i < last; i++)
+			{
+				TIdxAndData current = SortedData[i];
+				int j = i;
+				for (; j > first && current < SortedData[j-1]; j--)
+				{
+					SortedData[j] = SortedData[j-1];
+				}
+				SortedData[j] = current;
+			}
+		}
+
+		//merge sorted blocks, back and forth between SortedData and Scratch
+		bool sortedInScratch = false;
+		for (int width = FIXED_INSERTION_SORT_SIZE; width < N; width *= 2)
+		{
+			if (sortedInScratch) MergeBlocks(Scratch, SortedData, width);
+			else MergeBlocks(SortedData, Scratch, width);
+			sortedInScratch = !sortedInScratch;
+		}
+		if (sortedInScratch)
+		{
+			for (int i = 0; i < N; i++)
+			{
+				SortedData[i] = Scratch[i];
+			}
+		}
+	}
+
+	/*!
+		Merges each two neighboring sorted blocks of the given width from source to destination.
+	*/
+	static P1D_CONSTEXPR void MergeBlocks(const std::array<TIdxAndData, N>& source, std::array<TIdxAndData, N>& destination, const int width)
+	{
+		for (int first = 0; first < N; first += 2 * width)
+		{
+			const int middle = (first + width < N) ? first + width : N;
+			const int last = (first + 2 * width < N) ? first + 2 * width : N;
+			int left = first, right = middle;
+			for (int i = first; i < last; i++)
+			{
+				if (right == last || (left < middle && !(source[right] < source[left]))) destination[i] = source[left++];
+				else destination[i] = source[right++];
+			}
+		}
+	}
+
+	/*!
+		Same as Persistence1D::Watershed.
+	*/
+	P1D_CONSTEXPR void Watershed()
+	{
+		for (int i = 0; i < N + 2; i++)
+		{
+			Colors[i] = NO_COLOR;
+		}
+
+		for (int p = 0; p < N; p++)
+		{
+			const int i = SortedData[p].Idx;
+			const int leftComp = Colors[i];
+			const int rightComp = Colors[i+2];
+
+			if (leftComp == NO_COLOR && rightComp == NO_COLOR) //local minimum - create new component
+			{
+				CreateComponent(i, SortedData[p].Data);
+			}
+			else if (leftComp == NO_COLOR || rightComp == NO_COLOR) //single neighbor - extend, NO_COLOR is smaller than any component
+			{
+				const int comp = std::max(leftComp, rightComp);
+				ExtendComponent(comp, i);
+#ifdef P1D_PAIR_ATTRIBUTES
+				Sum[comp] += SortedData[p].Data;
+#endif
+			}
+			else //local maximum - merge components, destroy the one with the larger minimum
+			{
+				const int destroyedComp = (MinValue[rightComp] < MinValue[leftComp]) ? leftComp : rightComp;
+				CreatePairedExtrema(MinIndex[destroyedComp], MinValue[destroyedComp], i, SortedData[p].Data);
+#ifdef P1D_PAIR_ATTRIBUTES
+				PairedExtrema[NumberOfPairs-1].Width = RightEdgeIndex[destroyedComp] - LeftEdgeIndex[destroyedComp] + 1;
+				PairedExtrema[NumberOfPairs-1].Area = Sum[destroyedComp];
+				Sum[leftComp + rightComp - destroyedComp] += Sum[destroyedComp] + SortedData[p].Data;
+#endif
+				MergeComponents(leftComp, rightComp);
+				Colors[i+1] = Colors[i];
+			}
+		}
+	}
+
+	P1D_CONSTEXPR void CreateComponent(const int minIdx, const float minValue)
+	{
+		LeftEdgeIndex[TotalComponents] = minIdx;
+		RightEdgeIndex[TotalComponents] = minIdx;
+		MinIndex[TotalComponents] = minIdx;
+		MinValue[TotalComponents] = minValue;
+#ifdef P1D_PAIR_ATTRIBUTES
+		Sum[TotalComponents] = minValue;
+#endif
+		Colors[minIdx+1] = TotalComponents;
+		TotalComponents++;
+	}
+
+	P1D_CONSTEXPR void ExtendComponent(const int componentIdx, const int dataIdx)
+	{
+		if (dataIdx + 1 == LeftEdgeIndex[componentIdx]) LeftEdgeIndex[componentIdx] = dataIdx;
+		else RightEdgeIndex[componentIdx] = dataIdx;
+
+		Colors[dataIdx+1] = componentIdx;
+	}
+
+	/*!
+		Same as Persistence1D::MergeComponents.
+	*/
+	P1D_CONSTEXPR void MergeComponents(const int firstIdx, const int secondIdx)
+	{
+		int survivorIdx = firstIdx, destroyedIdx = secondIdx;
+		if (MinValue[firstIdx] > MinValue[secondIdx] || (MinValue[firstIdx] == MinValue[secondIdx] && firstIdx > secondIdx))
+		{
+			survivorIdx = secondIdx;
+			destroyedIdx = firstIdx;
+		}
+
+		Colors[RightEdgeIndex[destroyedIdx]+1] = survivorIdx;
+		Colors[LeftEdgeIndex[destroyedIdx]+1] = survivorIdx;
+
+		if (MinIndex[survivorIdx] > MinIndex[destroyedIdx]) LeftEdgeIndex[survivorIdx] = LeftEdgeIndex[destroyedIdx];
+		else RightEdgeIndex[survivorIdx] = RightEdgeIndex[destroyedIdx];
+	}
+
+	P1D_CONSTEXPR void CreatePairedExtrema(const int firstIdx, const float firstValue, const int secondIdx, const float secondValue)
+	{
+		PairedExtrema[NumberOfPairs] = MakePairedExtrema(firstIdx, firstValue, secondIdx, secondValue);
+		NumberOfPairs++;
+	}
+
+	/*!
+		Insertion sort of pairs according to persistence, see TPairedExtrema.
+	*/
+	P1D_CONSTEXPR void SortPairedExtrema()
+	{
+		//NumberOfPairs < MaxComponents always, the second condition only avoids a false array bounds warning
+		for (int i = 1; i < NumberOfPairs && i < MaxComponents; i++)
+		{
+			TPairedExtrema current = PairedExtrema[i];
+			int j = i;
+			for (; j > 0 && current < PairedExtrema[j-1]; j--)
+			{
+				PairedExtrema[j] = PairedExtrema[j-1];
+			}
+			PairedExtrema[j] = current;
+		}
+	}
+};
+}
+#endif
@@ -0,0 +1,87 @@
+/*! \file persistence1d_mapping.hpp
+    Read-only memory mapping of whole files, used by PersistenceSnapshot and Persistence1DColumns.
+*/
+
+#ifndef PERSISTENCE_MAPPING_H
+#define PERSISTENCE_MAPPING_H
+
+#include <stddef.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace p1d
+{
+
+/*!
+	Maps a whole file read-only and shared, so processes which map the same file share a single copy of it in memory.
+	Fails if the file cannot be opened or is empty. Release the mapping with UnmapFile.
+
+	@param[in]	filename	Name of file.
+	@param[out]	mapping		Start of the mapped file.
+	@param[out]	size		Size of the file in bytes.
+	@param[in]	sequential	Set this if the file is read once, in order, so the system can read ahead.
+*/
+inline bool MapFile(const char * filename, void * & mapping, size_t & size, const bool sequential = false)
+{
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 
+		sequential ? FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN : FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER fileSize;
+	HANDLE fileMapping = NULL;
+	if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0)
+	{
+		fileMapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	}
+	CloseHandle(file);
+	if (!fileMapping) return false;
+
+	mapping = MapViewOfFile(fileMapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(fileMapping);	//the view keeps the mapping alive
+	size = (size_t)fileSize.QuadPart;
+	return (mapping != NULL);
+#else
+	int file = open(filename, O_RDONLY);
+	if (file < 0) return false;
+
+	struct stat status;
+	if (fstat(file, &status) != 0 || status.st_size <= 0)
+	{
+		close(file);
+		return false;
+	}
+
+	void * view = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_SHARED, file, 0);
+	close(file);	//the mapping stays valid
+	if (view == MAP_FAILED) return false;
+
+	if (sequential) madvise(view, (size_t)status.st_size, MADV_SEQUENTIAL);
+	mapping = view;
+	size = (size_t)status.st_size;
+	return true;
+#endif
+}
+
+///Unmaps a file mapped by MapFile.
+inline void UnmapFile(void * mapping, const size_t size)
+{
+#ifdef _WIN32
+	(void)size;
+	UnmapViewOfFile(mapping);
+#else
+	munmap(mapping, size);
+#endif
+}
+}
+#endif
@@ -0,0 +1,670 @@
+/*! \file persistence1d_outofcore.hpp
+    Out-of-core variant of Persistence1D, for data that does not fit into memory.
+*/
+
+#ifndef PERSISTENCE_OUTOFCORE_H
+#define PERSISTENCE_OUTOFCORE_H
+
+#include "persistence1d.hpp"
+
+#include <stdio.h>
+#include <fstream>
+#include <limits>
+#include <queue>
+#include <random>
+#include <string>
+
+#define OUTOFCORE_DEFAULT_MEMORY_BUDGET (64 << 20)
+#define OUTOFCORE_MIN_BLOCK_SIZE 64
+
+namespace p1d
+{
+
+/*!
+	Temporary binary file used to spill intermediate state to disk.
+	The file is removed when the object is closed or destroyed.
+*/
+class TSpillFile
+{
+public:
+	TSpillFile():File(NULL)
+	{
+	}
+
+	~TSpillFile()
+	{
+		Close();
+	}
+
+	/*!
+		Opens a new, empty temporary file.
+
+		@param[in] directory	Directory of the file. If empty, the system temporary directory is used.
+	*/
+	bool Open(const std::string& directory)
+	{
+		Close();
+
+		if (directory.empty())
+		{
+			File = tmpfile();
+			return (File != NULL);
+		}
+
+		std::random_device random;
+		char name[64];
+		snprintf(name, sizeof(name), "p1d_%08x%08x.tmp", (unsigned int)random(), (unsigned int)random());
+
+		Name = directory + "/" + name;
+		File = fopen(Name.c_str(), "w+b");
+		return (File != NULL);
+	}
+
+	void Close()
+	{
+		if (File != NULL) fclose(File);
+		File = NULL;
+
+		if (!Name.empty()) remove(Name.c_str());
+		Name.clear();
+	}
+
+	/*!
+		Writes bytes at a byte offset from the beginning of the file.
+	*/
+	bool Write(const long long offset, const void * buffer, const size_t bytes)
+	{
+		if (File == NULL || !Seek(offset)) return false;
+		return (fwrite(buffer, 1, bytes, File) == bytes);
+	}
+
+	/*!
+		Reads bytes from a byte offset from the beginning of the file.
+	*/
+	bool Read(const long long offset, void * buffer, const size_t bytes)
+	{
+		if (File == NULL || !Seek(offset)) return false;
+		return (fread(buffer, 1, bytes, File) == bytes);
+	}
+
+private:
+	bool Seek(const long long offset)
+	{
+#ifdef _WIN32
+		return (_fseeki64(File, offset, SEEK_SET) == 0);
+#else
+		return (fseeko(File, (off_t)offset, SEEK_SET) == 0);
+#endif
+	}
+
+	FILE * File;
+	std::string Name;
+
+	//not copyable - the file is owned by a single object
+	TSpillFile(const TSpillFile&);
+	TSpillFile& operator=(const TSpillFile&);
+};
+
+
+/*!
+	A region of the data processed so far, which contains an unresolved local maximum.
+
+	Max is a local maximum that has not been paired yet, because all vertices to its right have smaller values.
+	Min is the minimum of the vertices between Max and the next unresolved maximum to the right.
+	The first region of the data has no maximum (Max.Idx == -1).
+*/
+struct TUnresolvedRegion
+{
+	TIdxAndData Max;
+	TIdxAndData Min;
+};
+
+
+/*!
+	Stack of TUnresolvedRegion which keeps at most a fixed number of entries in memory.
+	When the stack grows beyond that, its bottom half is written to a spill file.
+	Spilled entries are read back once the in-memory entries are popped.
+*/
+class TSpillStack
+{
+public:
+	TSpillStack():Capacity(OUTOFCORE_MIN_BLOCK_SIZE),Spilled(0)
+	{
+	}
+
+	/*!
+		Clears the stack.
+
+		@param[in] capacity		Maximal number of entries kept in memory.
+		@param[in] directory	Directory of the spill file, see TSpillFile::Open.
+	*/
+	void Init(const size_t capacity, const std::string& directory)
+	{
+		Capacity = std::max(capacity, (size_t)OUTOFCORE_MIN_BLOCK_SIZE);
+		Directory = directory;
+		Spilled = 0;
+
+		Entries.clear();
+		Entries.reserve(Capacity);
+		File.Close();
+	}
+
+	size_t Size() const
+	{
+		return (Spilled + Entries.size());
+	}
+
+	TUnresolvedRegion& Top()
+	{
+		return Entries.back();
+	}
+
+	bool Push(const TUnresolvedRegion& region)
+	{
+		if (Entries.size() == Capacity && !SpillBottom()) return false;
+
+		Entries.push_back(region);
+		return true;
+	}
+
+	bool Pop()
+	{
+		Entries.pop_back();
+
+		if (Entries.empty() && Spilled > 0) return Reload();
+		return true;
+	}
+
+protected:
+	///Writes the bottom half of the in-memory entries to the spill file.
+	bool SpillBottom()
+	{
+		if (Spilled == 0 && !File.Open(Directory)) return false;
+
+		size_t count = Entries.size() / 2;
+		if (!File.Write((long long)(Spilled * sizeof(TUnresolvedRegion)), &Entries[0], count * sizeof(TUnresolvedRegion))) return false;
+
+		Entries.erase(Entries.begin(), Entries.begin() + count);
+		Spilled += count;
+		return true;
+	}
+
+	///Reads the topmost spilled entries back to memory.
+	bool Reload()
+	{
+		size_t count = std::min(Spilled, Capacity / 2);
+		Spilled -= count;
+
+		Entries.resize(count);
+		return File.Read((long long)(Spilled * sizeof(TUnresolvedRegion)), &Entries[0], count * sizeof(TUnresolvedRegion));
+	}
+
+	size_t Capacity;
+	size_t Spilled;
+	std::string Directory;
+	std::vector<TUnresolvedRegion> Entries;
+	TSpillFile File;
+};
+
+
+
+/*! Finds extrema and their persistence in one-dimensional data which does not fit into memory.
+
+	Results are identical to Persistence1D. The data is read once, in chunks, from left to right.
+	Only a summary of the data processed so far is kept: the sequence of local maxima that cannot be paired
+	before the rest of the data is known, together with the minima between them.
+	This summary, as well as the pairs, are written to temporary files whenever they exceed the memory budget.
+	Pairs are sorted by persistence with an external merge sort.
+
+	Data can be either read from a text file (same format as persistence1d_driver.cpp),
+	or passed chunk by chunk with Begin(), AddSamples() and End().
+
+	The memory budget is split between the input chunk, the summary and the pairs:
+	1/8 for input, 1/4 for the summary and 1/2 for sorting pairs.
+
+	With P1D_PAIR_ATTRIBUTES, the attributes of pairs are not computed (Width is -1): 
+	the extent of a basin depends on data which may have been dropped from memory already.
+*/
+class Persistence1DOutOfCore
+{
+public:
+	/*!
+		@param[in] memoryBudget		Approximate number of bytes used for data, summary and pairs.
+		@param[in] tempDirectory	Directory for temporary files. If empty, the system temporary directory is used.
+	*/
+	Persistence1DOutOfCore(const size_t memoryBudget = OUTOFCORE_DEFAULT_MEMORY_BUDGET, const std::string& tempDirectory = "")
+		:MemoryBudget(memoryBudget),TempDirectory(tempDirectory),NumberOfSamples(0),NumberOfPairs(0),MinPersistence(0),Failed(false)
+	{
+		GlobalMinimum.Idx = -1;
+	}
+
+	~Persistence1DOutOfCore()
+	{
+	}
+
+	/*!
+		Runs persistence on the data in a text file, formatted as one float-compatible value per row.
+		Reading stops at the first value which cannot be parsed.
+
+		@param[in] filename			Name of input file.
+		@param[in] minPersistence	Minimal persistence of stored pairs, see Persistence1D::RunPersistence.
+	*/
+	bool RunPersistence(const char * filename, const float minPersistence = 0)
+	{
+		Begin(minPersistence);
+
+		std::ifstream datafile(filename, std::ifstream::in);
+		if (!datafile)
+		{
+			End();
+			return false;
+		}
+
+		std::vector<float> chunk;
+		size_t chunkSize = std::max(MemoryBudget / 8 / sizeof(float), (size_t)OUTOFCORE_MIN_BLOCK_SIZE);
+		chunk.reserve(chunkSize);
+
+		float currdata;
+		while (datafile >> currdata)
+		{
+			chunk.push_back(currdata);
+			if (chunk.size() == chunkSize)
+			{
+				AddSamples(&chunk[0], chunk.size());
+				chunk.clear();
+			}
+		}
+
+		if (!chunk.empty()) AddSamples(&chunk[0], chunk.size());
+
+		return End();
+	}
+
+	/*!
+		Starts a new run. Clears previous results.
+
+		@param[in] minPersistence	Minimal persistence of stored pairs, see Persistence1D::RunPersistence.
+	*/
+	void Begin(const float minPersistence = 0)
+	{
+		NumberOfSamples = 0;
+		NumberOfPairs = 0;
+		MinPersistence = minPersistence;
+		Failed = false;
+		GlobalMinimum.Idx = -1;
+		GlobalMinimum.Data = 0;
+
+		Regions.Init(MemoryBudget / 4 / sizeof(TUnresolvedRegion), TempDirectory);
+
+		PairBuffer.clear();
+		PairBuffer.reserve(GetRunCapacity());
+		RunOffsets.clear();
+		RunsFile.Close();
+		ResultFile.Close();
+	}
+
+	/*!
+		Adds the next samples of the data.
+
+		@param[in] samples	Pointer to the samples.
+		@param[in] count	Number of samples.
+	*/
+	void AddSamples(const float * samples, const size_t count)
+	{
+		for (size_t s = 0; s != count && !Failed; s++)
+		{
+			if (NumberOfSamples >= (size_t)std::numeric_limits<TIndex>::max())
+			{
+				Failed = true; //indices do not fit into TIndex, see P1D_64BIT_INDICES
+				break;
+			}
+
+			TIdxAndData current;
+			current.Idx = (TIndex)NumberOfSamples++;
+			current.Data = samples[s];
+
+			if (current.Idx == 0)
+			{
+				TUnresolvedRegion first;
+				first.Min = current;
+				Failed = !Regions.Push(first);
+			}
+			else if (Rising && current < Previous) //previous vertex is a local maximum - start a new region
+			{
+				TUnresolvedRegion region;
+				region.Max = Previous;
+				region.Min = current;
+				Failed = !Regions.Push(region);
+			}
+			else
+			{
+				//all unresolved maxima smaller than the current vertex can now be paired
+				while (Regions.Size() > 1 && Regions.Top().Max < current && !Failed)
+				{
+					ResolveTopRegion();
+				}
+				if (current < Regions.Top().Min) Regions.Top().Min = current;
+			}
+
+			Rising = (current.Idx > 0 && Previous < current);
+			Previous = current;
+		}
+	}
+
+	/*!
+		Ends the run: pairs all remaining maxima and sorts the pairs.
+		Returns false if no data was added or if temporary files could not be written.
+	*/
+	bool End()
+	{
+		if (NumberOfSamples == 0) Failed = true;
+
+		while (Regions.Size() > 1 && !Failed)
+		{
+			ResolveTopRegion();
+		}
+
+		if (!Failed)
+		{
+			GlobalMinimum = Regions.Top().Min;
+			Regions.Pop();
+			Failed = !SortPairs();
+		}
+
+		if (Failed)
+		{
+			NumberOfPairs = 0;
+			PairBuffer.clear();
+			GlobalMinimum.Idx = -1;
+			GlobalMinimum.Data = 0;
+		}
+		Regions.Init(0, TempDirectory);
+
+		return !Failed;
+	}
+
+	/*!
+		Returns the number of stored pairs.
+	*/
+	size_t GetNumberOfPairs() const
+	{
+		return NumberOfPairs;
+	}
+
+	/*!
+		Returns the number of samples in the data.
+	*/
+	size_t GetNumberOfSamples() const
+	{
+		return NumberOfSamples;
+	}
+
+	/*!
+		Returns the position of the first pair whose persistence is greater than or equal to threshold.
+		Pairs are sorted according to persistence, from least to most persistent.
+
+		@param[in] threshold	Minimum persistence of features.
+	*/
+	size_t FindFirstPair(const float threshold)
+	{
+		if (threshold <= 0 || NumberOfPairs == 0) return 0;
+
+		if (RunOffsets.empty())
+		{
+			TPairedExtrema searchPair;
+			searchPair.Persistence = threshold;
+			searchPair.MaxIndex = 0;
+			searchPair.MinIndex = 0;
+			return (lower_bound(PairBuffer.begin(), PairBuffer.end(), searchPair) - PairBuffer.begin());
+		}
+
+		size_t first = 0, last = NumberOfPairs;
+		while (first < last)
+		{
+			size_t middle = first + (last - first) / 2;
+			TPairedExtrema pair;
+			if (!ResultFile.Read((long long)(middle * sizeof(TPairedExtrema)), &pair, sizeof(TPairedExtrema))) return NumberOfPairs;
+
+			if (pair.Persistence < threshold) first = middle + 1;
+			else last = middle;
+		}
+		return first;
+	}
+
+	/*!
+		Reads a range of stored pairs. Use this to process results in chunks when they do not fit into memory.
+
+		@param[out] pairs			Destination vector, overwritten.
+		@param[in]	first			Position of first pair.
+		@param[in]	count			Maximal number of pairs to read.
+		@param[in]	matlabIndexing	Set this to true to change all indices of features to Matlab's 1-indexing.
+	*/
+	bool ReadPairs(std::vector<TPairedExtrema> & pairs, const size_t first, const size_t count, const bool matlabIndexing = false)
+	{
+		pairs.clear();
+		if (first >= NumberOfPairs) return false;
+
+		size_t n = std::min(count, NumberOfPairs - first);
+		if (RunOffsets.empty())
+		{
+			pairs.assign(PairBuffer.begin() + first, PairBuffer.begin() + first + n);
+		}
+		else
+		{
+			pairs.resize(n);
+			if (!ResultFile.Read((long long)(first * sizeof(TPairedExtrema)), &pairs[0], n * sizeof(TPairedExtrema)))
+			{
+				pairs.clear();
+				return false;
+			}
+		}
+
+		if (matlabIndexing) //match matlab indices by adding one
+		{
+			for (std::vector<TPairedExtrema>::iterator p = pairs.begin(); p != pairs.end(); p++)
+			{
+				(*p).MinIndex += MATLAB_INDEX_FACTOR;
+				(*p).MaxIndex += MATLAB_INDEX_FACTOR;
+			}
+		}
+		return true;
+	}
+
+	/*!
+		Same as Persistence1D::GetPairedExtrema. All matching pairs are read into memory.
+	*/
+	bool GetPairedExtrema(std::vector<TPairedExtrema> & pairs, const float threshold = 0, const bool matlabIndexing = false)
+	{
+		pairs.clear();
+		if (NumberOfPairs == 0 || threshold < 0.0) return false;
+
+		size_t first = FindFirstPair(threshold);
+		return ReadPairs(pairs, first, NumberOfPairs - first, matlabIndexing);
+	}
+
+	/*!
+		Returns the index of the global minimum, or -1 if no data was processed.
+	*/
+	TIndex GetGlobalMinimumIndex(const bool matlabIndexing = false) const
+	{
+		if (GlobalMinimum.Idx == -1) return -1;
+		return GlobalMinimum.Idx + (matlabIndexing ? MATLAB_INDEX_FACTOR : 0);
+	}
+
+	/*!
+		Returns the value of the global minimum, or 0 if no data was processed.
+	*/
+	float GetGlobalMinimumValue() const
+	{
+		return GlobalMinimum.Data;
+	}
+
+protected:
+	/*!
+		Pairs the topmost unresolved maximum.
+		Its left and right regions are merged: the smaller minimum survives, the larger one is paired with the maximum.
+	*/
+	void ResolveTopRegion()
+	{
+		TUnresolvedRegion top = Regions.Top();
+		if (!Regions.Pop())
+		{
+			Failed = true;
+			return;
+		}
+
+		TIdxAndData& survivor = Regions.Top().Min;
+		if (top.Min < survivor)
+		{
+			std::swap(top.Min, survivor);
+		}
+
+		TPairedExtrema pair = MakePairedExtrema(top.Min.Idx, top.Min.Data, top.Max.Idx, top.Max.Data);
+		if (pair.Persistence < MinPersistence) return;
+#ifdef P1D_PAIR_ATTRIBUTES
+		//not available: the basin of a minimum may extend over data which is no longer in memory
+		pair.Width = -1;
+		pair.Area = 0;
+#endif
+
+		if (PairBuffer.size() == GetRunCapacity() && !WriteRun())
+		{
+			Failed = true;
+			return;
+		}
+		PairBuffer.push_back(pair);
+		NumberOfPairs++;
+	}
+
+	///Sorts the pair buffer and writes it to the runs file.
+	bool WriteRun()
+	{
+		if (RunOffsets.empty() && !RunsFile.Open(TempDirectory)) return false;
+
+		std::sort(PairBuffer.begin(), PairBuffer.end());
+
+		size_t offset = RunOffsets.empty() ? 0 : RunOffsets.back();
+		if (!RunsFile.Write((long long)(offset * sizeof(TPairedExtrema)), &PairBuffer[0], PairBuffer.size() * sizeof(TPairedExtrema))) return false;
+
+		RunOffsets.push_back(offset + PairBuffer.size());
+		PairBuffer.clear();
+		return true;
+	}
+
+	/*!
+		Sorts all pairs. If all pairs fit into memory, they are sorted in place.
+		Otherwise, the sorted runs are merged into the result file.
+	*/
+	bool SortPairs()
+	{
+		if (RunOffsets.empty())
+		{
+			std::sort(PairBuffer.begin(), PairBuffer.end());
+			return true;
+		}
+
+		if (!PairBuffer.empty() && !WriteRun()) return false;
+		if (!ResultFile.Open(TempDirectory)) return false;
+
+		//one read buffer per run and one write buffer share the memory of the pair buffer
+		size_t numRuns = RunOffsets.size();
+		size_t blockSize = std::max(GetRunCapacity() / (numRuns + 1), (size_t)OUTOFCORE_MIN_BLOCK_SIZE);
+		std::vector<TPairedExtrema> buffers(blockSize * (numRuns + 1));
+		std::vector<size_t> runPosition(numRuns), runBuffered(numRuns), bufferPosition(numRuns);
+
+		typedef std::pair<TPairedExtrema, size_t> TQueueEntry;
+		std::priority_queue<TQueueEntry, std::vector<TQueueEntry>, TQueueEntryGreater> queue;
+
+		for (size_t r = 0; r != numRuns; r++)
+		{
+			runPosition[r] = (r == 0) ? 0 : RunOffsets[r - 1];
+			if (!FillRunBuffer(r, blockSize, buffers, runPosition, runBuffered, bufferPosition)) return false;
+			queue.push(TQueueEntry(buffers[r * blockSize], r));
+		}
+
+		TPairedExtrema * output = &buffers[numRuns * blockSize];
+		size_t outputSize = 0, written = 0;
+		while (!queue.empty())
+		{
+			size_t r = queue.top().second;
+			output[outputSize++] = queue.top().first;
+			queue.pop();
+
+			if (outputSize == blockSize)
+			{
+				if (!ResultFile.Write((long long)(written * sizeof(TPairedExtrema)), output, outputSize * sizeof(TPairedExtrema))) return false;
+				written += outputSize;
+				outputSize = 0;
+			}
+
+			if (++bufferPosition[r] == runBuffered[r])
+			{
+				size_t runEnd = RunOffsets[r];
+				if (runPosition[r] == runEnd) continue;
+				if (!FillRunBuffer(r, blockSize, buffers, runPosition, runBuffered, bufferPosition)) return false;
+			}
+			queue.push(TQueueEntry(buffers[r * blockSize + bufferPosition[r]], r));
+		}
+
+		if (outputSize > 0 && !ResultFile.Write((long long)(written * sizeof(TPairedExtrema)), output, outputSize * sizeof(TPairedExtrema))) return false;
+
+		RunsFile.Close();
+		return true;
+	}
+
+	///Reads the next block of a sorted run into its buffer.
+	bool FillRunBuffer(const size_t r, const size_t blockSize, std::vector<TPairedExtrema>& buffers,
+		std::vector<size_t>& runPosition, std::vector<size_t>& runBuffered, std::vector<size_t>& bufferPosition)
+	{
+		size_t n = std::min(blockSize, RunOffsets[r] - runPosition[r]);
+		if (!RunsFile.Read((long long)(runPosition[r] * sizeof(TPairedExtrema)), &buffers[r * blockSize], n * sizeof(TPairedExtrema))) return false;
+
+		runPosition[r] += n;
+		runBuffered[r] = n;
+		bufferPosition[r] = 0;
+		return true;
+	}
+
+	struct TQueueEntryGreater
+	{
+		bool operator()(const std::pair<TPairedExtrema, size_t>& a, const std::pair<TPairedExtrema, size_t>& b) const
+		{
+			return (b.first < a.first);
+		}
+	};
+
+	size_t GetRunCapacity() const
+	{
+		return std::max(MemoryBudget / 2 / sizeof(TPairedExtrema), (size_t)OUTOFCORE_MIN_BLOCK_SIZE);
+	}
+
+
+	size_t MemoryBudget;
+	std::string TempDirectory;
+
+	size_t NumberOfSamples;
+	size_t NumberOfPairs;
+	float MinPersistence;
+	bool Failed;				//set when temporary files fail or indices overflow
+
+	TIdxAndData Previous;		//last processed vertex
+	bool Rising;				//true if Previous is larger than the vertex before it
+	TIdxAndData GlobalMinimum;
+
+	/*!
+		Summary of the data processed so far.
+		Maxima are decreasing from bottom to top, the bottom region contains the global minimum.
+	*/
+	TSpillStack Regions;
+
+	/*!
+		Pairs not yet written to disk. If no run was written, holds all sorted results after End().
+	*/
+	std::vector<TPairedExtrema> PairBuffer;
+
+	std::vector<size_t> RunOffsets;		//end position of each sorted run in RunsFile, in pairs
+	TSpillFile RunsFile;
+	TSpillFile ResultFile;				//all sorted pairs, used when pairs did not fit into memory
+};
+}
+#endif
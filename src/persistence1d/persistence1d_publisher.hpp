@@ -0,0 +1,211 @@
+/*! \file persistence1d_publisher.hpp
+    Publication of results to concurrent readers without locks, while new results are computed.
+*/
+
+#ifndef PERSISTENCE_PUBLISHER_H
+#define PERSISTENCE_PUBLISHER_H
+
+#include "persistence1d.hpp"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+namespace p1d
+{
+
+/*!
+	A published result and the number of readers which hold it.
+*/
+struct TPublishedNode
+{
+	PersistenceResult Result;
+	unsigned long long Version;
+	std::atomic<int> Readers;
+
+	TPublishedNode():Version(0),Readers(0)
+	{
+	}
+};
+
+/*!
+	Handle of a result acquired from a ResultPublisher. The result stays valid and unchanged while the handle holds it,
+	even if newer results are published. Handles are cheap to copy and move, and must be released before the publisher is destroyed.
+*/
+class PublishedResult
+{
+public:
+	PublishedResult():Node(NULL)
+	{
+	}
+
+	PublishedResult(const PublishedResult& other):Node(other.Node)
+	{
+		if (Node != NULL) Node->Readers++;
+	}
+
+	PublishedResult(PublishedResult&& other):Node(other.Node)
+	{
+		other.Node = NULL;
+	}
+
+	PublishedResult& operator=(PublishedResult other)
+	{
+		std::swap(Node, other.Node);
+		return *this;
+	}
+
+	~PublishedResult()
+	{
+		Release();
+	}
+
+	///Releases the result. Afterwards, the handle is empty.
+	void Release()
+	{
+		if (Node != NULL) Node->Readers--;
+		Node = NULL;
+	}
+
+	///Returns false if the handle is empty, e.g. if nothing was published yet.
+	bool IsValid() const
+	{
+		return (Node != NULL);
+	}
+
+	///Returns the number of the publication of this result, starting at 1.
+	unsigned long long GetVersion() const
+	{
+		return Node->Version;
+	}
+
+	const PersistenceResult& operator*() const
+	{
+		return Node->Result;
+	}
+
+	const PersistenceResult * operator->() const
+	{
+		return &Node->Result;
+	}
+
+protected:
+	friend class ResultPublisher;
+	TPublishedNode * Node;
+};
+
+/*!
+	Holds the latest result for any number of reader threads, while writer threads compute and publish new results.
+
+	Readers never lock or wait: Acquire takes the current result and counts itself as its reader,
+	then checks that the result is still current - if a new result was published meanwhile, it retries with that one.
+	Writers publish by swapping the current result. Results which were replaced and have no readers are released,
+	and their nodes are reused for later results, so the number of nodes is at most the number of results held by readers plus one.
+	Publish locks a mutex, which only serializes writers.
+
+	Usage:
+	\code
+	ResultPublisher publisher;
+
+	//writer thread
+	Persistence1D p;
+	p.RunPersistence(data);
+	publisher.Publish(p);
+
+	//reader threads
+	PublishedResult result = publisher.Acquire();
+	if (result.IsValid()) result->GetPairedExtrema(pairs, threshold);
+	\endcode
+*/
+class ResultPublisher
+{
+public:
+	ResultPublisher():Current(NULL),Version(0)
+	{
+	}
+
+	/*!
+		Returns a handle of the latest result, or an empty handle if nothing was published yet. Does not lock.
+	*/
+	PublishedResult Acquire() const
+	{
+		PublishedResult handle;
+		TPublishedNode * node = Current.load();
+		while (node != NULL)
+		{
+			//a replaced node may be reused meanwhile, but its result is only read if it is current after counting the reader
+			node->Readers++;
+			TPublishedNode * current = Current.load();
+			if (current == node)
+			{
+				handle.Node = node;
+				break;
+			}
+			node->Readers--;
+			node = current;
+		}
+		return handle;
+	}
+
+	/*!
+		Publishes a result, which replaces the current one for all later calls of Acquire.
+		Returns the version of the published result.
+	*/
+	unsigned long long Publish(PersistenceResult&& result)
+	{
+		std::lock_guard<std::mutex> lock(WriterMutex);
+
+		TPublishedNode * node = GetFreeNode();
+		node->Result = std::move(result);
+		node->Version = ++Version;
+		Current.store(node);
+
+		//release replaced results nobody reads, their nodes stay for reuse
+		for (size_t n = 0; n != Nodes.size(); n++)
+		{
+			if (Nodes[n].get() != node && Nodes[n]->Readers.load() == 0) Nodes[n]->Result = PersistenceResult();
+		}
+		return node->Version;
+	}
+
+	/*!
+		Publishes the results of the last run of p, see Persistence1D::TakeResult.
+	*/
+	unsigned long long Publish(Persistence1D& p)
+	{
+		return Publish(p.TakeResult());
+	}
+
+	///Returns the number of nodes allocated so far.
+	size_t GetNumberOfNodes()
+	{
+		std::lock_guard<std::mutex> lock(WriterMutex);
+		return Nodes.size();
+	}
+
+protected:
+	//not copyable, handles point to the nodes
+	ResultPublisher(const ResultPublisher&);
+	ResultPublisher& operator=(const ResultPublisher&);
+
+	std::atomic<TPublishedNode*> Current;
+	std::vector<std::unique_ptr<TPublishedNode> > Nodes;	//changed by writers only, with WriterMutex held
+	unsigned long long Version;
+	std::mutex WriterMutex;
+
+	/*!
+		Returns a node which is not current and has no readers, or a new node.
+	*/
+	TPublishedNode * GetFreeNode()
+	{
+		TPublishedNode * current = Current.load();
+		for (size_t n = 0; n != Nodes.size(); n++)
+		{
+			if (Nodes[n].get() != current && Nodes[n]->Readers.load() == 0) return Nodes[n].get();
+		}
+		Nodes.push_back(std::unique_ptr<TPublishedNode>(new TPublishedNode()));
+		return Nodes.back().get();
+	}
+};
+}
+#endif
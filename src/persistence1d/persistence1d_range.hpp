@@ -0,0 +1,278 @@
+/*! \file persistence1d_range.hpp
+    Index for paired extrema of any sub-interval of data, without running Persistence1D again.
+*/
+
+#ifndef PERSISTENCE_RANGE_H
+#define PERSISTENCE_RANGE_H
+
+#include "persistence1d.hpp"
+
+//Number of data values per block of the range minimum structure
+#define RANGE_BLOCK_SIZE 32
+
+namespace p1d
+{
+
+/*!
+	Finds the paired extrema of data restricted to an interval [first, last].
+	Results are identical to running Persistence1D on the interval alone.
+
+	The maxima of the interval are the local maxima of all data strictly inside it.
+	A maximum is paired with the larger of two minima: the smallest vertex between it and the nearest larger vertex on its left,
+	and the smallest vertex between it and the nearest larger vertex on its right - both restricted to the interval.
+	This is the component merge of Watershed, without running it.
+
+	Build stores the nearest larger vertices of each local maximum, and a structure for range minimum queries:
+	a sparse table over the minima of blocks of RANGE_BLOCK_SIZE values.
+	A query takes two range minimum queries per local maximum inside the interval, plus sorting the pairs, 
+	so its time depends on the number of local maxima in the interval, not on its length (apart from a binary search).
+	Pairs below the threshold are computed and then dropped, so a high threshold does not make a query faster.
+
+	Memory is about 4 bytes per data value (a copy of the data), plus 12 bytes per local maximum,
+	plus 4*log2(n/RANGE_BLOCK_SIZE)/RANGE_BLOCK_SIZE bytes per data value for the sparse table.
+	With P1D_PAIR_ATTRIBUTES, prefix sums of the data take another 8 bytes per data value.
+*/
+class Persistence1DRangeIndex
+{
+public:
+	/*!
+		Builds the index. Takes linear time.
+
+		@param[in] InputData	Vector of data, ordered according to its axis.
+	*/
+	bool Build(const std::vector<float>& InputData)
+	{
+		return Build(InputData.empty() ? NULL : &InputData[0], InputData.size());
+	}
+
+	/*!
+		Same as Build with a data vector, for data in a buffer. The buffer is copied.
+	*/
+	bool Build(const float * InputData, const size_t size)
+	{
+		Data.assign(InputData, InputData + size);
+		Maxima.clear();
+		LeftBlocker.clear();
+		RightBlocker.clear();
+		BlockMinima.clear();
+
+		if (Data.empty()) return false;
+
+#ifdef P1D_PAIR_ATTRIBUTES
+		PrefixSums.assign(1, 0.0);
+		PrefixSums.reserve(Data.size() + 1);
+		for (size_t i = 0; i != Data.size(); i++)
+		{
+			PrefixSums.push_back(PrefixSums.back() + Data[i]);
+		}
+#endif
+
+		FindMaxima();
+		BuildRangeMinimum();
+		return true;
+	}
+
+	///Returns the number of data values of the index.
+	size_t GetNumberOfSamples() const
+	{
+		return Data.size();
+	}
+
+	/*!
+		Returns the paired extrema of the data values first to last (inclusive),
+		sorted according to persistence, as Persistence1D::GetPairedExtrema.
+		Indices are indices of the whole data, not of the interval.
+
+		@param[in]	first, last		Interval, 0 <= first <= last < GetNumberOfSamples().
+		@param[out]	pairs			Paired extrema.
+		@param[in]	threshold		Minimal persistence of returned pairs.
+		@param[in]	matlabIndexing	Set this to true to change all indices to Matlab's 1-indexing.
+	*/
+	bool GetPairedExtrema(const TIndex first, const TIndex last, std::vector<TPairedExtrema>& pairs,
+						  const float threshold = 0, const bool matlabIndexing = false) const
+	{
+		pairs.clear();
+		if (!IsValidInterval(first, last) || threshold < 0) return false;
+
+		//maxima strictly inside the interval
+		std::vector<TIndex>::const_iterator begin = std::upper_bound(Maxima.begin(), Maxima.end(), first);
+		std::vector<TIndex>::const_iterator end = std::lower_bound(begin, Maxima.end(), last);
+
+		for (std::vector<TIndex>::const_iterator max = begin; max != end; max++)
+		{
+			const size_t m = max - Maxima.begin();
+			const TIndex leftEdge = std::max(LeftBlocker[m] + 1, first);
+			const TIndex rightEdge = std::min(RightBlocker[m] - 1, last);
+			TIndex leftMin = GetMinimumIndex(leftEdge, *max - 1);
+			TIndex rightMin = GetMinimumIndex(*max + 1, rightEdge);
+
+			//the component with the larger minimum is destroyed
+			const bool destroyLeft = IsLess(rightMin, leftMin);
+			TIndex destroyed = destroyLeft ? leftMin : rightMin;
+
+			TPairedExtrema pair = MakePairedExtrema(destroyed, Data[destroyed], *max, Data[*max]);
+			if (pair.Persistence < threshold) continue;
+
+#ifdef P1D_PAIR_ATTRIBUTES
+			pair.Width = destroyLeft ? *max - leftEdge : rightEdge - *max;
+			pair.Area = destroyLeft ? PrefixSums[*max] - PrefixSums[leftEdge] : PrefixSums[rightEdge + 1] - PrefixSums[*max + 1];
+#endif
+
+			if (matlabIndexing)
+			{
+				pair.MinIndex += MATLAB_INDEX_FACTOR;
+				pair.MaxIndex += MATLAB_INDEX_FACTOR;
+			}
+			pairs.push_back(pair);
+		}
+
+		std::sort(pairs.begin(), pairs.end());
+		return !pairs.empty();
+	}
+
+	/*!
+		Returns the index of the global minimum of the interval, or -1 for an invalid interval.
+	*/
+	TIndex GetGlobalMinimumIndex(const TIndex first, const TIndex last, const bool matlabIndexing = false) const
+	{
+		if (!IsValidInterval(first, last)) return -1;
+		return GetMinimumIndex(first, last) + (matlabIndexing ? MATLAB_INDEX_FACTOR : 0);
+	}
+
+	/*!
+		Returns the value of the global minimum of the interval, or 0 for an invalid interval.
+	*/
+	float GetGlobalMinimumValue(const TIndex first, const TIndex last) const
+	{
+		if (!IsValidInterval(first, last)) return 0;
+		return Data[GetMinimumIndex(first, last)];
+	}
+
+protected:
+	std::vector<float> Data;
+
+	///Local maxima of all data, sorted according to their indices.
+	std::vector<TIndex> Maxima;
+
+	///Index of nearest larger vertex left of each maximum, or -1.
+	std::vector<TIndex> LeftBlocker;
+
+	///Index of nearest larger vertex right of each maximum, or the size of data.
+	std::vector<TIndex> RightBlocker;
+
+	///BlockMinima[level][block] is the index of the smallest vertex in blocks block to block + 2^level - 1.
+	std::vector<std::vector<TIndex> > BlockMinima;
+
+#ifdef P1D_PAIR_ATTRIBUTES
+	///PrefixSums[i] is the sum of the first i data values.
+	std::vector<double> PrefixSums;
+#endif
+
+	bool IsValidInterval(const TIndex first, const TIndex last) const
+	{
+		return (first >= 0 && first <= last && last < (TIndex)Data.size());
+	}
+
+	///Compares vertices by values, and by indices if values are equal - like TIdxAndData.
+	bool IsLess(const TIndex first, const TIndex second) const
+	{
+		if (Data[first] < Data[second]) return true;
+		if (Data[first] > Data[second]) return false;
+		return (first < second);
+	}
+
+	TIndex GetSmaller(const TIndex first, const TIndex second) const
+	{
+		return IsLess(first, second) ? first : second;
+	}
+
+	/*!
+		Finds inner vertices which are larger than both neighbors, and the nearest larger vertex on each side,
+		with a stack of vertices whose values decrease.
+	*/
+	void FindMaxima()
+	{
+		const TIndex size = (TIndex)Data.size();
+		std::vector<TIndex> stack;
+
+		for (TIndex i = 1; i + 1 < size; i++)
+		{
+			if (IsLess(i - 1, i) && IsLess(i + 1, i)) Maxima.push_back(i);
+		}
+		LeftBlocker.resize(Maxima.size());
+		RightBlocker.resize(Maxima.size());
+
+		size_t m = 0;
+		for (TIndex i = 0; i < size; i++)
+		{
+			while (!stack.empty() && IsLess(stack.back(), i)) stack.pop_back();
+			if (m < Maxima.size() && Maxima[m] == i) LeftBlocker[m++] = stack.empty() ? -1 : stack.back();
+			stack.push_back(i);
+		}
+
+		stack.clear();
+		m = Maxima.size();
+		for (TIndex i = size - 1; i >= 0; i--)
+		{
+			while (!stack.empty() && IsLess(stack.back(), i)) stack.pop_back();
+			if (m > 0 && Maxima[m-1] == i) RightBlocker[--m] = stack.empty() ? size : stack.back();
+			stack.push_back(i);
+		}
+	}
+
+	void BuildRangeMinimum()
+	{
+		const TIndex size = (TIndex)Data.size();
+		const TIndex numBlocks = (size + RANGE_BLOCK_SIZE - 1) / RANGE_BLOCK_SIZE;
+
+		BlockMinima.push_back(std::vector<TIndex>(numBlocks));
+		for (TIndex b = 0; b < numBlocks; b++)
+		{
+			TIndex first = b * RANGE_BLOCK_SIZE;
+			BlockMinima[0][b] = GetMinimumIndexInBlock(first, std::min(first + RANGE_BLOCK_SIZE, size) - 1);
+		}
+
+		for (TIndex width = 2; width <= numBlocks; width *= 2)
+		{
+			const std::vector<TIndex>& previous = BlockMinima.back();
+			std::vector<TIndex> level(numBlocks - width + 1);
+			for (TIndex b = 0; b + width <= numBlocks; b++)
+			{
+				level[b] = GetSmaller(previous[b], previous[b + width/2]);
+			}
+			BlockMinima.push_back(level);
+		}
+	}
+
+	TIndex GetMinimumIndexInBlock(const TIndex first, const TIndex last) const
+	{
+		TIndex min = first;
+		for (TIndex i = first + 1; i <= last; i++)
+		{
+			if (IsLess(i, min)) min = i;
+		}
+		return min;
+	}
+
+	/*!
+		Returns the index of the smallest vertex in [first, last].
+	*/
+	TIndex GetMinimumIndex(const TIndex first, const TIndex last) const
+	{
+		const TIndex firstBlock = first / RANGE_BLOCK_SIZE, lastBlock = last / RANGE_BLOCK_SIZE;
+		if (lastBlock - firstBlock < 2) return GetMinimumIndexInBlock(first, last);
+
+		//partial blocks at both ends, and two overlapping ranges of whole blocks in between
+		TIndex min = GetSmaller(GetMinimumIndexInBlock(first, (firstBlock + 1) * RANGE_BLOCK_SIZE - 1),
+								GetMinimumIndexInBlock(lastBlock * RANGE_BLOCK_SIZE, last));
+
+		const TIndex numBlocks = lastBlock - firstBlock - 1;
+		int level = 0;
+		while (((TIndex)2 << level) <= numBlocks) level++;
+
+		min = GetSmaller(min, BlockMinima[level][firstBlock + 1]);
+		return GetSmaller(min, BlockMinima[level][lastBlock - ((TIndex)1 << level)]);
+	}
+};
+}
+#endif
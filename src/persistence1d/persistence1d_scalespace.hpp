@@ -0,0 +1,366 @@
+/*! \file persistence1d_scalespace.hpp
+    Persistence of data smoothed at many scales, computed in parallel, with correspondences of extrema across scales.
+*/
+
+#ifndef PERSISTENCE_SCALESPACE_H
+#define PERSISTENCE_SCALESPACE_H
+
+#include "persistence1d.hpp"
+
+#include <atomic>
+#include <exception>
+#include <thread>
+
+//Number of output values smoothed together, so their input stays in the cache for all kernel taps
+#define SCALESPACE_BLOCK_SIZE 2048
+//Gaussian kernels are truncated at this many standard deviations
+#define SCALESPACE_KERNEL_TRUNCATE 4
+//Largest standard deviation, which keeps kernels below about 50 MB
+#define SCALESPACE_MAX_SIGMA 1048576
+
+namespace p1d
+{
+
+/*!
+	Results of Persistence1D for a single scale.
+*/
+struct TScaleResult
+{
+	///Standard deviation of the Gaussian the data was smoothed with.
+	float Sigma;
+
+	///Paired extrema, sorted as in Persistence1D::GetPairedExtrema.
+	std::vector<TPairedExtrema> PairedExtrema;
+
+	TIndex GlobalMinIndex;
+	float GlobalMinValue;
+};
+
+/*!
+	An extremum of one scale and the nearest extremum of the same kind in the previous scale.
+*/
+struct TExtremumMatch
+{
+	///Index of the extremum.
+	TIndex Index;
+
+	///Index of the nearest extremum of the same kind in the previous scale, or -1 if there is none within the maximal distance.
+	TIndex PreviousIndex;
+
+	bool IsMaximum;
+};
+
+/*!
+	Runs Persistence1D on data smoothed with Gaussians of many standard deviations (scales).
+
+	Scales are smoothed and processed concurrently, one scale per thread at a time.
+	Each thread has its own workspace - a buffer for smoothed data and a Persistence1D object -
+	which is reused for all scales it processes, so memory is allocated only for the first one.
+
+	If smoothing or persistence fails in a thread, e.g. with std::bad_alloc, the other threads stop after their current scale,
+	and Run throws the exception to the caller, with no results.
+
+	Smoothing is a convolution with a truncated, normalized Gaussian kernel, replicating the boundary values.
+	It runs over blocks of SCALESPACE_BLOCK_SIZE values, applying all kernel taps to a block before moving on.
+	Results of each scale are identical to running Persistence1D on the output of Smooth.
+
+	Usage:
+	\code
+	PersistenceScaleSpace scaleSpace;
+	scaleSpace.Run(data, sigmas);
+	for (size_t s = 0; s < scaleSpace.GetNumberOfScales(); s++)
+	{
+		scaleSpace.GetPairedExtrema(s, pairs);
+		scaleSpace.GetCorrespondences(s, matches);	//extrema of scale s and their nearest extrema in scale s-1
+	}
+	\endcode
+*/
+class PersistenceScaleSpace
+{
+public:
+	/*!
+		Smooths data at all scales and runs persistence on each of them.
+
+		@param[in] InputData		Vector of data, ordered according to its axis.
+		@param[in] sigmas			Standard deviations of the Gaussians, in data values, usually increasing. A sigma of 0 keeps the data as it is.
+									Fails if a sigma is negative, not finite or larger than SCALESPACE_MAX_SIGMA.
+		@param[in] minPersistence	Minimal persistence of stored pairs, see Persistence1D::RunPersistence.
+		@param[in] numThreads		Number of threads. If 0, one per hardware thread, at most one per scale.
+	*/
+	bool Run(const std::vector<float>& InputData, const std::vector<float>& sigmas, const float minPersistence = 0, unsigned int numThreads = 0)
+	{
+		return Run(InputData.empty() ? NULL : &InputData[0], InputData.size(), sigmas, minPersistence, numThreads);
+	}
+
+	/*!
+		Same as Run with a data vector, for data in a buffer. The buffer is not copied.
+	*/
+	bool Run(const float * InputData, const size_t size, const std::vector<float>& sigmas, const float minPersistence = 0, unsigned int numThreads = 0)
+	{
+		Results.clear();
+		if (size == 0 || sigmas.empty()) return false;
+		for (size_t s = 0; s != sigmas.size(); s++)
+		{
+			if (!IsValidSigma(sigmas[s])) return false;
+		}
+
+		Results.resize(sigmas.size());
+
+		if (numThreads == 0) numThreads = std::thread::hardware_concurrency();
+		if (numThreads == 0) numThreads = 1;
+		if (numThreads > sigmas.size()) numThreads = (unsigned int)sigmas.size();
+
+		//larger scales take longer to smooth, so threads take the next scale when done instead of fixed ranges
+		std::atomic<size_t> next(0);
+		std::vector<std::exception_ptr> errors(numThreads);
+		std::vector<std::thread> threads;
+		for (unsigned int t = 0; t < numThreads; t++)
+		{
+			threads.push_back(std::thread([&, t]()
+			{
+				try
+				{
+					std::vector<float> smoothed(size);
+					Persistence1D p;
+					for (size_t s = next++; s < sigmas.size(); s = next++)
+					{
+						Smooth(InputData, size, sigmas[s], &smoothed[0]);
+						p.RunPersistence(&smoothed[0], size, minPersistence);
+
+						TScaleResult& result = Results[s];
+						result.Sigma = sigmas[s];
+						p.GetPairedExtrema(result.PairedExtrema);
+						result.GlobalMinIndex = p.GetGlobalMinimumIndex();
+						result.GlobalMinValue = p.GetGlobalMinimumValue();
+					}
+				}
+				catch (...)
+				{
+					//an exception must not leave the thread, so it is thrown again by Run
+					errors[t] = std::current_exception();
+					next = sigmas.size();
+				}
+			}));
+		}
+		for (size_t t = 0; t < threads.size(); t++)
+		{
+			threads[t].join();
+		}
+		for (size_t t = 0; t < errors.size(); t++)
+		{
+			if (errors[t])
+			{
+				Results.clear();
+				std::rethrow_exception(errors[t]);
+			}
+		}
+		return true;
+	}
+
+	size_t GetNumberOfScales() const
+	{
+		return Results.size();
+	}
+
+	///Returns all results of a scale.
+	const TScaleResult& GetScale(const size_t scale) const
+	{
+		return Results[scale];
+	}
+
+	/*!
+		Same as Persistence1D::GetPairedExtrema, for a scale.
+	*/
+	bool GetPairedExtrema(const size_t scale, std::vector<TPairedExtrema> & pairs, const float threshold = 0, const bool matlabIndexing = false) const
+	{
+		pairs.clear();
+		if (scale >= Results.size() || Results[scale].PairedExtrema.empty() || threshold < 0.0) return false;
+
+		const std::vector<TPairedExtrema>& all = Results[scale].PairedExtrema;
+		TPairedExtrema searchPair;
+		searchPair.Persistence = threshold;
+		searchPair.MaxIndex = 0;
+		searchPair.MinIndex = 0;
+		std::vector<TPairedExtrema>::const_iterator first = (threshold == 0) ? all.begin() : std::lower_bound(all.begin(), all.end(), searchPair);
+		if (first == all.end()) return false;
+
+		pairs.assign(first, all.end());
+		if (matlabIndexing)
+		{
+			for (std::vector<TPairedExtrema>::iterator p = pairs.begin(); p != pairs.end(); p++)
+			{
+				(*p).MinIndex += MATLAB_INDEX_FACTOR;
+				(*p).MaxIndex += MATLAB_INDEX_FACTOR;
+			}
+		}
+		return true;
+	}
+
+	///Same as Persistence1D::GetGlobalMinimumIndex, for a scale.
+	TIndex GetGlobalMinimumIndex(const size_t scale, const bool matlabIndexing = false) const
+	{
+		if (scale >= Results.size()) return -1;
+		return Results[scale].GlobalMinIndex + (matlabIndexing ? MATLAB_INDEX_FACTOR : 0);
+	}
+
+	///Same as Persistence1D::GetGlobalMinimumValue, for a scale.
+	float GetGlobalMinimumValue(const size_t scale) const
+	{
+		if (scale >= Results.size()) return 0;
+		return Results[scale].GlobalMinValue;
+	}
+
+	/*!
+		Matches each extremum of a scale - paired minima and maxima, and the global minimum - to the nearest extremum
+		of the same kind in the previous scale. Extrema at equal distances on both sides are matched to the left one.
+		Matches are sorted by index, minima and maxima interleaved.
+
+		@param[in]	scale		Scale, at least 1.
+		@param[out]	matches		Extrema of the scale and their matches.
+		@param[in]	maxDistance	Maximal distance between matched extrema. If negative, extrema are matched at any distance.
+	*/
+	bool GetCorrespondences(const size_t scale, std::vector<TExtremumMatch>& matches, const TIndex maxDistance = -1) const
+	{
+		matches.clear();
+		if (scale == 0 || scale >= Results.size()) return false;
+
+		std::vector<TIndex> minima, maxima, previousMinima, previousMaxima;
+		GetExtrema(Results[scale], minima, maxima);
+		GetExtrema(Results[scale - 1], previousMinima, previousMaxima);
+
+		matches.reserve(minima.size() + maxima.size());
+		for (size_t i = 0; i != minima.size(); i++)
+		{
+			matches.push_back(Match(minima[i], previousMinima, maxDistance, false));
+		}
+		for (size_t i = 0; i != maxima.size(); i++)
+		{
+			matches.push_back(Match(maxima[i], previousMaxima, maxDistance, true));
+		}
+		std::inplace_merge(matches.begin(), matches.begin() + minima.size(), matches.end(), IndexLess);
+		return true;
+	}
+
+	/*!
+		Smooths data with a Gaussian, replicating the values at the boundaries.
+
+		@param[in]	input	Pointer to data.
+		@param[in]	size	Number of data values.
+		@param[in]	sigma	Standard deviation of the Gaussian. If 0, data is copied. 
+							Fails if it is negative, not finite or larger than SCALESPACE_MAX_SIGMA.
+		@param[out]	output	Pointer to size values for the smoothed data. Must not overlap input.
+	*/
+	static bool Smooth(const float * input, const size_t size, const float sigma, float * output)
+	{
+		if (!IsValidSigma(sigma)) return false;
+
+		std::vector<float> kernel;
+		CreateKernel(sigma, kernel);
+		const size_t radius = kernel.size() - 1;
+
+		for (size_t first = 0; first < size; first += SCALESPACE_BLOCK_SIZE)
+		{
+			const size_t last = std::min(first + SCALESPACE_BLOCK_SIZE, size);
+			for (size_t i = first; i != last; i++)
+			{
+				output[i] = kernel[0] * input[i];
+			}
+
+			for (size_t k = 1; k <= radius; k++)
+			{
+				const float weight = kernel[k];
+
+				//values whose taps are all inside the data need no clamping
+				const size_t innerFirst = std::min(std::max(first, k), last);
+				const size_t innerLast = std::max(std::min(last, (size > k) ? size - k : 0), innerFirst);
+
+				for (size_t i = first; i != innerFirst; i++)
+				{
+					output[i] += weight * (input[(i > k) ? i - k : 0] + input[std::min(i + k, size - 1)]);
+				}
+				for (size_t i = innerFirst; i != innerLast; i++)
+				{
+					output[i] += weight * (input[i - k] + input[i + k]);
+				}
+				for (size_t i = innerLast; i != last; i++)
+				{
+					output[i] += weight * (input[(i > k) ? i - k : 0] + input[std::min(i + k, size - 1)]);
+				}
+			}
+		}
+		return true;
+	}
+
+protected:
+	std::vector<TScaleResult> Results;
+
+	///Returns false for sigmas which are negative, not finite (including NaN) or larger than SCALESPACE_MAX_SIGMA.
+	static bool IsValidSigma(const float sigma)
+	{
+		return (sigma >= 0 && sigma <= SCALESPACE_MAX_SIGMA);
+	}
+
+	/*!
+		Creates the right half of a normalized Gaussian kernel, starting at its center.
+	*/
+	static void CreateKernel(const float sigma, std::vector<float>& kernel)
+	{
+		const size_t radius = (size_t)ceil(SCALESPACE_KERNEL_TRUNCATE * sigma);
+		kernel.assign(radius + 1, 1.0f);
+		if (radius == 0) return;
+
+		double sum = 1;
+		std::vector<double> weights(radius + 1, 1.0);
+		for (size_t k = 1; k <= radius; k++)
+		{
+			weights[k] = exp(-0.5 * (double)(k * k) / ((double)sigma * sigma));
+			sum += 2 * weights[k];
+		}
+		for (size_t k = 0; k <= radius; k++)
+		{
+			kernel[k] = (float)(weights[k] / sum);
+		}
+	}
+
+	/*!
+		Returns the indices of all minima and maxima of a scale, sorted.
+	*/
+	static void GetExtrema(const TScaleResult& result, std::vector<TIndex>& minima, std::vector<TIndex>& maxima)
+	{
+		minima.clear();
+		maxima.clear();
+		for (std::vector<TPairedExtrema>::const_iterator p = result.PairedExtrema.begin(); p != result.PairedExtrema.end(); p++)
+		{
+			minima.push_back((*p).MinIndex);
+			maxima.push_back((*p).MaxIndex);
+		}
+		if (result.GlobalMinIndex != -1) minima.push_back(result.GlobalMinIndex);
+
+		std::sort(minima.begin(), minima.end());
+		std::sort(maxima.begin(), maxima.end());
+	}
+
+	static TExtremumMatch Match(const TIndex index, const std::vector<TIndex>& previous, const TIndex maxDistance, const bool isMaximum)
+	{
+		TExtremumMatch match;
+		match.Index = index;
+		match.PreviousIndex = -1;
+		match.IsMaximum = isMaximum;
+
+		std::vector<TIndex>::const_iterator right = std::lower_bound(previous.begin(), previous.end(), index);
+		TIndex nearest = -1;
+		if (right != previous.end()) nearest = *right;
+		if (right != previous.begin() && (nearest == -1 || index - *(right - 1) <= nearest - index)) nearest = *(right - 1);
+
+		const TIndex distance = (nearest > index) ? nearest - index : index - nearest;
+		if (nearest != -1 && (maxDistance < 0 || distance <= maxDistance)) match.PreviousIndex = nearest;
+		return match;
+	}
+
+	static bool IndexLess(const TExtremumMatch& first, const TExtremumMatch& second)
+	{
+		return (first.Index < second.Index);
+	}
+};
+}
+#endif
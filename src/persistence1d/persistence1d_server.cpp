@@ -0,0 +1,352 @@
+/*! \file persistence1d_server.cpp
+    Server mode of persistence1d_driver, see persistence1d_server.hpp for the protocol.
+*/
+
+#include "persistence1d_server.hpp"
+
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+
+#ifndef _WIN32
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace p1d
+{
+
+#ifndef _WIN32
+
+/*!
+	Reads exactly size bytes from a socket. Returns false if the connection was closed or failed.
+*/
+static bool ReadExactly(const int socket, void * buffer, size_t size)
+{
+	char * bytes = (char *)buffer;
+	while (size > 0)
+	{
+		ssize_t count = read(socket, bytes, size);
+		if (count <= 0) return false;
+		bytes += count;
+		size -= (size_t)count;
+	}
+	return true;
+}
+
+/*!
+	Writes exactly size bytes to a socket. Returns false if the connection was closed or failed.
+*/
+static bool WriteExactly(const int socket, const void * buffer, size_t size)
+{
+	const char * bytes = (const char *)buffer;
+	while (size > 0)
+	{
+		ssize_t count = write(socket, bytes, size);
+		if (count <= 0) return false;
+		bytes += count;
+		size -= (size_t)count;
+	}
+	return true;
+}
+
+/*!
+	Appends a value to a response buffer.
+*/
+template <class T>
+static void Append(string& buffer, const T value)
+{
+	buffer.append((const char *)&value, sizeof(value));
+}
+
+static bool WriteError(const int socket, const string& message)
+{
+	string response;
+	Append(response, (unsigned int)SERVER_STATUS_ERROR);
+	Append(response, (unsigned int)0);
+	Append(response, (unsigned long long)message.size());
+	Append(response, (long long)-1);
+	Append(response, (float)0);
+	response += message;
+	return WriteExactly(socket, response.data(), response.size());
+}
+
+/*!
+	Parses float values from the contents of a data text file, one value per line,
+	stopping at the first value which cannot be read.
+
+	As for the stream input of persistence1d_driver, only decimal numbers are read:
+	nan, inf, hexadecimal numbers and values which overflow a float stop the parsing, although strtof accepts them.
+*/
+static void ParseData(const string& contents, vector<float>& data)
+{
+	const char * current = contents.c_str();
+	for (;;)
+	{
+		char * end;
+		float value = strtof(current, &end);
+		if (end == current || !(fabs(value) <= numeric_limits<float>::max())) break;
+
+		const char * digit = current;
+		while (isspace((unsigned char)*digit)) digit++;
+		if (strspn(digit, "0123456789+-.eE") < (size_t)(end - digit)) break;
+
+		data.push_back(value);
+		current = end;
+	}
+}
+
+/*!
+	Reads all requests from one connection and answers them, until the client closes the connection.
+*/
+static void ServeRequests(const int socket, ResultCache& cache)
+{
+	for (;;)
+	{
+		unsigned int magic, flags;
+		float threshold;
+		unsigned long long payloadSize;
+
+		if (!ReadExactly(socket, &magic, sizeof(magic)) ||
+			!ReadExactly(socket, &flags, sizeof(flags)) ||
+			!ReadExactly(socket, &threshold, sizeof(threshold)) ||
+			!ReadExactly(socket, &payloadSize, sizeof(payloadSize))) break;
+
+		if (magic != SERVER_REQUEST_MAGIC)
+		{
+			WriteError(socket, "Invalid request.");
+			break;
+		}
+
+		//the payload is not read, so the connection cannot be used for further requests
+		if (payloadSize > SERVER_MAX_PAYLOAD_SIZE)
+		{
+			WriteError(socket, "Request is too large.");
+			break;
+		}
+
+		string payload((size_t)payloadSize, '\0');
+		if (payloadSize > 0 && !ReadExactly(socket, &payload[0], payload.size())) break;
+
+		const bool isPath = (flags & SERVER_FLAG_PATH) != 0;
+		if (threshold < 0 || (!isPath && payload.size() % sizeof(float) != 0))
+		{
+			if (!WriteError(socket, "Invalid threshold or data size.")) break;
+			continue;
+		}
+
+		//for paths, the contents of the file are digested - the file may have changed since the last request
+		string contents;
+		if (isPath)
+		{
+			ifstream file(payload.c_str(), ifstream::in | ifstream::binary | ifstream::ate);
+			if (!file)
+			{
+				if (!WriteError(socket, "Cannot open file " + payload)) break;
+				continue;
+			}
+			if ((unsigned long long)file.tellg() > SERVER_MAX_PAYLOAD_SIZE)
+			{
+				if (!WriteError(socket, "File is too large: " + payload)) break;
+				continue;
+			}
+			file.seekg(0);
+			contents.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+		}
+		const string& digested = isPath ? contents : payload;
+
+		TCacheKey key;
+		DigestBytes(digested.data(), digested.size(), key.Digest);
+		key.Size = digested.size();
+		key.IsPath = isPath;
+
+		shared_ptr<const PersistenceResult> results = cache.Find(key);
+		const bool cached = (results.get() != NULL);
+		if (!cached)
+		{
+			Persistence1D p;
+			if (isPath)
+			{
+				vector<float> data;
+				ParseData(contents, data);
+				p.RunPersistence(data);
+			}
+			else
+			{
+				p.RunPersistence((const float *)payload.data(), payload.size() / sizeof(float));
+			}
+			results = make_shared<const PersistenceResult>(p.TakeResult());
+			cache.Add(key, results);
+		}
+
+		const bool matlabIndexing = (flags & SERVER_FLAG_MATLAB) != 0;
+		vector<TPairedExtrema> pairs;
+		results->GetPairedExtrema(pairs, threshold, matlabIndexing);
+
+		string response;
+		response.reserve(32 + pairs.size() * 20);
+		Append(response, (unsigned int)SERVER_STATUS_OK);
+		Append(response, (unsigned int)(cached ? 1 : 0));
+		Append(response, (unsigned long long)pairs.size());
+		Append(response, (long long)results->GetGlobalMinimumIndex(matlabIndexing));
+		Append(response, results->GetGlobalMinimumValue());
+		for (vector<TPairedExtrema>::const_iterator it = pairs.begin(); it != pairs.end(); it++)
+		{
+			Append(response, (long long)(*it).MinIndex);
+			Append(response, (long long)(*it).MaxIndex);
+			Append(response, (*it).Persistence);
+		}
+		if (!WriteExactly(socket, response.data(), response.size())) break;
+	}
+}
+
+/*!
+	Number of connections being served, which RunServer keeps at most SERVER_MAX_CONNECTIONS.
+*/
+struct TConnectionCount
+{
+	mutex Mutex;
+	condition_variable Changed;
+	size_t Active;
+};
+
+/*!
+	Marks a connection as closed. Notifies under the lock, since RunServer may destroy count once no connections are left.
+*/
+static void ReleaseConnection(TConnectionCount& count)
+{
+	lock_guard<mutex> lock(count.Mutex);
+	count.Active--;
+	count.Changed.notify_all();
+}
+
+/*!
+	Entry point of a connection thread. An exception would terminate the whole server,
+	so it is reported to the client instead, and the connection is closed.
+*/
+static void ServeConnection(const int socket, ResultCache& cache, TConnectionCount& count)
+{
+	try
+	{
+		ServeRequests(socket, cache);
+	}
+	catch (const exception& e)
+	{
+		WriteError(socket, string("Server error: ") + e.what());
+	}
+	catch (...)
+	{
+		WriteError(socket, "Server error.");
+	}
+
+	close(socket);
+	ReleaseConnection(count);
+}
+
+bool RunServer(const char * socketPath, const size_t cacheSize)
+{
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (strlen(socketPath) >= sizeof(address.sun_path))
+	{
+		cout << "Socket path is too long: " << socketPath << endl;
+		return false;
+	}
+	strcpy(address.sun_path, socketPath);
+
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0)
+	{
+		cout << "Cannot create socket." << endl;
+		return false;
+	}
+
+	//a client which closes its connection early should not kill the server
+	signal(SIGPIPE, SIG_IGN);
+
+	unlink(socketPath);
+	if (bind(listener, (sockaddr *)&address, sizeof(address)) != 0 || listen(listener, SOMAXCONN) != 0)
+	{
+		cout << "Cannot listen on " << socketPath << endl;
+		close(listener);
+		return false;
+	}
+
+	ResultCache cache(cacheSize);
+	TConnectionCount count;
+	count.Active = 0;
+	cout << "Listening on " << socketPath << endl;
+
+	for (;;)
+	{
+		{
+			unique_lock<mutex> lock(count.Mutex);
+			while (count.Active >= SERVER_MAX_CONNECTIONS) count.Changed.wait(lock);
+		}
+
+		int connection = accept(listener, NULL, NULL);
+		if (connection < 0)
+		{
+			//the client gave up before it was accepted, or a signal interrupted the call
+			if (errno == EINTR || errno == ECONNABORTED || errno == EPROTO) continue;
+
+			//out of descriptors or memory - retry later, when connections may have been closed
+			if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM)
+			{
+				this_thread::sleep_for(chrono::milliseconds(SERVER_ACCEPT_RETRY_DELAY));
+				continue;
+			}
+
+			cout << "Cannot accept connections on " << socketPath << ": " << strerror(errno) << endl;
+			break;
+		}
+
+		{
+			lock_guard<mutex> lock(count.Mutex);
+			count.Active++;
+		}
+		try
+		{
+			thread(ServeConnection, connection, ref(cache), ref(count)).detach();
+		}
+		catch (const system_error&)
+		{
+			close(connection);
+			ReleaseConnection(count);
+			this_thread::sleep_for(chrono::milliseconds(SERVER_ACCEPT_RETRY_DELAY));
+		}
+	}
+
+	//connection threads use the cache and the count, so they have to finish first
+	close(listener);
+	unique_lock<mutex> lock(count.Mutex);
+	while (count.Active > 0) count.Changed.wait(lock);
+	return false;
+}
+
+#else
+
+bool RunServer(const char * socketPath, const size_t cacheSize)
+{
+	cout << "Server mode is not supported on Windows." << endl;
+	return false;
+}
+
+#endif
+}
@@ -0,0 +1,258 @@
+/*! \file persistence1d_server.hpp
+    Server mode of persistence1d_driver: protocol and result cache.
+
+	The server listens on a Unix domain socket and answers requests until it is killed.
+	Each connection is served by its own thread, and may send any number of requests.
+	All values are in the native byte order of the machine, since clients run on the same machine.
+
+	Request:
+	- uint32	Magic number SERVER_REQUEST_MAGIC
+	- uint32	Flags: SERVER_FLAG_MATLAB for Matlab indexing, SERVER_FLAG_PATH if the payload is a file path
+	- float		Threshold
+	- uint64	Size of payload in bytes
+	- Payload	Either a path of a data text file (as for persistence1d_driver, no terminating 0), or float values
+
+	Response:
+	- uint32	Status: SERVER_STATUS_OK or SERVER_STATUS_ERROR
+	- uint32	1 if results were found in the cache, 0 otherwise
+	- uint64	Number of pairs, or the length of an error message if status is SERVER_STATUS_ERROR
+	- int64		Index of global minimum
+	- float		Value of global minimum
+	- Pairs		Per pair: int64 index of minimum, int64 index of maximum, float persistence - sorted as in GetPairedExtrema.
+				Or an error message.
+
+	Results are cached according to the SHA-256 digest of the request data - the raw file contents for paths -
+	so requests with different thresholds or indexing on the same data skip reading and running persistence.
+	
+	Payloads and files larger than SERVER_MAX_PAYLOAD_SIZE are answered with an error.
+	For a payload, the connection is closed afterwards, since the payload is not read.
+
+	At most SERVER_MAX_CONNECTIONS connections are served at once, further clients wait in the backlog of the socket.
+*/
+
+#ifndef PERSISTENCE_SERVER_H
+#define PERSISTENCE_SERVER_H
+
+#include "persistence1d.hpp"
+
+#include <string.h>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#define SERVER_REQUEST_MAGIC 0x51443150	//"P1DQ"
+#define SERVER_FLAG_MATLAB 1
+#define SERVER_FLAG_PATH 2
+#define SERVER_STATUS_OK 0
+#define SERVER_STATUS_ERROR 1
+#define SERVER_DEFAULT_CACHE_SIZE 64
+#define SERVER_MAX_PAYLOAD_SIZE (1ULL << 30)	//in bytes
+#define SERVER_MAX_CONNECTIONS 64
+#define SERVER_ACCEPT_RETRY_DELAY 100			//in milliseconds, after accept ran out of descriptors or memory
+#define SERVER_DIGEST_SIZE 32					//SHA-256, in bytes
+
+namespace p1d
+{
+
+inline unsigned int RotateRight32(const unsigned int value, const int shift)
+{
+	return (value >> shift) | (value << (32 - shift));
+}
+
+/*!
+	SHA-256 digest of a buffer (FIPS 180-4), to identify data in the result cache without keeping the data.
+	Unlike HashBytes, no collisions are known, so results of other data are not returned from the cache.
+
+	@param[in] data		Pointer to buffer.
+	@param[in] size		Size of buffer in bytes.
+	@param[out] digest	Digest, in the byte order of the standard.
+*/
+inline void DigestBytes(const void * data, const size_t size, unsigned char digest[SERVER_DIGEST_SIZE])
+{
+	static const unsigned int k[64] = {
+		0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+		0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+		0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+		0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+		0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+		0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+		0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+		0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2 };
+	unsigned int state[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+
+	//full blocks are read in place, the last one or two blocks hold the rest of the data, 
+	//a 1 bit, zeros, and the size in bits
+	const unsigned char * bytes = (const unsigned char *)data;
+	const size_t fullBlocks = size / 64;
+	const size_t rest = size % 64;
+	unsigned char tail[128];
+	memset(tail, 0, sizeof(tail));
+	if (rest > 0) memcpy(tail, bytes + fullBlocks * 64, rest);
+	tail[rest] = 0x80;
+	const size_t tailSize = (rest < 56) ? 64 : 128;
+	const unsigned long long bits = (unsigned long long)size * 8;
+	for (int b = 0; b < 8; b++)
+	{
+		tail[tailSize - 1 - b] = (unsigned char)(bits >> (8 * b));
+	}
+
+	for (size_t block = 0; block < fullBlocks + tailSize / 64; block++)
+	{
+		const unsigned char * chunk = (block < fullBlocks) ? bytes + block * 64 : tail + (block - fullBlocks) * 64;
+
+		unsigned int w[64];
+		for (int t = 0; t < 16; t++)
+		{
+			w[t] = ((unsigned int)chunk[4*t] << 24) | ((unsigned int)chunk[4*t + 1] << 16) | ((unsigned int)chunk[4*t + 2] << 8) | chunk[4*t + 3];
+		}
+		for (int t = 16; t < 64; t++)
+		{
+			const unsigned int s0 = RotateRight32(w[t-15], 7) ^ RotateRight32(w[t-15], 18) ^ (w[t-15] >> 3);
+			const unsigned int s1 = RotateRight32(w[t-2], 17) ^ RotateRight32(w[t-2], 19) ^ (w[t-2] >> 10);
+			w[t] = w[t-16] + s0 + w[t-7] + s1;
+		}
+
+		unsigned int a = state[0], b = state[1], c = state[2], d = state[3], e = state[4], f = state[5], g = state[6], h = state[7];
+		for (int t = 0; t < 64; t++)
+		{
+			const unsigned int t1 = h + (RotateRight32(e, 6) ^ RotateRight32(e, 11) ^ RotateRight32(e, 25)) + ((e & f) ^ (~e & g)) + k[t] + w[t];
+			const unsigned int t2 = (RotateRight32(a, 2) ^ RotateRight32(a, 13) ^ RotateRight32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+			h = g; g = f; f = e; e = d + t1;
+			d = c; c = b; b = a; a = t1 + t2;
+		}
+		state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+		state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+	}
+
+	for (int i = 0; i < 8; i++)
+	{
+		digest[4*i] = (unsigned char)(state[i] >> 24);
+		digest[4*i + 1] = (unsigned char)(state[i] >> 16);
+		digest[4*i + 2] = (unsigned char)(state[i] >> 8);
+		digest[4*i + 3] = (unsigned char)state[i];
+	}
+}
+
+/*!
+	Identifies data in the result cache by the digest of its contents.
+*/
+struct TCacheKey
+{
+	unsigned char Digest[SERVER_DIGEST_SIZE];	//DigestBytes of contents
+	unsigned long long Size;					//size in bytes
+	bool IsPath;								//digest of file contents or of float values
+
+	bool operator==(const TCacheKey& other) const
+	{
+		return (memcmp(Digest, other.Digest, SERVER_DIGEST_SIZE) == 0 && Size == other.Size && IsPath == other.IsPath);
+	}
+};
+
+struct TCacheKeyHash
+{
+	size_t operator()(const TCacheKey& key) const
+	{
+		//the bytes of a digest are uniformly distributed already
+		size_t hash;
+		memcpy(&hash, key.Digest, sizeof(hash));
+		return hash;
+	}
+};
+
+/*!
+	Thread safe cache of results of RunPersistence, which drops the least recently used results when full.
+
+	Results are shared and never changed once they are in the cache, so they can be read by many threads at once,
+	and stay valid for readers after they are dropped from the cache.
+	Only the paired extrema and the global minimum are kept, no data or working memory of Persistence1D.
+
+	Entries are identified by the SHA-256 digest and size of the request data, so the data itself is not kept.
+*/
+class ResultCache
+{
+public:
+	/*!
+		@param[in] maxEntries	Maximal number of cached results.
+	*/
+	ResultCache(const size_t maxEntries = SERVER_DEFAULT_CACHE_SIZE):MaxEntries(maxEntries)
+	{
+	}
+
+	/*!
+		Returns the cached results for key, or an empty pointer. Marks the results as most recently used.
+
+		@param[in] key		Digest of contents.
+	*/
+	std::shared_ptr<const PersistenceResult> Find(const TCacheKey& key)
+	{
+		std::lock_guard<std::mutex> lock(Mutex);
+
+		TIndexMap::iterator it = Index.find(key);
+		if (it == Index.end()) return std::shared_ptr<const PersistenceResult>();
+
+		Entries.splice(Entries.begin(), Entries, it->second);
+		return it->second->Results;
+	}
+
+	/*!
+		Adds results to the cache, and drops the least recently used results if the cache is full.
+		If there are results for key already, they are replaced.
+	*/
+	void Add(const TCacheKey& key, const std::shared_ptr<const PersistenceResult>& results)
+	{
+		if (MaxEntries == 0) return;
+
+		std::lock_guard<std::mutex> lock(Mutex);
+
+		TIndexMap::iterator it = Index.find(key);
+		if (it != Index.end())
+		{
+			Entries.erase(it->second);
+			Index.erase(it);
+		}
+
+		TEntry entry;
+		entry.Key = key;
+		entry.Results = results;
+		Entries.push_front(std::move(entry));
+		Index[key] = Entries.begin();
+
+		while (Entries.size() > MaxEntries)
+		{
+			Index.erase(Entries.back().Key);
+			Entries.pop_back();
+		}
+	}
+
+	size_t GetNumberOfEntries()
+	{
+		std::lock_guard<std::mutex> lock(Mutex);
+		return Entries.size();
+	}
+
+protected:
+	struct TEntry
+	{
+		TCacheKey Key;
+		std::shared_ptr<const PersistenceResult> Results;
+	};
+	typedef std::unordered_map<TCacheKey, std::list<TEntry>::iterator, TCacheKeyHash> TIndexMap;
+
+	size_t MaxEntries;
+	std::list<TEntry> Entries;	//most recently used first
+	TIndexMap Index;
+	std::mutex Mutex;
+};
+
+/*!
+	Runs the server until it fails, i.e. until accept fails other than by running out of descriptors or memory.
+	Open connections are served to their end before it returns. Not supported on Windows.
+
+	@param[in] socketPath	Path of the Unix domain socket. An existing file with this name is removed.
+	@param[in] cacheSize	Maximal number of cached results.
+*/
+bool RunServer(const char * socketPath, const size_t cacheSize = SERVER_DEFAULT_CACHE_SIZE);
+
+}
+#endif
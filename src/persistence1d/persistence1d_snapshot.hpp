@@ -0,0 +1,378 @@
+/*! \file persistence1d_snapshot.hpp
+    Binary snapshot of the results of Persistence1D, which can be memory-mapped and queried in place.
+
+	Layout (native byte order, all sections aligned to 8 bytes):
+	- TSnapshotHeader
+	- Paired extrema, TSnapshotHeader::NumberOfPairs times TPairedExtrema, sorted as in Persistence1D::GetPairedExtrema
+	- Optional merge hierarchy, TSnapshotHeader::NumberOfMerges times TMergeRecord, in the order of the merges
+
+	The file stores TPairedExtrema as they are in memory, so it can only be opened by programs with the same
+	index size (see P1D_64BIT_INDICES) and byte order. Other files are rejected, not converted.
+
+	The file is mapped read-only and shared, so any number of processes can open the same snapshot,
+	and share a single copy of it in memory.
+*/
+
+#ifndef PERSISTENCE_SNAPSHOT_H
+#define PERSISTENCE_SNAPSHOT_H
+
+#include "persistence1d.hpp"
+#include "persistence1d_mapping.hpp"
+
+#include <stdio.h>
+#include <string.h>
+
+#define SNAPSHOT_MAGIC 0x53443150	//"P1DS"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_FLAG_DATA_CHECKSUM 1
+#define SNAPSHOT_FLAG_MERGES 2
+
+namespace p1d
+{
+
+/*!
+	A merge of two components at a local maximum, as reported to TNullVisitor::ComponentsMerged.
+	All merges in the order they happen form the merge hierarchy of the data.
+*/
+struct TMergeRecord
+{
+	///Index of the local maximum at which the components merge.
+	TIndex MaxIndex;
+
+	///Index of the minimum of the surviving component, the one with the smaller minimum.
+	TIndex SurvivorMinIndex;
+
+	///Index of the minimum of the destroyed component.
+	TIndex DestroyedMinIndex;
+};
+
+/*!
+	Visitor which records the merge hierarchy during Persistence1D::RunPersistence, to store it in a snapshot.
+*/
+class MergeHierarchyRecorder : public TNullVisitor
+{
+public:
+	void ComponentsMerged(const TIndex survivorMinIdx, const TIndex destroyedMinIdx, const TIndex maxIdx)
+	{
+		TMergeRecord merge;
+		merge.MaxIndex = maxIdx;
+		merge.SurvivorMinIndex = survivorMinIdx;
+		merge.DestroyedMinIndex = destroyedMinIdx;
+		Merges.push_back(merge);
+	}
+
+	const std::vector<TMergeRecord>& GetMerges() const
+	{
+		return Merges;
+	}
+
+	void Clear()
+	{
+		Merges.clear();
+	}
+
+protected:
+	std::vector<TMergeRecord> Merges;
+};
+
+/*!
+	First bytes of a snapshot file.
+*/
+struct TSnapshotHeader
+{
+	unsigned int Magic;					//SNAPSHOT_MAGIC
+	unsigned int Version;				//SNAPSHOT_VERSION
+	unsigned int PairSize;				//sizeof(TPairedExtrema)
+	unsigned int MergeSize;				//sizeof(TMergeRecord)
+	unsigned int Flags;					//SNAPSHOT_FLAG_DATA_CHECKSUM, SNAPSHOT_FLAG_MERGES
+	float GlobalMinValue;
+	long long GlobalMinIndex;			//-1 if there was no data
+	unsigned long long NumberOfSamples;
+	unsigned long long NumberOfPairs;
+	unsigned long long NumberOfMerges;
+	unsigned long long PairsOffset;		//in bytes, from the start of the file
+	unsigned long long MergesOffset;
+	unsigned long long DataChecksum;	//HashBytes of the input data values, if SNAPSHOT_FLAG_DATA_CHECKSUM is set
+	unsigned long long Checksum;		//HashBytes of the header with Checksum set to 0, followed by all sections
+};
+
+/*!
+	Returns the offset of the next section, aligned to 8 bytes.
+*/
+inline unsigned long long AlignSnapshotOffset(const unsigned long long offset)
+{
+	return (offset + 7) & ~7ULL;
+}
+
+/*!
+	Writes the results of a run to a snapshot file. Overwrites any existing file with the same name.
+
+	@param[in] filename		Name of snapshot file.
+	@param[in] p			Persistence1D after RunPersistence.
+	@param[in] data			Optional input data of the run, whose checksum is stored to identify it later.
+	@param[in] merges		Optional merge hierarchy of the run, see MergeHierarchyRecorder.
+*/
+inline bool SaveSnapshot(const char * filename, const Persistence1D& p,
+						 const std::vector<float> * data = NULL, const std::vector<TMergeRecord> * merges = NULL)
+{
+	std::vector<TPairedExtrema> pairs;
+	p.GetPairedExtrema(pairs);
+
+	TSnapshotHeader header;
+	memset(&header, 0, sizeof(header));
+	header.Magic = SNAPSHOT_MAGIC;
+	header.Version = SNAPSHOT_VERSION;
+	header.PairSize = sizeof(TPairedExtrema);
+	header.MergeSize = sizeof(TMergeRecord);
+	header.GlobalMinValue = p.GetGlobalMinimumValue();
+	header.GlobalMinIndex = p.GetGlobalMinimumIndex();
+	header.NumberOfSamples = p.GetNumberOfSamples();
+	header.NumberOfPairs = pairs.size();
+	header.PairsOffset = AlignSnapshotOffset(sizeof(header));
+	header.MergesOffset = AlignSnapshotOffset(header.PairsOffset + pairs.size() * sizeof(TPairedExtrema));
+	if (data)
+	{
+		header.Flags |= SNAPSHOT_FLAG_DATA_CHECKSUM;
+		header.DataChecksum = HashBytes(data->empty() ? NULL : &(*data)[0], data->size() * sizeof(float));
+	}
+	if (merges)
+	{
+		header.Flags |= SNAPSHOT_FLAG_MERGES;
+		header.NumberOfMerges = merges->size();
+	}
+
+	//sections, including the padding between them
+	std::vector<char> body((size_t)(header.MergesOffset + header.NumberOfMerges * sizeof(TMergeRecord) - header.PairsOffset), 0);
+	if (!pairs.empty()) memcpy(&body[0], &pairs[0], pairs.size() * sizeof(TPairedExtrema));
+	if (header.NumberOfMerges > 0) memcpy(&body[(size_t)(header.MergesOffset - header.PairsOffset)], &(*merges)[0], merges->size() * sizeof(TMergeRecord));
+
+	const char padding[8] = { 0 };
+	const size_t headerPadding = (size_t)(header.PairsOffset - sizeof(header));
+	header.Checksum = HashBytes(&header, sizeof(header));
+	header.Checksum = HashBytes(body.empty() ? NULL : &body[0], body.size(), header.Checksum);
+
+	FILE * file = fopen(filename, "wb");
+	if (!file) return false;
+
+	bool written = (fwrite(&header, sizeof(header), 1, file) == 1 &&
+					fwrite(padding, 1, headerPadding, file) == headerPadding &&
+					fwrite(body.empty() ? padding : &body[0], 1, body.size(), file) == body.size());
+	return (fclose(file) == 0 && written);
+}
+
+/*!
+	Read-only view of a snapshot file, mapped into memory.
+	Queries have the same semantics as Persistence1D, and read the mapped pairs in place.
+
+	Usage:
+	\code
+	Persistence1D p;
+	p.RunPersistence(data);
+	SaveSnapshot("data.p1d", p, &data);
+
+	PersistenceSnapshot snapshot;
+	if (snapshot.Open("data.p1d")) snapshot.GetPairedExtrema(pairs, threshold);
+	\endcode
+*/
+class PersistenceSnapshot
+{
+public:
+	PersistenceSnapshot() : Mapping(NULL), MappingSize(0), Header(NULL), Pairs(NULL), Merges(NULL)
+	{
+	}
+
+	~PersistenceSnapshot()
+	{
+		Close();
+	}
+
+	/*!
+		Maps a snapshot file. Fails if the file is not a snapshot, has a different version, index size or byte order,
+		is truncated, or - if verifyChecksum is set - its checksum does not match.
+
+		@param[in] filename			Name of snapshot file.
+		@param[in] verifyChecksum	Set this to false to skip reading the whole file, e.g. for large snapshots which are queried sparsely.
+	*/
+	bool Open(const char * filename, const bool verifyChecksum = true)
+	{
+		Close();
+		if (!MapFile(filename, Mapping, MappingSize)) return false;
+
+		if (!IsValid(verifyChecksum))
+		{
+			Close();
+			return false;
+		}
+
+		const char * bytes = (const char *)Mapping;
+		Header = (const TSnapshotHeader *)bytes;
+		Pairs = (const TPairedExtrema *)(bytes + Header->PairsOffset);
+		Merges = (const TMergeRecord *)(bytes + Header->MergesOffset);
+		return true;
+	}
+
+	///Unmaps the snapshot. Pointers returned by GetPairs and GetMerges become invalid.
+	void Close()
+	{
+		if (Mapping) UnmapFile(Mapping, MappingSize);
+		Mapping = NULL;
+		MappingSize = 0;
+		Header = NULL;
+		Pairs = NULL;
+		Merges = NULL;
+	}
+
+	bool IsOpen() const
+	{
+		return (Header != NULL);
+	}
+
+	/*!
+		Same as Persistence1D::GetPairedExtrema.
+	*/
+	bool GetPairedExtrema(std::vector<TPairedExtrema> & pairs, const float threshold = 0, const bool matlabIndexing = false) const
+	{
+		pairs.clear();
+		if (GetNumberOfPairs() == 0 || threshold < 0.0) return false;
+
+		const TPairedExtrema * first = FilterByPersistence(threshold);
+		if (first == GetPairs() + GetNumberOfPairs()) return false;
+
+		pairs.assign(first, GetPairs() + GetNumberOfPairs());
+		if (matlabIndexing)
+		{
+			for (std::vector<TPairedExtrema>::iterator p = pairs.begin(); p != pairs.end(); p++)
+			{
+				(*p).MinIndex += MATLAB_INDEX_FACTOR;
+				(*p).MaxIndex += MATLAB_INDEX_FACTOR;
+			}
+		}
+		return true;
+	}
+
+	/*!
+		Same as Persistence1D::GetExtremaIndices.
+	*/
+	bool GetExtremaIndices(std::vector<TIndex> & min, std::vector<TIndex> & max, const float threshold = 0, const bool matlabIndexing = false) const
+	{
+		min.clear();
+		max.clear();
+		if (GetNumberOfPairs() == 0 || threshold < 0.0) return false;
+
+		const TIndex matlabIndexFactor = matlabIndexing ? MATLAB_INDEX_FACTOR : 0;
+		for (const TPairedExtrema * p = FilterByPersistence(threshold); p != GetPairs() + GetNumberOfPairs(); p++)
+		{
+			min.push_back((*p).MinIndex + matlabIndexFactor);
+			max.push_back((*p).MaxIndex + matlabIndexFactor);
+		}
+		return true;
+	}
+
+	///Same as Persistence1D::GetGlobalMinimumIndex.
+	TIndex GetGlobalMinimumIndex(const bool matlabIndexing = false) const
+	{
+		if (!IsOpen() || Header->GlobalMinIndex < 0) return -1;
+		return (TIndex)Header->GlobalMinIndex + (matlabIndexing ? MATLAB_INDEX_FACTOR : 0);
+	}
+
+	///Same as Persistence1D::GetGlobalMinimumValue.
+	float GetGlobalMinimumValue() const
+	{
+		return IsOpen() ? Header->GlobalMinValue : 0;
+	}
+
+	size_t GetNumberOfSamples() const
+	{
+		return IsOpen() ? (size_t)Header->NumberOfSamples : 0;
+	}
+
+	///Returns the mapped pairs, sorted according to persistence. Valid until the snapshot is closed.
+	const TPairedExtrema * GetPairs() const
+	{
+		return Pairs;
+	}
+
+	size_t GetNumberOfPairs() const
+	{
+		return IsOpen() ? (size_t)Header->NumberOfPairs : 0;
+	}
+
+	bool HasMerges() const
+	{
+		return IsOpen() && (Header->Flags & SNAPSHOT_FLAG_MERGES) != 0;
+	}
+
+	///Returns the mapped merge hierarchy, in the order of the merges. Valid until the snapshot is closed.
+	const TMergeRecord * GetMerges() const
+	{
+		return Merges;
+	}
+
+	size_t GetNumberOfMerges() const
+	{
+		return IsOpen() ? (size_t)Header->NumberOfMerges : 0;
+	}
+
+	/*!
+		Returns true if the snapshot has a data checksum, and it matches data - i.e. the snapshot holds the results for data.
+	*/
+	bool MatchesData(const std::vector<float>& data) const
+	{
+		if (!IsOpen() || (Header->Flags & SNAPSHOT_FLAG_DATA_CHECKSUM) == 0 || data.size() != Header->NumberOfSamples) return false;
+		return (HashBytes(data.empty() ? NULL : &data[0], data.size() * sizeof(float)) == Header->DataChecksum);
+	}
+
+protected:
+	//not copyable, the mapping is unmapped once
+	PersistenceSnapshot(const PersistenceSnapshot&);
+	PersistenceSnapshot& operator=(const PersistenceSnapshot&);
+
+	void * Mapping;
+	size_t MappingSize;
+	const TSnapshotHeader * Header;
+	const TPairedExtrema * Pairs;
+	const TMergeRecord * Merges;
+
+	/*!
+		Checks the header of the mapped file against the layout of this program, and the sizes of all sections.
+	*/
+	bool IsValid(const bool verifyChecksum) const
+	{
+		if (MappingSize < sizeof(TSnapshotHeader)) return false;
+
+		//copy, since the mapping cannot be changed to zero the checksum
+		TSnapshotHeader header;
+		memcpy(&header, Mapping, sizeof(header));
+
+		if (header.Magic != SNAPSHOT_MAGIC || header.Version != SNAPSHOT_VERSION ||
+			header.PairSize != sizeof(TPairedExtrema) || header.MergeSize != sizeof(TMergeRecord)) return false;
+
+		if (header.PairsOffset != AlignSnapshotOffset(sizeof(header)) ||
+			header.NumberOfPairs > (MappingSize - header.PairsOffset) / sizeof(TPairedExtrema) ||
+			header.MergesOffset != AlignSnapshotOffset(header.PairsOffset + header.NumberOfPairs * sizeof(TPairedExtrema)) ||
+			header.MergesOffset > MappingSize ||
+			header.NumberOfMerges > (MappingSize - header.MergesOffset) / sizeof(TMergeRecord)) return false;
+
+		if (!verifyChecksum) return true;
+
+		const unsigned long long checksum = header.Checksum;
+		header.Checksum = 0;
+		const char * bytes = (const char *)Mapping;
+		const size_t end = (size_t)(header.MergesOffset + header.NumberOfMerges * sizeof(TMergeRecord));
+		return (HashBytes(bytes + header.PairsOffset, end - (size_t)header.PairsOffset, HashBytes(&header, sizeof(header))) == checksum);
+	}
+
+	///Same as Persistence1D::FilterByPersistence, on the mapped pairs.
+	const TPairedExtrema * FilterByPersistence(const float threshold) const
+	{
+		if (threshold == 0 || threshold < 0) return GetPairs();
+
+		TPairedExtrema searchPair;
+		searchPair.Persistence = threshold;
+		searchPair.MaxIndex = 0;
+		searchPair.MinIndex = 0;
+		return std::lower_bound(GetPairs(), GetPairs() + GetNumberOfPairs(), searchPair);
+	}
+};
+}
+#endif
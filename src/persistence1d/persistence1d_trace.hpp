@@ -0,0 +1,341 @@
+/*! \file persistence1d_trace.hpp
+    Timeline of Persistence1D runs in Chrome trace event format, with optional hardware counters.
+
+	The trace is written as JSON, which can be opened in Perfetto (ui.perfetto.dev) or chrome://tracing.
+	Each phase of a run is a complete event ("ph":"X") with its thread, and arguments such as the file name.
+
+	On Linux, the Watershed phase also gets hardware counters from perf_event_open if they are available
+	(cycles, cache misses and branch misses). Otherwise, they are left out.
+
+	TracedPersistence1D gets the phases from the PhaseStarted and PhaseFinished hooks of Persistence1D.
+	A run without tracing only pays for these calls, which do nothing.
+*/
+
+#ifndef PERSISTENCE_TRACE_H
+#define PERSISTENCE_TRACE_H
+
+#include "persistence1d.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <string.h>
+#endif
+
+namespace p1d
+{
+
+/*!
+	Escapes a string for a JSON string value.
+*/
+inline std::string EscapeJson(const std::string& text)
+{
+	std::string escaped;
+	for (std::string::const_iterator c = text.begin(); c != text.end(); c++)
+	{
+		if (*c == '"' || *c == '\\') escaped += '\\';
+		if ((unsigned char)*c < 0x20) escaped += ' ';
+		else escaped += *c;
+	}
+	return escaped;
+}
+
+/*!
+	Collects trace events from any number of threads, and writes them as a Chrome trace JSON file.
+	Timestamps are in microseconds since the recorder was created.
+*/
+class TraceRecorder
+{
+public:
+	TraceRecorder() : Start(std::chrono::steady_clock::now())
+	{
+	}
+
+	///Returns the time since the recorder was created, in microseconds.
+	long long GetTimestamp() const
+	{
+		return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - Start).count();
+	}
+
+	/*!
+		Adds a complete event on the calling thread.
+
+		@param[in] name			Name of event, e.g. the phase of a run.
+		@param[in] category		Category of event.
+		@param[in] start		Start time from GetTimestamp.
+		@param[in] duration		Duration in microseconds.
+		@param[in] args			Members of the JSON args object, e.g. "\"file\":\"data.txt\"", or empty.
+	*/
+	void AddEvent(const std::string& name, const std::string& category, const long long start, const long long duration,
+				  const std::string& args = std::string())
+	{
+		std::lock_guard<std::mutex> lock(Mutex);
+
+		std::ostringstream event;
+		event << "{\"name\":\"" << EscapeJson(name) << "\",\"cat\":\"" << EscapeJson(category)
+			  << "\",\"ph\":\"X\",\"ts\":" << start << ",\"dur\":" << duration
+			  << ",\"pid\":1,\"tid\":" << GetThreadNumber() << ",\"args\":{" << args << "}}";
+		Events.push_back(event.str());
+	}
+
+	size_t GetNumberOfEvents()
+	{
+		std::lock_guard<std::mutex> lock(Mutex);
+		return Events.size();
+	}
+
+	/*!
+		Writes all events to a JSON file. Overwrites any existing file with the same name.
+	*/
+	bool WriteJson(const char * filename)
+	{
+		std::lock_guard<std::mutex> lock(Mutex);
+
+		std::ofstream file(filename);
+		if (!file) return false;
+
+		file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" << std::endl;
+		for (size_t i = 0; i != Events.size(); i++)
+		{
+			file << Events[i] << ((i + 1 != Events.size()) ? "," : "") << std::endl;
+		}
+		file << "]}" << std::endl;
+		return (bool)file;
+	}
+
+protected:
+	std::chrono::steady_clock::time_point Start;
+	std::vector<std::string> Events;
+	std::map<std::thread::id, int> ThreadNumbers;
+	std::mutex Mutex;
+
+	///Numbers threads in the order of their first event, starting at 1. Called with Mutex held.
+	int GetThreadNumber()
+	{
+		std::map<std::thread::id, int>::iterator it = ThreadNumbers.find(std::this_thread::get_id());
+		if (it != ThreadNumbers.end()) return it->second;
+
+		int number = (int)ThreadNumbers.size() + 1;
+		ThreadNumbers[std::this_thread::get_id()] = number;
+		return number;
+	}
+};
+
+/*!
+	Adds an event to a recorder for the lifetime of the object. Does nothing if the recorder is NULL.
+*/
+class ScopedTraceEvent
+{
+public:
+	ScopedTraceEvent(TraceRecorder * recorder, const char * name, const char * category, const std::string& args = std::string())
+		: Recorder(recorder), Name(name), Category(category), Args(args), Start(recorder ? recorder->GetTimestamp() : 0)
+	{
+	}
+
+	~ScopedTraceEvent()
+	{
+		if (Recorder) Recorder->AddEvent(Name, Category, Start, Recorder->GetTimestamp() - Start, Args);
+	}
+
+	///Adds members to the args object of the event, e.g. results which are known only at the end.
+	void AddArgs(const std::string& args)
+	{
+		if (args.empty()) return;
+		if (!Args.empty()) Args += ",";
+		Args += args;
+	}
+
+protected:
+	TraceRecorder * Recorder;
+	const char * Name;
+	const char * Category;
+	std::string Args;
+	long long Start;
+};
+
+/*!
+	Hardware counters of the calling thread: cycles, cache misses and branch misses.
+
+	Uses perf_event_open on Linux. Open fails if the kernel or its settings (perf_event_paranoid),
+	a virtual machine or a container do not allow it - counters are then simply not available.
+*/
+class PerfCounters
+{
+public:
+	unsigned long long Cycles, CacheMisses, BranchMisses;
+
+	PerfCounters() : Cycles(0), CacheMisses(0), BranchMisses(0)
+	{
+		for (int i = 0; i < NumberOfCounters; i++) Descriptors[i] = -1;
+	}
+
+	~PerfCounters()
+	{
+		Close();
+	}
+
+	/*!
+		Opens the counters for the calling thread. Returns false if any of them is not available.
+	*/
+	bool Open()
+	{
+		Close();
+#ifdef __linux__
+		const unsigned long long configs[NumberOfCounters] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES };
+		for (int i = 0; i < NumberOfCounters; i++)
+		{
+			perf_event_attr attr;
+			memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.config = configs[i];
+			attr.disabled = (i == 0);	//the group leader starts and stops all counters
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			attr.read_format = PERF_FORMAT_GROUP;
+
+			Descriptors[i] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, (i == 0) ? -1 : Descriptors[0], 0);
+			if (Descriptors[i] < 0)
+			{
+				Close();
+				return false;
+			}
+		}
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	bool IsOpen() const
+	{
+		return (Descriptors[0] >= 0);
+	}
+
+	///Resets and starts the counters.
+	void Start()
+	{
+#ifdef __linux__
+		if (!IsOpen()) return;
+		ioctl(Descriptors[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+		ioctl(Descriptors[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+	}
+
+	///Stops the counters and reads them. Returns false if they are not open or cannot be read.
+	bool Stop()
+	{
+#ifdef __linux__
+		if (!IsOpen()) return false;
+		ioctl(Descriptors[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+		unsigned long long values[1 + NumberOfCounters];	//number of counters, then their values
+		if (read(Descriptors[0], values, sizeof(values)) != (ssize_t)sizeof(values)) return false;
+
+		Cycles = values[1];
+		CacheMisses = values[2];
+		BranchMisses = values[3];
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	///Returns the counters as members of a JSON args object.
+	std::string GetArgs() const
+	{
+		std::ostringstream args;
+		args << "\"cycles\":" << Cycles << ",\"cache_misses\":" << CacheMisses << ",\"branch_misses\":" << BranchMisses;
+		return args.str();
+	}
+
+protected:
+	static const int NumberOfCounters = 3;
+	int Descriptors[NumberOfCounters];
+
+	void Close()
+	{
+		for (int i = NumberOfCounters - 1; i >= 0; i--)
+		{
+#ifdef __linux__
+			if (Descriptors[i] >= 0) close(Descriptors[i]);
+#endif
+			Descriptors[i] = -1;
+		}
+	}
+};
+
+/*!
+	Persistence1D which adds an event for each phase of its runs to a recorder: RunPersistence around the whole run,
+	CreateIndexValueVector, Watershed (with hardware counters if available) and SortPairedExtrema.
+	All overloads of RunPersistence are traced, and results are identical to Persistence1D.
+*/
+class TracedPersistence1D : public Persistence1D
+{
+public:
+	/*!
+		@param[in] recorder		Recorder to add events to.
+		@param[in] args			Members of the JSON args object of all events, e.g. the file name.
+		@param[in] useCounters	Set this to false to skip hardware counters.
+	*/
+	TracedPersistence1D(TraceRecorder& recorder, const std::string& args = std::string(), const bool useCounters = true)
+		: Recorder(recorder), Args(args), UseCounters(useCounters)
+	{
+		for (int i = 0; i < NUMBER_OF_PHASES; i++) PhaseStarts[i] = 0;
+	}
+
+	///Returns the name of the event of a phase.
+	static const char * GetPhaseName(const int phase)
+	{
+		switch (phase)
+		{
+		case PHASE_CREATE_INDEX_VALUE_VECTOR: return "CreateIndexValueVector";
+		case PHASE_WATERSHED: return "Watershed";
+		case PHASE_SORT_PAIRED_EXTREMA: return "SortPairedExtrema";
+		}
+		return "RunPersistence";
+	}
+
+protected:
+	TraceRecorder& Recorder;
+	std::string Args;
+	bool UseCounters;
+	long long PhaseStarts[NUMBER_OF_PHASES];
+	PerfCounters Counters;
+
+	void PhaseStarted(const int phase)
+	{
+		//counters are opened per run, since runs may happen on different threads
+		if (phase == PHASE_WATERSHED && UseCounters && Counters.Open()) Counters.Start();
+
+		PhaseStarts[phase] = Recorder.GetTimestamp();
+	}
+
+	void PhaseFinished(const int phase)
+	{
+		const long long end = Recorder.GetTimestamp();
+
+		std::string args = Args;
+		if (phase == PHASE_WATERSHED && Counters.Stop()) args += (args.empty() ? "" : ",") + Counters.GetArgs();
+		if (phase == PHASE_RUN)
+		{
+			std::ostringstream results;
+			results << "\"samples\":" << Data.size() << ",\"pairs\":" << PairedExtrema.size();
+			args += (args.empty() ? "" : ",") + results.str();
+		}
+
+		Recorder.AddEvent(GetPhaseName(phase), "persistence", PhaseStarts[phase], end - PhaseStarts[phase], args);
+	}
+};
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,109 @@
+/*! \file matrix.h
+    Minimal stand-in for Matlab's matrix.h, used to build and test run_persistence1d.cpp without Matlab.
+	Provides only the mx functions used by run_persistence1d.cpp, for real numeric matrices.
+*/
+
+#ifndef MEX_STUB_MATRIX_H
+#define MEX_STUB_MATRIX_H
+
+#include <stddef.h>
+#include <vector>
+
+typedef size_t mwSize;
+
+enum mxClassID
+{
+	mxUNKNOWN_CLASS,
+	mxDOUBLE_CLASS,
+	mxSINGLE_CLASS
+};
+
+enum mxComplexity
+{
+	mxREAL,
+	mxCOMPLEX
+};
+
+struct mxArray
+{
+	mxClassID ClassID;
+	size_t M;
+	size_t N;
+	std::vector<double> Storage; //double, so that data is aligned for any class
+};
+
+inline mxArray * mxCreateNumericMatrix(const mwSize m, const mwSize n, const mxClassID classID, const mxComplexity)
+{
+	mxArray * out = new mxArray;
+	out->ClassID = classID;
+	out->M = m;
+	out->N = n;
+	out->Storage.resize(m * n);
+	return out;
+}
+
+inline mxArray * mxCreateDoubleScalar(const double value)
+{
+	mxArray * out = mxCreateNumericMatrix(1, 1, mxDOUBLE_CLASS, mxREAL);
+	out->Storage[0] = value;
+	return out;
+}
+
+inline void mxDestroyArray(mxArray * array)
+{
+	delete array;
+}
+
+inline void * mxGetData(const mxArray * array)
+{
+	return array->Storage.empty() ? NULL : (void *)&array->Storage[0];
+}
+
+inline size_t mxGetNumberOfElements(const mxArray * array)
+{
+	return array->M * array->N;
+}
+
+inline size_t mxGetM(const mxArray * array)
+{
+	return array->M;
+}
+
+inline size_t mxGetN(const mxArray * array)
+{
+	return array->N;
+}
+
+inline mwSize mxGetNumberOfDimensions(const mxArray *)
+{
+	return 2;
+}
+
+inline mxClassID mxGetClassID(const mxArray * array)
+{
+	return array->ClassID;
+}
+
+inline bool mxIsNumeric(const mxArray * array)
+{
+	return (array->ClassID != mxUNKNOWN_CLASS);
+}
+
+inline bool mxIsComplex(const mxArray *)
+{
+	return false;
+}
+
+inline bool mxIsSingle(const mxArray * array)
+{
+	return (array->ClassID == mxSINGLE_CLASS);
+}
+
+inline double mxGetScalar(const mxArray * array)
+{
+	if (mxGetNumberOfElements(array) == 0) return 0;
+	if (array->ClassID == mxSINGLE_CLASS) return *(const float *)mxGetData(array);
+	return array->Storage[0];
+}
+
+#endif
@@ -0,0 +1,24 @@
+/*! \file mex.h
+    Minimal stand-in for Matlab's mex.h, used to build and test run_persistence1d.cpp without Matlab.
+*/
+
+#ifndef MEX_STUB_MEX_H
+#define MEX_STUB_MEX_H
+
+#include "matrix.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+
+inline int mexPrintf(const char * format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	int written = vprintf(format, args);
+	va_end(args);
+	return written;
+}
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]);
+
+#endif
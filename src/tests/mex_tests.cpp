@@ -0,0 +1,156 @@
+/*! \file mex_tests.cpp
+    Tests for the Matlab interface run_persistence1d.cpp, built against the mex.h stand-in in the mex folder.
+*/
+
+#include <mex.h>
+#include "../persistence1d/persistence1d.hpp"
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+
+using namespace std;
+using namespace p1d;
+
+#define NUM_OUTPUTS 5
+
+mxArray * CreateSingleInput(const vector<float> & data)
+{
+	mxArray * input = mxCreateNumericMatrix(1, data.size(), mxSINGLE_CLASS, mxREAL);
+	float * inputPt = (float *)mxGetData(input);
+	for (size_t i = 0; i < data.size(); i++)
+	{
+		inputPt[i] = data[i];
+	}
+	return input;
+}
+
+void DestroyOutputs(mxArray * outputs[])
+{
+	for (int i = 0; i < NUM_OUTPUTS; i++)
+	{
+		if (outputs[i] != NULL) mxDestroyArray(outputs[i]);
+		outputs[i] = NULL;
+	}
+}
+
+/*!
+	Compares Matlab interface outputs to the last pairs of Persistence1D results (the most persistent ones).
+*/
+void AssertSameResults(mxArray * outputs[], Persistence1D & p, const float threshold, const size_t topK)
+{
+	vector<TPairedExtrema> pairs;
+	p.GetPairedExtrema(pairs, threshold, true);
+	if (topK != 0 && pairs.size() > topK) pairs.erase(pairs.begin(), pairs.end() - topK);
+
+	assert(mxGetNumberOfElements(outputs[0]) == pairs.size());
+	assert(mxGetNumberOfElements(outputs[1]) == pairs.size());
+	assert(mxGetNumberOfElements(outputs[2]) == pairs.size());
+
+	float * minIndices = (float *)mxGetData(outputs[0]);
+	float * maxIndices = (float *)mxGetData(outputs[1]);
+	float * persistence = (float *)mxGetData(outputs[2]);
+	for (size_t i = 0; i < pairs.size(); i++)
+	{
+		assert(minIndices[i] == (float)pairs[i].MinIndex);
+		assert(maxIndices[i] == (float)pairs[i].MaxIndex);
+		assert(persistence[i] == pairs[i].Persistence);
+	}
+
+	assert(*(float *)mxGetData(outputs[3]) == (float)p.GetGlobalMinimumIndex(true));
+	assert(*(float *)mxGetData(outputs[4]) == p.GetGlobalMinimumValue());
+}
+
+void MexMatchesPersistence1D()
+{
+	vector<float> data;
+	int size = rand() % 1000 + 1;
+	for (int i = 0; i < size; i++)
+	{
+		data.push_back((float)(rand() % 100));
+	}
+
+	Persistence1D p;
+	p.RunPersistence(data);
+
+	mxArray * outputs[NUM_OUTPUTS] = {NULL};
+	const mxArray * inputs[3] = {CreateSingleInput(data), NULL, NULL};
+
+	mexFunction(NUM_OUTPUTS, outputs, 1, inputs);
+	AssertSameResults(outputs, p, 0, 0);
+	DestroyOutputs(outputs);
+
+	float threshold = (float)(rand() % 50);
+	size_t topK = rand() % 20;
+	inputs[1] = mxCreateDoubleScalar(threshold);
+	inputs[2] = mxCreateDoubleScalar((double)topK);
+
+	mexFunction(NUM_OUTPUTS, outputs, 2, inputs);
+	AssertSameResults(outputs, p, threshold, 0);
+	DestroyOutputs(outputs);
+
+	mexFunction(NUM_OUTPUTS, outputs, 3, inputs);
+	AssertSameResults(outputs, p, threshold, topK);
+	DestroyOutputs(outputs);
+
+	//topK beyond the number of pairs returns all of them
+	mxDestroyArray((mxArray *)inputs[2]);
+	inputs[2] = mxCreateDoubleScalar(HUGE_VAL);
+	mexFunction(NUM_OUTPUTS, outputs, 3, inputs);
+	AssertSameResults(outputs, p, threshold, 0);
+	DestroyOutputs(outputs);
+
+	for (int i = 0; i < 3; i++)
+	{
+		mxDestroyArray((mxArray *)inputs[i]);
+	}
+}
+void MexRejectsInvalidInput()
+{
+	mxArray * outputs[NUM_OUTPUTS] = {NULL};
+	const mxArray * inputs[2] = {mxCreateNumericMatrix(1, 10, mxDOUBLE_CLASS, mxREAL), mxCreateDoubleScalar(-1)};
+
+	mexFunction(NUM_OUTPUTS, outputs, 1, inputs);
+	assert(outputs[0] == NULL);
+
+	vector<float> data(10, 1.0);
+	mxDestroyArray((mxArray *)inputs[0]);
+	inputs[0] = CreateSingleInput(data);
+
+	mexFunction(NUM_OUTPUTS, outputs, 2, inputs); //negative threshold
+	assert(outputs[0] == NULL);
+
+	mexFunction(NUM_OUTPUTS - 1, outputs, 1, inputs);
+	assert(outputs[0] == NULL);
+
+	mxDestroyArray((mxArray *)inputs[1]);
+	inputs[1] = mxCreateDoubleScalar(NAN);
+	mexFunction(NUM_OUTPUTS, outputs, 2, inputs); //NaN threshold
+	assert(outputs[0] == NULL);
+
+	const mxArray * topKInputs[3] = {inputs[0], mxCreateDoubleScalar(0), mxCreateDoubleScalar(NAN)};
+	mexFunction(NUM_OUTPUTS, outputs, 3, topKInputs); //NaN topK
+	assert(outputs[0] == NULL);
+
+	mxDestroyArray((mxArray *)topKInputs[2]);
+	topKInputs[2] = mxCreateDoubleScalar(1.5);
+	mexFunction(NUM_OUTPUTS, outputs, 3, topKInputs); //fractional topK
+	assert(outputs[0] == NULL);
+
+	mxDestroyArray((mxArray *)topKInputs[1]);
+	mxDestroyArray((mxArray *)topKInputs[2]);
+	mxDestroyArray((mxArray *)inputs[0]);
+	mxDestroyArray((mxArray *)inputs[1]);
+
+	cout << endl << "MexRejectsInvalidInput: passed" << endl;
+}
+int main()
+{
+	for (int i = 0; i < 100; i++)
+	{
+		MexMatchesPersistence1D();
+	}
+	cout << "MexMatchesPersistence1D: passed" << endl;
+
+	MexRejectsInvalidInput();
+	return 0;
+}
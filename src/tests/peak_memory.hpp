@@ -0,0 +1,31 @@
+/*! \file peak_memory.hpp
+    Peak memory measurement shared by the tests and the benchmarks.
+*/
+
+#ifndef PERSISTENCE_PEAK_MEMORY_H
+#define PERSISTENCE_PEAK_MEMORY_H
+
+#include <stdlib.h>
+#include <fstream>
+#include <string>
+
+/*!
+	Returns the peak resident memory of the process since the last call, in bytes, or 0 where this is not available.
+	On Linux, this reads VmHWM from /proc/self/status and then resets it.
+*/
+inline size_t GetPeakMemorySinceLastCall()
+{
+	size_t peak = 0;
+#ifdef __linux__
+	std::ifstream status("/proc/self/status");
+	std::string line;
+	while (std::getline(status, line))
+	{
+		if (line.compare(0, 6, "VmHWM:") == 0) peak = (size_t)atol(line.c_str() + 6) * 1024;
+	}
+	std::ofstream("/proc/self/clear_refs") << "5";	//resets VmHWM
+#endif
+	return peak;
+}
+
+#endif
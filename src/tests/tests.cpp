@@ -1,6 +1,23 @@
 #include "..\persistence1d\persistence1d.hpp"
+#include "..\persistence1d\persistence1d_outofcore.hpp"
+#include "..\persistence1d\persistence1d_distances.hpp"
+#include "..\persistence1d\persistence1d_fixed.hpp"
+#include "..\persistence1d\persistence1d_server.hpp"
+#include "..\persistence1d\persistence1d_range.hpp"
+#include "..\persistence1d\persistence1d_trace.hpp"
+#include "..\persistence1d\persistence1d_snapshot.hpp"
+#include "..\persistence1d\persistence1d_scalespace.hpp"
+#include "..\persistence1d\persistence1d_approximate.hpp"
+#include "..\persistence1d\persistence1d_publisher.hpp"
+#include "..\persistence1d\persistence1d_columns.hpp"
+#include "..\persistence1d\persistence1d_dispatch.hpp"
+#include "peak_memory.hpp"
 #include <assert.h>
 #include <stdlib.h>
+#include <math.h>
+#include <fstream>
+#include <iterator>
+#include <string>
 
 using namespace std;
 using namespace p1d;
@@ -9,7 +26,7 @@ void SecondCallOnEmptyData()
 {
 	Persistence1D p;
 	vector<TPairedExtrema> pairs;
-	vector<int> min, max;
+	vector<TIndex> min, max;
 	vector<float> data1, data2; 
 
 	data1.push_back(1.0);
@@ -24,7 +41,7 @@ void SecondCallOnEmptyData()
 	p.GetExtremaIndices(min, max);
 	p.GetPairedExtrema(pairs);
 	float minVal = p.GetGlobalMinimumValue();
-	int idx = p.GetGlobalMinimumIndex();
+	TIndex idx = p.GetGlobalMinimumIndex();
 	
 	assert(minVal==0);
 	assert(idx ==-1);
@@ -39,7 +56,7 @@ void MutliCallPersistence()
 {
 	Persistence1D p;
 	vector<TPairedExtrema> pairs;
-	vector<int> min, max;
+	vector<TIndex> min, max;
 	vector<float> data1, data2; 
 
 	data1.push_back(1.0);
@@ -96,7 +113,7 @@ void RunOnEmptyData()
 {
 	Persistence1D p;
 	vector<TPairedExtrema> pairs;
-	vector<int> min, max;
+	vector<TIndex> min, max;
 	vector<float> data; 
 
 	p.RunPersistence(data);
@@ -126,7 +143,7 @@ void CallsBeforeRuns()
 {
 	Persistence1D p;
 	vector<TPairedExtrema> pairs;
-	vector<int> min, max;
+	vector<TIndex> min, max;
 	vector<float> data; 
 
 	p.GetExtremaIndices(min, max);
@@ -154,7 +171,7 @@ void TestInputSizeOne()
 {
 	Persistence1D p;
 	vector<TPairedExtrema> pairs;
-	vector<int> min, max;
+	vector<TIndex> min, max;
 
 	vector<float> data; 
 	data.push_back(10.0);
@@ -162,7 +179,7 @@ void TestInputSizeOne()
 	p.RunPersistence(data); 
 	p.GetPairedExtrema(pairs);
 	p.GetExtremaIndices(min, max);
-	int minIdx = p.GetGlobalMinimumIndex();
+	TIndex minIdx = p.GetGlobalMinimumIndex();
 	float minVal = p.GetGlobalMinimumValue();
 
 	assert(pairs.empty() && min.empty() && max.empty());
@@ -177,7 +194,7 @@ void TestInputSizeTwo()
 {
 	Persistence1D p;
 	vector<TPairedExtrema> pairs;
-	vector<int> min, max;
+	vector<TIndex> min, max;
 
 	vector<float> data; 
 	data.push_back(10.0);
@@ -186,7 +203,7 @@ void TestInputSizeTwo()
 	p.RunPersistence(data); 
 	p.GetPairedExtrema(pairs);
 	p.GetExtremaIndices(min, max);
-	int minIdx = p.GetGlobalMinimumIndex();
+	TIndex minIdx = p.GetGlobalMinimumIndex();
 	float minVal = p.GetGlobalMinimumValue();
 
 	assert(pairs.empty() && min.empty() && max.empty());
@@ -214,6 +231,1477 @@ void RandomizedTesting()
 	p.RunPersistence(data);
 	assert(p.VerifyResults());
 }
+void ThresholdedRunMatchesFiltering()
+{
+	vector<float> data; 
+	int size = rand() % 10000;
+	float threshold = (float)(rand() % (RAND_MAX/2));
+
+	for (int i = 0; i < size; i++)
+	{		
+		data.push_back((float)rand());
+	}
+
+	Persistence1D full, thresholded;
+	vector<TPairedExtrema> fullPairs, thresholdedPairs;
+
+	full.RunPersistence(data);
+	thresholded.RunPersistence(data, threshold);
+	full.GetPairedExtrema(fullPairs, threshold);
+	thresholded.GetPairedExtrema(thresholdedPairs);
+
+	assert(fullPairs.size() == thresholdedPairs.size());
+	for (size_t i = 0; i < fullPairs.size(); i++)
+	{
+		assert(fullPairs[i].MinIndex == thresholdedPairs[i].MinIndex);
+		assert(fullPairs[i].MaxIndex == thresholdedPairs[i].MaxIndex);
+		assert(fullPairs[i].Persistence == thresholdedPairs[i].Persistence);
+	}
+	assert(full.GetGlobalMinimumIndex() == thresholded.GetGlobalMinimumIndex());
+	assert(thresholded.VerifyResults());
+}
+/*!
+	Compares the attributes of two pairs if they are compiled in. All test data are integers, so sums are exact.
+*/
+void AssertSameAttributes(const TPairedExtrema& first, const TPairedExtrema& second)
+{
+#ifdef P1D_PAIR_ATTRIBUTES
+	assert(first.Width == second.Width);
+	assert(first.Area == second.Area);
+#else
+	(void)first;
+	(void)second;
+#endif
+}
+void OutOfCoreMatchesInMemory(const int dataType)
+{
+	vector<float> data; 
+	int size = rand() % 20000;
+
+	for (int i = 0; i < size; i++)
+	{
+		if (dataType == 0) data.push_back((float)rand());
+		else if (dataType == 1) data.push_back((float)(rand() % 10)); //many equal values
+		else data.push_back((float)((size - i) * (i % 2)));	//decreasing maxima - nothing resolves before the end
+	}
+
+	Persistence1D p;
+	Persistence1DOutOfCore ooc(4096); //tiny budget, forces spilling of regions and pairs
+	vector<TPairedExtrema> pairs, oocPairs;
+
+	p.RunPersistence(data);
+	p.GetPairedExtrema(pairs);
+
+	ooc.Begin();
+	for (size_t first = 0; first < data.size(); )
+	{
+		size_t count = std::min((size_t)(rand() % 1000), data.size() - first);
+		ooc.AddSamples(&data[0] + first, count);
+		first += count;
+	}
+	const bool ended = ooc.End();
+	assert(ended == !data.empty());
+	ooc.GetPairedExtrema(oocPairs);
+
+	assert(pairs.size() == oocPairs.size());
+	for (size_t i = 0; i < pairs.size(); i++)
+	{
+		assert(pairs[i].MinIndex == oocPairs[i].MinIndex);
+		assert(pairs[i].MaxIndex == oocPairs[i].MaxIndex);
+		assert(pairs[i].Persistence == oocPairs[i].Persistence);
+#ifdef P1D_PAIR_ATTRIBUTES
+		assert(oocPairs[i].Width == -1);
+#endif
+	}
+	assert(p.GetGlobalMinimumIndex() == ooc.GetGlobalMinimumIndex());
+	assert(p.GetGlobalMinimumValue() == ooc.GetGlobalMinimumValue());
+
+	float threshold = (float)(rand() % 100);
+	p.GetPairedExtrema(pairs, threshold, true);
+	ooc.GetPairedExtrema(oocPairs, threshold, true);
+	assert(pairs.size() == oocPairs.size());
+	assert(pairs.empty() || (pairs.front().MinIndex == oocPairs.front().MinIndex));
+}
+void AssertSameResults(Persistence1D& p1, Persistence1D& p2)
+{
+	vector<TPairedExtrema> pairs1, pairs2;
+	p1.GetPairedExtrema(pairs1);
+	p2.GetPairedExtrema(pairs2);
+
+	assert(pairs1.size() == pairs2.size());
+	for (size_t i = 0; i < pairs1.size(); i++)
+	{
+		assert(pairs1[i].MinIndex == pairs2[i].MinIndex);
+		assert(pairs1[i].MaxIndex == pairs2[i].MaxIndex);
+		assert(pairs1[i].Persistence == pairs2[i].Persistence);
+		AssertSameAttributes(pairs1[i], pairs2[i]);
+	}
+	assert(p1.GetGlobalMinimumIndex() == p2.GetGlobalMinimumIndex());
+	assert(p1.GetGlobalMinimumValue() == p2.GetGlobalMinimumValue());
+}
+void UpdateValuesMatchesFullRun()
+{
+	vector<float> data; 
+	int size = rand() % 2000 + 1;
+	int range = (rand() % 2) ? 20 : RAND_MAX;	//small range - many equal values
+	float threshold = (rand() % 2) ? 0 : (float)(range / 10);
+
+	for (int i = 0; i < size; i++)
+	{		
+		data.push_back((float)(rand() % range));
+	}
+
+	Persistence1D updated, full;
+	updated.RunPersistence(data, threshold);
+
+	for (int u = 0; u < 50; u++)
+	{
+		vector<TIndex> indices;
+		vector<float> values;
+		int numChanges = (u % 2) ? 1 : rand() % 10 + 1;
+		for (int c = 0; c < numChanges; c++)
+		{
+			indices.push_back(rand() % size);
+			values.push_back((float)(rand() % range));
+			data[indices.back()] = values.back();
+		}
+
+		const bool changed = (numChanges == 1) ? updated.UpdateValue(indices.front(), values.front()) 
+											   : updated.UpdateValues(indices, values);
+		assert(changed);
+
+		full.RunPersistence(data, threshold);
+		AssertSameResults(updated, full);
+	}
+
+	const bool outOfRange = updated.UpdateValue(size, 0);
+	assert(!outOfRange);
+	assert(updated.VerifyResults());
+
+	//a run which only reports pairs to a visitor has no pairs to update
+	TNullVisitor visitor;
+	Persistence1D streamed;
+	streamed.RunPersistence(data, visitor, false);
+	const bool streamedUpdated = streamed.UpdateValue(0, 0);
+	assert(!streamedUpdated);
+}
+void PersistenceCurveMatchesFiltering()
+{
+	vector<float> data; 
+	int size = rand() % 10000;
+	int range = (rand() % 2) ? 20 : RAND_MAX;	//small range - many equal persistence values
+
+	for (int i = 0; i < size; i++)
+	{		
+		data.push_back((float)(rand() % range));
+	}
+
+	Persistence1D p;
+	p.RunPersistence(data);
+
+	vector<float> thresholds;
+	for (int i = 0; i < 200; i++)
+	{
+		thresholds.push_back((float)(rand() % range));
+	}
+	thresholds.push_back(0);
+	sort(thresholds.begin(), thresholds.end());
+
+	vector<TIndex> counts(thresholds.size()), offsets(thresholds.size());
+	const bool computed = p.GetPersistenceCurve(&thresholds[0], thresholds.size(), &counts[0], &offsets[0]);
+	assert(computed);
+
+	vector<TPairedExtrema> all, pairs;
+	p.GetPairedExtrema(all);
+	for (size_t t = 0; t < thresholds.size(); t++)
+	{
+		p.GetPairedExtrema(pairs, thresholds[t]);
+		assert(counts[t] == (TIndex)pairs.size());
+		assert(offsets[t] + counts[t] == (TIndex)all.size());
+		assert(pairs.empty() || (all[offsets[t]].MinIndex == pairs.front().MinIndex));
+	}
+
+	if (thresholds.front() != thresholds.back())
+	{
+		//nothing is written for unsorted thresholds
+		reverse(thresholds.begin(), thresholds.end());
+		const vector<TIndex> previousCounts(counts), previousOffsets(offsets);
+		const bool unsorted = p.GetPersistenceCurve(&thresholds[0], thresholds.size(), &counts[0], &offsets[0]);
+		assert(!unsorted && counts == previousCounts && offsets == previousOffsets);
+	}
+}
+struct TCollectingVisitor
+{
+	vector<TPairedExtrema> Pairs;
+	int Created, Merged;
+
+	TCollectingVisitor() : Created(0), Merged(0) {}
+
+	void ComponentCreated(const TIndex /*minIdx*/, const float /*minValue*/) { Created++; }
+	void ComponentsMerged(const TIndex survivorMinIdx, const TIndex destroyedMinIdx, const TIndex /*maxIdx*/) 
+	{ 
+		assert(survivorMinIdx != destroyedMinIdx);
+		Merged++; 
+	}
+	void PairCreated(const TPairedExtrema& pair) { Pairs.push_back(pair); }
+};
+void VisitorMatchesStoredPairs()
+{
+	vector<float> data; 
+	int size = rand() % 10000;
+	float threshold = (rand() % 2) ? 0 : (float)(rand() % (RAND_MAX/2));
+
+	for (int i = 0; i < size; i++)
+	{		
+		data.push_back((float)rand());
+	}
+
+	Persistence1D p, streaming;
+	TCollectingVisitor visitor, streamingVisitor;
+	vector<TPairedExtrema> pairs, streamingPairs;
+
+	p.RunPersistence(data, visitor, true, threshold);
+	p.GetPairedExtrema(pairs);
+	sort(visitor.Pairs.begin(), visitor.Pairs.end());
+
+	assert(pairs.size() == visitor.Pairs.size());
+	for (size_t i = 0; i < pairs.size(); i++)
+	{
+		assert(pairs[i].MinIndex == visitor.Pairs[i].MinIndex);
+		assert(pairs[i].MaxIndex == visitor.Pairs[i].MaxIndex);
+		assert(pairs[i].Persistence == visitor.Pairs[i].Persistence);
+	}
+	assert(visitor.Created == visitor.Merged + (data.empty() ? 0 : 1));
+	
+	//pairs are only reported, nothing is stored
+	streaming.RunPersistence(data, streamingVisitor, false, threshold);
+	streaming.GetPairedExtrema(streamingPairs);
+	assert(streamingPairs.empty());
+	assert(streamingVisitor.Pairs.size() == visitor.Pairs.size());
+	assert(streaming.GetGlobalMinimumIndex() == p.GetGlobalMinimumIndex());
+}
+bool IsClose(const double a, const double b)
+{
+	return fabs(a - b) <= 1e-6 * std::max(1.0, std::max(fabs(a), fabs(b)));
+}
+void SummaryMatchesPairs()
+{
+	vector<float> data; 
+	int size = rand() % 10000;
+	int range = (rand() % 2) ? 20 : 1000;
+
+	for (int i = 0; i < size; i++)
+	{		
+		data.push_back((float)(rand() % range));
+	}
+
+	Persistence1D p, streaming;
+	const int numBins = 10;
+	PersistenceSummary summary(2, numBins, (float)range / 2, true);
+	vector<TPairedExtrema> pairs;
+	
+	p.RunPersistence(data);
+	p.GetPairedExtrema(pairs);
+	streaming.RunPersistence(data, summary, false);
+
+	double total = 0, squares = 0, entropy = 0;
+	float max = 0;
+	vector<TIndex> histogram(numBins, 0);
+	for (size_t i = 0; i < pairs.size(); i++)
+	{
+		total += pairs[i].Persistence;
+		squares += pairs[i].Persistence * pairs[i].Persistence;
+		max = std::max(max, pairs[i].Persistence);
+		histogram[std::min(numBins - 1, (int)(pairs[i].Persistence / ((float)range / 2) * numBins))]++;
+	}
+	for (size_t i = 0; i < pairs.size(); i++)
+	{
+		if (pairs[i].Persistence > 0) entropy -= pairs[i].Persistence / total * log(pairs[i].Persistence / total);
+	}
+
+	assert(summary.GetNumberOfPairs() == (TIndex)pairs.size());
+	assert(IsClose(summary.GetTotalPersistence(), total));
+	assert(IsClose(summary.GetPNorm(), sqrt(squares)));
+	assert(summary.GetMaxPersistence() == max);
+	assert(IsClose(summary.GetPersistentEntropy(), entropy));
+	assert(summary.GetHistogram() == histogram);
+	if (!pairs.empty())
+	{
+		//pairs are sorted according to persistence
+		float median = pairs[pairs.size()/2].Persistence;
+		if (pairs.size() % 2 == 0) median = (median + pairs[pairs.size()/2 - 1].Persistence) / 2;
+		assert(summary.GetMedianPersistence() == median);
+		assert(IsClose(summary.GetMeanPersistence(), total / pairs.size()));
+	}
+
+	//no histogram without a positive, finite upper limit
+	const float invalidMax[] = { 0, -1, std::numeric_limits<float>::infinity(), std::numeric_limits<float>::quiet_NaN() };
+	for (size_t m = 0; m < sizeof(invalidMax) / sizeof(invalidMax[0]); m++)
+	{
+		PersistenceSummary noHistogram(2, numBins, invalidMax[m]);
+		streaming.RunPersistence(data, noHistogram, false);
+		assert(noHistogram.GetHistogram().empty() && noHistogram.GetNumberOfPairs() == (TIndex)pairs.size());
+	}
+}
+/*!
+	Bottleneck (p = 0) or p-Wasserstein distance by trying all matchings of points and diagonal copies.
+*/
+double BruteForceDistance(const PersistenceDiagram& first, const PersistenceDiagram& second, const double p)
+{
+	const vector<TDiagramPoint>& A = first.GetPoints();
+	const vector<TDiagramPoint>& B = second.GetPoints();
+	const int n = (int)A.size(), m = (int)B.size();
+	double essential = fabs(first.GetEssentialBirth() - second.GetEssentialBirth());
+	
+	vector<int> columns(n + m);
+	for (int i = 0; i < n + m; i++) columns[i] = i;
+
+	double best = numeric_limits<double>::infinity();
+	do
+	{
+		double cost = (p == 0) ? essential : pow(essential, p);
+		for (int row = 0; row < n + m; row++)
+		{
+			int column = columns[row];
+			double d = 0;
+			if (row < n && column < m) d = std::max(fabs(A[row].Birth - B[column].Birth), fabs(A[row].Death - B[column].Death));
+			else if (row < n) d = A[row].Persistence / 2;
+			else if (column < m) d = B[column].Persistence / 2;
+			
+			if (p == 0) cost = std::max(cost, d);
+			else cost += pow(d, p);
+		}
+		best = std::min(best, cost);
+	} while (next_permutation(columns.begin(), columns.end()));
+
+	return (p == 0) ? best : pow(best, 1.0 / p);
+}
+void DistancesMatchBruteForce()
+{
+	const int numDiagrams = 6;
+	vector<PersistenceDiagram> diagrams(numDiagrams);
+	for (int d = 0; d < numDiagrams; d++)
+	{
+		vector<float> data; 
+		int size = rand() % 12 + 1;
+		int range = (rand() % 2) ? 5 : 1000;
+		for (int i = 0; i < size; i++)
+		{		
+			data.push_back((float)(rand() % range));
+		}
+
+		Persistence1D p;
+		p.RunPersistence(data);
+		const bool created = diagrams[d].Create(p, data);
+		assert(created);
+	}
+
+	PersistenceDiagramDistance distance;
+	const double infinity = numeric_limits<double>::infinity();
+	for (int i = 0; i < numDiagrams; i++)
+	{
+		assert(distance.Bottleneck(diagrams[i], diagrams[i]) == 0);
+		assert(distance.Wasserstein(diagrams[i], diagrams[i], 2) == 0);
+
+		for (int j = 0; j < numDiagrams; j++)
+		{
+			double bottleneck = distance.Bottleneck(diagrams[i], diagrams[j]);
+			assert(bottleneck == distance.Bottleneck(diagrams[j], diagrams[i]));
+			assert(bottleneck == BruteForceDistance(diagrams[i], diagrams[j], 0));
+			assert(IsClose(distance.Wasserstein(diagrams[i], diagrams[j], 1), BruteForceDistance(diagrams[i], diagrams[j], 1)));
+			assert(IsClose(distance.Wasserstein(diagrams[i], diagrams[j], 2), BruteForceDistance(diagrams[i], diagrams[j], 2)));
+			assert(distance.Wasserstein(diagrams[i], diagrams[j], 1) >= bottleneck);
+		}
+
+		vector<double> distances;
+		PersistenceDiagramDistance::ComputeDistances(diagrams[i], diagrams, distances, infinity, 3);
+		assert(distances.size() == diagrams.size());
+		for (int j = 0; j < numDiagrams; j++)
+		{
+			assert(distances[j] == distance.Bottleneck(diagrams[i], diagrams[j]));
+		}
+		PersistenceDiagramDistance::ComputeDistances(diagrams[i], diagrams, distances, 2);
+		for (int j = 0; j < numDiagrams; j++)
+		{
+			assert(distances[j] == distance.Wasserstein(diagrams[i], diagrams[j], 2));
+		}
+	}
+
+	//empty data has no essential point
+	PersistenceDiagram empty;
+	assert(distance.Bottleneck(empty, empty) == 0);
+	assert(distance.Bottleneck(empty, diagrams[0]) == infinity);
+}
+template <int N>
+void FixedMatchesPersistence1D()
+{
+	vector<float> data; 
+	int range = (rand() % 2) ? 5 : RAND_MAX;
+
+	for (int i = 0; i < N; i++)
+	{		
+		data.push_back((float)(rand() % range));
+	}
+
+	Persistence1D p;
+	Persistence1DFixed<N> fixed;
+	vector<TPairedExtrema> pairs;
+
+	p.RunPersistence(data);
+	p.GetPairedExtrema(pairs);
+	fixed.RunPersistence(&data[0]);
+
+	assert(fixed.GetNumberOfPairs() == (int)pairs.size());
+	for (size_t i = 0; i < pairs.size(); i++)
+	{
+		assert(pairs[i].MinIndex == fixed.GetPairedExtrema((int)i).MinIndex);
+		assert(pairs[i].MaxIndex == fixed.GetPairedExtrema((int)i).MaxIndex);
+		assert(pairs[i].Persistence == fixed.GetPairedExtrema((int)i).Persistence);
+		AssertSameAttributes(pairs[i], fixed.GetPairedExtrema((int)i));
+	}
+	assert(p.GetGlobalMinimumIndex() == fixed.GetGlobalMinimumIndex());
+	assert(p.GetGlobalMinimumValue() == fixed.GetGlobalMinimumValue());
+}
+#ifdef P1D_CONSTEXPR_ENABLED
+P1D_CONSTEXPR Persistence1DFixed<7> RunFixedAtCompileTime()
+{
+	std::array<float, 7> data = {{ 2, 8, 1, 4, 0, 6, 3 }};
+	Persistence1DFixed<7> p;
+	p.RunPersistence(data);
+	return p;
+}
+static_assert(RunFixedAtCompileTime().GetGlobalMinimumIndex() == 4, "global minimum at compile time");
+static_assert(RunFixedAtCompileTime().GetNumberOfPairs() == 3, "pairs at compile time");
+static_assert(RunFixedAtCompileTime().GetPairedExtrema(2).MinIndex == 0, "most persistent pair at compile time");
+static_assert(RunFixedAtCompileTime().GetPairedExtrema(2).MaxIndex == 1, "most persistent pair at compile time");
+#endif
+void LowMemoryMatchesPersistence1D()
+{
+	vector<float> data; 
+	int size = rand() % 10000;
+	int range = (rand() % 2) ? 5 : RAND_MAX;	//small range - many equal values
+	float threshold = (rand() % 2) ? 0 : (float)(range / 10);
+
+	for (int i = 0; i < size; i++)
+	{		
+		data.push_back((float)(rand() % range));
+	}
+
+	Persistence1D p, lowMemory;
+	p.RunPersistence(data, threshold);
+	lowMemory.RunPersistence(data);		//results of a previous run are replaced
+	const bool ran = lowMemory.RunPersistenceLowMemory(data.empty() ? NULL : &data[0], data.size(), threshold);
+	assert(ran == !data.empty());
+	
+	AssertSameResults(p, lowMemory);
+	assert(lowMemory.VerifyResults());
+	const bool updated = !data.empty() && lowMemory.UpdateValue(0, 0);
+	assert(!updated);
+#ifndef P1D_64BIT_INDICES
+	//fails before reading the data
+	const bool tooLarge = lowMemory.RunPersistenceLowMemory(data.empty() ? NULL : &data[0], (size_t)std::numeric_limits<TIndex>::max() + 2);
+	assert(!tooLarge);
+#endif
+}
+void RangeIndexMatchesSlices()
+{
+	vector<float> data; 
+	int size = rand() % 3000 + 1;
+	int range = (rand() % 2) ? 5 : RAND_MAX;	//small range - many equal values
+
+	for (int i = 0; i < size; i++)
+	{		
+		data.push_back((float)(rand() % range));
+	}
+
+	Persistence1DRangeIndex index;
+	const bool built = index.Build(data);
+	assert(built);
+	assert(index.GetNumberOfSamples() == data.size());
+
+	for (int q = 0; q < 20; q++)
+	{
+		TIndex first = rand() % size;
+		TIndex last = first + rand() % (size - first);
+		float threshold = (rand() % 2) ? 0 : (float)(range / 10);
+		bool matlabIndexing = (q % 2 == 1);
+
+		vector<float> slice(data.begin() + first, data.begin() + last + 1);
+		Persistence1D p;
+		p.RunPersistence(slice);
+		vector<TPairedExtrema> expected, pairs;
+		p.GetPairedExtrema(expected, threshold, matlabIndexing);
+
+		const bool found = index.GetPairedExtrema(first, last, pairs, threshold, matlabIndexing);
+		assert(found == !pairs.empty());
+		assert(pairs.size() == expected.size());
+		for (size_t i = 0; i < pairs.size(); i++)
+		{
+			assert(pairs[i].MinIndex == expected[i].MinIndex + first);
+			assert(pairs[i].MaxIndex == expected[i].MaxIndex + first);
+			assert(pairs[i].Persistence == expected[i].Persistence);
+			AssertSameAttributes(pairs[i], expected[i]);
+		}
+		assert(index.GetGlobalMinimumIndex(first, last, matlabIndexing) == p.GetGlobalMinimumIndex(matlabIndexing) + first);
+		assert(index.GetGlobalMinimumValue(first, last) == p.GetGlobalMinimumValue());
+	}
+
+	vector<TPairedExtrema> pairs;
+	const bool reversed = index.GetPairedExtrema(size - 1, 0, pairs);
+	const bool outOfRange = index.GetPairedExtrema(0, size, pairs);
+	assert(!reversed && !outOfRange);
+	assert(index.GetGlobalMinimumIndex(-1, 0) == -1);
+}
+void TracedRunMatchesPersistence1D()
+{
+	vector<float> data; 
+	int size = rand() % 10000 + 1;
+
+	for (int i = 0; i < size; i++)
+	{		
+		data.push_back((float)(rand() % 100));
+	}
+
+	TraceRecorder recorder;
+	TracedPersistence1D traced(recorder, "\"file\":\"a\\\"b\"");
+	Persistence1D p;
+	const bool tracedRun = traced.RunPersistence(data);
+	assert(tracedRun);
+	p.RunPersistence(data);
+	AssertSameResults(p, traced);
+
+	//RunPersistence, CreateIndexValueVector, Watershed, SortPairedExtrema
+	assert(recorder.GetNumberOfEvents() == 4);
+
+	//all overloads are traced, also through a reference to Persistence1D
+	TCollectingVisitor visitor;
+	Persistence1D& base = traced;
+	base.RunPersistence(&data[0], data.size(), visitor);
+	AssertSameResults(p, traced);
+	assert(recorder.GetNumberOfEvents() == 8);
+	{
+		ScopedTraceEvent none(NULL, "None", "test");
+	}
+	assert(recorder.GetNumberOfEvents() == 8);
+
+	const char * filename = "trace_test.json";
+	const bool written = recorder.WriteJson(filename);
+	assert(written);
+	ifstream file(filename);
+	string contents((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+	file.close();
+	remove(filename);
+
+	assert(contents.compare(0, 17, "{\"displayTimeUnit") == 0);
+	assert(contents.find("\"name\":\"Watershed\",\"cat\":\"persistence\",\"ph\":\"X\"") != string::npos);
+	assert(contents.find("\"args\":{\"file\":\"a\\\"b\"") != string::npos);
+	assert(EscapeJson("a\\b\"c\n") == "a\\\\b\\\"c ");
+}
+/*!
+	Inverts the bits of one byte of a file, so the byte is guaranteed to change - writing a fixed value 
+	leaves it unchanged whenever it already had that value.
+*/
+void InvertByte(const char * filename, const long long offset)
+{
+	fstream file(filename, ios::in | ios::out | ios::binary);
+	file.seekg(offset);
+	const char byte = (char)file.get();
+	file.seekp(offset);
+	file.put((char)~byte);
+}
+void SnapshotMatchesPersistence1D()
+{
+	vector<float> data; 
+	int size = rand() % 10000;
+	int range = (rand() % 2) ? 5 : RAND_MAX;	//small range - many equal values
+	float threshold = (rand() % 2) ? 0 : (float)(range / 10);
+	bool matlabIndexing = (rand() % 2) == 1;
+	bool storeMerges = (rand() % 2) == 1;
+
+	for (int i = 0; i < size; i++)
+	{		
+		data.push_back((float)(rand() % range));
+	}
+
+	Persistence1D p;
+	MergeHierarchyRecorder merges;
+	p.RunPersistence(data, merges);
+
+	const char * filename = "snapshot_test.p1d";
+	const bool saved = SaveSnapshot(filename, p, &data, storeMerges ? &merges.GetMerges() : NULL);
+	assert(saved);
+
+	PersistenceSnapshot snapshot;
+	const bool opened = snapshot.Open(filename);
+	const bool reopened = snapshot.Open(filename, false);	//reopening replaces the mapping
+	assert(opened && reopened);
+
+	vector<TPairedExtrema> expected, pairs;
+	vector<TIndex> expectedMin, expectedMax, min, max;
+	const bool expectedPairsFound = p.GetPairedExtrema(expected, threshold, matlabIndexing);
+	const bool pairsFound = snapshot.GetPairedExtrema(pairs, threshold, matlabIndexing);
+	assert(expectedPairsFound == pairsFound);
+	const bool expectedIndicesFound = p.GetExtremaIndices(expectedMin, expectedMax, threshold, matlabIndexing);
+	const bool indicesFound = snapshot.GetExtremaIndices(min, max, threshold, matlabIndexing);
+	assert(expectedIndicesFound == indicesFound);
+	assert(pairs.size() == expected.size());
+	for (size_t i = 0; i < pairs.size(); i++)
+	{
+		assert(pairs[i].MinIndex == expected[i].MinIndex);
+		assert(pairs[i].MaxIndex == expected[i].MaxIndex);
+		assert(pairs[i].Persistence == expected[i].Persistence);
+	}
+	assert(min == expectedMin && max == expectedMax);
+	assert(snapshot.GetGlobalMinimumIndex(matlabIndexing) == p.GetGlobalMinimumIndex(matlabIndexing));
+	assert(snapshot.GetGlobalMinimumValue() == p.GetGlobalMinimumValue());
+	assert(snapshot.GetNumberOfSamples() == data.size());
+	assert(snapshot.MatchesData(data));
+
+	assert(snapshot.HasMerges() == storeMerges);
+	assert(snapshot.GetNumberOfMerges() == (storeMerges ? merges.GetMerges().size() : 0));
+	for (size_t i = 0; i < snapshot.GetNumberOfMerges(); i++)
+	{
+		assert(snapshot.GetMerges()[i].MaxIndex == merges.GetMerges()[i].MaxIndex);
+		assert(snapshot.GetMerges()[i].DestroyedMinIndex == merges.GetMerges()[i].DestroyedMinIndex);
+	}
+
+	if (!data.empty())
+	{
+		data[0] = -data[0] - 1;
+		assert(!snapshot.MatchesData(data));
+	}
+	snapshot.Close();
+	assert(!snapshot.IsOpen() && snapshot.GetNumberOfPairs() == 0);
+
+	//a changed byte of the header or of the pairs fails the checksum, a truncated file fails in any case
+	InvertByte(filename, sizeof(TSnapshotHeader) - 1);
+	const bool headerChecked = snapshot.Open(filename);
+	const bool headerUnchecked = snapshot.Open(filename, false);
+	assert(!headerChecked && headerUnchecked);
+	snapshot.Close();
+	InvertByte(filename, sizeof(TSnapshotHeader) - 1);
+
+	const bool unchanged = snapshot.Open(filename);
+	assert(unchanged);
+	const size_t numberOfPairs = snapshot.GetNumberOfPairs();
+	snapshot.Close();
+	if (numberOfPairs > 0)
+	{
+		InvertByte(filename, (long long)AlignSnapshotOffset(sizeof(TSnapshotHeader)));
+		const bool pairsChecked = snapshot.Open(filename);
+		const bool pairsUnchecked = snapshot.Open(filename, false);
+		assert(!pairsChecked && pairsUnchecked);
+		snapshot.Close();
+	}
+
+	FILE * truncated = fopen(filename, "wb");
+	fwrite("P1DS", 1, 4, truncated);
+	fclose(truncated);
+	const bool truncatedOpened = snapshot.Open(filename, false);
+	remove(filename);
+	const bool missingOpened = snapshot.Open(filename);
+	assert(!truncatedOpened && !missingOpened);
+}
+void ScaleSpaceMatchesPersistence1D()
+{
+	vector<float> data; 
+	int size = rand() % 5000 + 1;
+	int range = (rand() % 2) ? 5 : RAND_MAX;	//small range - many equal values
+
+	for (int i = 0; i < size; i++)
+	{		
+		data.push_back((float)(rand() % range));
+	}
+
+	vector<float> sigmas;
+	int numScales = rand() % 8 + 1;
+	for (int s = 0; s < numScales; s++)
+	{
+		sigmas.push_back((float)(rand() % 40) / 4);
+	}
+	float threshold = (rand() % 2) ? 0 : (float)(range / 10);
+
+	PersistenceScaleSpace scaleSpace;
+	const bool ran = scaleSpace.Run(data, sigmas, 0, rand() % 4);
+	assert(ran);
+	assert(scaleSpace.GetNumberOfScales() == sigmas.size());
+
+	vector<float> smoothed(size);
+	for (size_t s = 0; s < sigmas.size(); s++)
+	{
+		PersistenceScaleSpace::Smooth(&data[0], size, sigmas[s], &smoothed[0]);
+
+		//compare smoothing to a direct convolution
+		const int radius = (int)ceil(SCALESPACE_KERNEL_TRUNCATE * sigmas[s]);
+		for (int i = 0; i < size; i += 1 + rand() % 10)
+		{
+			double sum = 0, weights = 0;
+			for (int k = -radius; k <= radius; k++)
+			{
+				double weight = (radius == 0) ? 1 : exp(-0.5 * k * k / ((double)sigmas[s] * sigmas[s]));
+				sum += weight * data[std::min(std::max(i + k, 0), size - 1)];
+				weights += weight;
+			}
+			assert(fabs(sum / weights - smoothed[i]) <= 1e-4 * range);
+		}
+
+		Persistence1D p;
+		p.RunPersistence(smoothed);
+		vector<TPairedExtrema> expected, pairs;
+		const bool expectedFound = p.GetPairedExtrema(expected, threshold, true);
+		const bool found = scaleSpace.GetPairedExtrema(s, pairs, threshold, true);
+		assert(expectedFound == found);
+		assert(pairs.size() == expected.size());
+		for (size_t i = 0; i < pairs.size(); i++)
+		{
+			assert(pairs[i].MinIndex == expected[i].MinIndex);
+			assert(pairs[i].MaxIndex == expected[i].MaxIndex);
+			assert(pairs[i].Persistence == expected[i].Persistence);
+		}
+		assert(scaleSpace.GetGlobalMinimumIndex(s) == p.GetGlobalMinimumIndex());
+		assert(scaleSpace.GetGlobalMinimumValue(s) == p.GetGlobalMinimumValue());
+		assert(scaleSpace.GetScale(s).Sigma == sigmas[s]);
+	}
+
+	//correspondences, against all extrema of the previous scale
+	vector<TExtremumMatch> matches;
+	const bool firstMatched = scaleSpace.GetCorrespondences(0, matches);
+	assert(!firstMatched);
+	for (size_t s = 1; s < sigmas.size(); s++)
+	{
+		TIndex maxDistance = (rand() % 2) ? -1 : rand() % 20;
+		const bool matched = scaleSpace.GetCorrespondences(s, matches, maxDistance);
+		assert(matched);
+
+		vector<TPairedExtrema> pairs, previousPairs;
+		scaleSpace.GetPairedExtrema(s, pairs);
+		scaleSpace.GetPairedExtrema(s - 1, previousPairs);
+		assert(matches.size() == 2 * pairs.size() + 1);
+
+		for (size_t m = 0; m < matches.size(); m++)
+		{
+			assert(m == 0 || matches[m-1].Index < matches[m].Index);
+
+			vector<TIndex> previous;
+			if (!matches[m].IsMaximum) previous.push_back(scaleSpace.GetGlobalMinimumIndex(s - 1));
+			for (size_t i = 0; i < previousPairs.size(); i++)
+			{
+				previous.push_back(matches[m].IsMaximum ? previousPairs[i].MaxIndex : previousPairs[i].MinIndex);
+			}
+
+			TIndex nearest = -1, nearestDistance = 0;
+			for (size_t i = 0; i < previous.size(); i++)
+			{
+				TIndex distance = (previous[i] > matches[m].Index) ? previous[i] - matches[m].Index : matches[m].Index - previous[i];
+				if (nearest == -1 || distance < nearestDistance || (distance == nearestDistance && previous[i] < nearest))
+				{
+					nearest = previous[i];
+					nearestDistance = distance;
+				}
+			}
+			if (maxDistance >= 0 && nearestDistance > maxDistance) nearest = -1;
+			assert(matches[m].PreviousIndex == nearest);
+		}
+	}
+
+	const float invalidSigmas[] = { -1, std::numeric_limits<float>::infinity(), std::numeric_limits<float>::quiet_NaN(), 
+									SCALESPACE_MAX_SIGMA * 2.0f, std::numeric_limits<float>::max() };
+	for (size_t s = 0; s < sizeof(invalidSigmas) / sizeof(invalidSigmas[0]); s++)
+	{
+		vector<float> invalid(1, invalidSigmas[s]);
+		const bool invalidRan = scaleSpace.Run(data, invalid);
+		assert(!invalidRan);
+		assert(scaleSpace.GetNumberOfScales() == 0);
+		const bool invalidSmoothed = PersistenceScaleSpace::Smooth(&data[0], size, invalidSigmas[s], &smoothed[0]);
+		assert(!invalidSmoothed);
+	}
+
+	//workspaces larger than any vector throw in the threads, and the exception reaches the caller
+	bool thrown = false;
+	try
+	{
+		scaleSpace.Run(&data[0], std::numeric_limits<size_t>::max() / 2, sigmas, 0, rand() % 4);
+	}
+	catch (const std::exception&)
+	{
+		thrown = true;
+	}
+	assert(thrown && scaleSpace.GetNumberOfScales() == 0);
+}
+void ApproximateWithinErrorBound()
+{
+	vector<float> data; 
+	int size = rand() % 20000 + 1;
+	int range = (rand() % 2) ? 5 : RAND_MAX;	//small range - many equal values
+	size_t blockSize = 1 + rand() % 64;
+
+	//random walk, so that blocks have smaller ranges than the data
+	float value = 0;
+	for (int i = 0; i < size; i++)
+	{		
+		value += (float)(rand() % range) - (float)(range / 2);
+		data.push_back(value);
+	}
+
+	Persistence1D p;
+	p.RunPersistence(data);
+	Persistence1DApproximate approximate;
+	const bool approximated = approximate.Run(data, blockSize, 0, rand() % 4);
+	assert(approximated);
+	assert(approximate.GetNumberOfSamples() == data.size());
+	assert(approximate.GetGlobalMinimumIndex() == p.GetGlobalMinimumIndex());
+	assert(approximate.GetGlobalMinimumValue() == p.GetGlobalMinimumValue());
+
+	vector<TPairedExtrema> expected, pairs;
+	p.GetPairedExtrema(expected);
+	approximate.GetPairedExtrema(pairs);
+	if (blockSize == 1)
+	{
+		assert(approximate.GetErrorBound() == 0);
+		assert(pairs.size() == expected.size());
+		for (size_t i = 0; i < pairs.size(); i++)
+		{
+			assert(pairs[i].MinIndex == expected[i].MinIndex);
+			assert(pairs[i].MaxIndex == expected[i].MaxIndex);
+			assert(pairs[i].Persistence == expected[i].Persistence);
+		}
+	}
+
+	//values at indices are data values, and in the bottleneck distance bound,
+	//the k-th largest persistence is off by at most twice the error bound
+	const double bound = 2.0 * approximate.GetErrorBound() + 1e-5 * fabs(value) + 1e-3 * range;
+	assert(pairs.size() <= expected.size());
+	for (size_t i = 0; i < pairs.size(); i++)
+	{
+		assert(pairs[i].Persistence == data[pairs[i].MaxIndex] - data[pairs[i].MinIndex]);
+	}
+	for (size_t i = 0; i < expected.size(); i++)
+	{
+		double approximatePersistence = (i < pairs.size()) ? pairs[pairs.size() - 1 - i].Persistence : 0;
+		assert(fabs(expected[expected.size() - 1 - i].Persistence - approximatePersistence) <= bound);
+	}
+
+	float threshold = (float)(rand() % (range * 5 + 1));
+	vector<TPairedExtrema> exactAbove, candidates;
+	p.GetPairedExtrema(exactAbove, threshold);
+	approximate.GetCandidatePairs(candidates, threshold, true);
+	assert(threshold <= 2 * approximate.GetErrorBound() || candidates.size() >= exactAbove.size());
+	assert(candidates.empty() || candidates[0].Persistence >= threshold - 2 * approximate.GetErrorBound());
+
+	const bool emptyBlocks = approximate.Run(data, 0);
+	assert(!emptyBlocks);
+	const bool pairsLeft = approximate.GetPairedExtrema(pairs);
+	assert(approximate.GetGlobalMinimumIndex() == -1 && !pairsLeft);
+#ifndef P1D_64BIT_INDICES
+	//fails before reading the data
+	const bool tooLarge = approximate.Run(&data[0], (size_t)std::numeric_limits<TIndex>::max() + 2);
+	assert(!tooLarge);
+#endif
+}
+void TakenResultMatchesPersistence1D()
+{
+	vector<float> data; 
+	int size = rand() % 10000;
+	int range = (rand() % 2) ? 5 : RAND_MAX;	//small range - many equal values
+	float threshold = (rand() % 2) ? 0 : (float)(range / 10);
+	bool matlabIndexing = (rand() % 2) == 1;
+
+	for (int i = 0; i < size; i++)
+	{		
+		data.push_back((float)(rand() % range));
+	}
+
+	Persistence1D p, taken;
+	p.RunPersistence(data);
+	taken.RunPersistence(data);
+	PersistenceResult result = taken.TakeResult();
+
+	vector<TPairedExtrema> expected, pairs;
+	vector<TIndex> expectedMin, expectedMax, min, max;
+	const bool expectedPairsFound = p.GetPairedExtrema(expected, threshold, matlabIndexing);
+	const bool pairsFound = result.GetPairedExtrema(pairs, threshold, matlabIndexing);
+	assert(expectedPairsFound == pairsFound);
+	const bool expectedIndicesFound = p.GetExtremaIndices(expectedMin, expectedMax, threshold, matlabIndexing);
+	const bool indicesFound = result.GetExtremaIndices(min, max, threshold, matlabIndexing);
+	assert(expectedIndicesFound == indicesFound);
+	assert(pairs.size() == expected.size());
+	for (size_t i = 0; i < pairs.size(); i++)
+	{
+		assert(pairs[i].MinIndex == expected[i].MinIndex);
+		assert(pairs[i].MaxIndex == expected[i].MaxIndex);
+		assert(pairs[i].Persistence == expected[i].Persistence);
+	}
+	assert(min == expectedMin && max == expectedMax);
+	assert(result.GetNumberOfPairs() - result.FindFirstPair(threshold) == pairs.size());
+	assert(result.GetGlobalMinimumIndex(matlabIndexing) == p.GetGlobalMinimumIndex(matlabIndexing));
+	assert(result.GetGlobalMinimumValue() == p.GetGlobalMinimumValue());
+	assert(result.GetNumberOfSamples() == data.size());
+
+	//the object is left without results, and can run again
+	const bool pairsLeft = taken.GetPairedExtrema(pairs);
+	assert(!pairsLeft && taken.GetGlobalMinimumIndex() == -1 && taken.GetNumberOfSamples() == 0);
+	const bool updated = taken.UpdateValue(0, 0);
+	assert(!updated);
+	taken.RunPersistence(data);
+	AssertSameResults(p, taken);
+
+	p.GetPairedExtrema(expected);
+	PersistenceResult moved(std::move(result));
+	assert(moved.GetNumberOfPairs() == expected.size() && result.GetNumberOfPairs() == 0);
+}
+void PairLookupMatchesPairs()
+{
+	const int size = rand() % 1000 + 1;
+	const int range = rand() % 100 + 1;
+	vector<float> data;
+	for (int i = 0; i < size; i++)
+	{
+		data.push_back((float)(rand() % range));
+	}
+
+	Persistence1D p;
+	p.RunPersistence(data, (rand() % 2) ? 0 : (float)(range / 10));
+	vector<TPairedExtrema> pairs;
+	p.GetPairedExtrema(pairs);
+	const TIndex globalMin = p.GetGlobalMinimumIndex();
+
+	vector<TIndex> expected(size, LOOKUP_NOT_PAIRED);
+	for (size_t i = 0; i < pairs.size(); i++)
+	{
+		expected[pairs[i].MinIndex] = expected[pairs[i].MaxIndex] = (TIndex)i;
+	}
+	expected[globalMin] = LOOKUP_GLOBAL_MINIMUM;
+
+	//the first queries of all threads build the lookup at the same time
+	const PersistenceResult result = p.TakeResult();
+	std::atomic<int> failures(0);
+	vector<std::thread> readers;
+	for (int r = 0; r < 4; r++)
+	{
+		readers.push_back(std::thread([&]()
+		{
+			for (TIndex i = -1; i <= (TIndex)size; i++)
+			{
+				const TIndex slot = result.FindPair(i);
+				if (slot != ((i < 0 || i == size) ? LOOKUP_NOT_PAIRED : expected[i])) failures++;
+
+				TPairedExtrema pair;
+				if (!result.GetPairOf(i, pair)) 
+				{
+					if (slot >= 0) failures++;
+				}
+				else if (slot < 0 || pair.Persistence != pairs[slot].Persistence) failures++;
+			}
+		}));
+	}
+	for (size_t r = 0; r < readers.size(); r++)
+	{
+		readers[r].join();
+	}
+	assert(failures == 0);
+	const size_t numberOfExtrema = result.GetLookup().GetNumberOfExtrema();
+	assert(numberOfExtrema == 2 * pairs.size() + 1);
+
+	//copies build their own lookup, moves take it along - FindPair builds the lookup, so it is called outside of assert
+	PersistenceResult copied(result);
+	const TIndex copiedSlot = copied.FindPair(globalMin);
+	assert(copiedSlot == LOOKUP_GLOBAL_MINIMUM);
+	PersistenceResult moved(std::move(copied));
+	const TIndex movedSlot = moved.FindPair(globalMin);
+	const TIndex movedFromSlot = copied.FindPair(globalMin);
+	assert(movedSlot == LOOKUP_GLOBAL_MINIMUM && movedFromSlot == LOOKUP_NOT_PAIRED);
+	moved = PersistenceResult();
+	const TIndex resetSlot = moved.FindPair(globalMin);
+	assert(resetSlot == LOOKUP_NOT_PAIRED);
+}
+void ColumnsMatchPersistence1D()
+{
+	const int numRows = rand() % 500 + 1;
+	const int numColumns = rand() % 8 + 1;
+	const bool hasHeader = (rand() % 2) == 1;
+	const char delimiter = (rand() % 2) ? ',' : '\t';
+	const string newline = (rand() % 2) ? "\n" : "\r\n";
+
+	//a timestamp, then numeric columns, with empty and malformed lines in between
+	vector<vector<float> > data(numColumns);
+	string text;
+	if (hasHeader)
+	{
+		text += "time";
+		for (int c = 0; c < numColumns; c++) text += delimiter + string("value") + to_string((long long)c);
+		text += newline;
+	}
+	for (int r = 0; r < numRows; r++)
+	{
+		text += "2024-01-01T" + to_string((long long)r);
+		for (int c = 0; c < numColumns; c++)
+		{
+			data[c].push_back((float)(rand() % 100) / 4);
+			text += delimiter + string(" ") + to_string((long double)data[c].back());
+		}
+		text += newline;
+
+		if (rand() % 50 == 0) text += newline;
+		if (rand() % 50 == 0) text += "not a number" + newline;
+		if (rand() % 50 == 0) text += "2024-01-01" + string(1, delimiter) + "x" + newline;	//not a number in any column
+	}
+
+	Persistence1DColumns columns;
+	const bool ran = columns.Run(text.c_str(), text.size(), delimiter, vector<size_t>(), 0, rand() % 4 + 1);
+	assert(ran);
+	assert(columns.GetNumberOfColumns() == (size_t)numColumns);
+	assert(columns.GetNumberOfRows() == (size_t)numRows);
+	for (int c = 0; c < numColumns; c++)
+	{
+		assert(columns.GetColumnPosition(c) == (size_t)c + 1);
+		assert(columns.GetColumnName(c) == (hasHeader ? "value" + to_string((long long)c) : string()));
+
+		Persistence1D p;
+		p.RunPersistence(data[c]);
+		vector<TPairedExtrema> expected, pairs;
+		p.GetPairedExtrema(expected);
+		columns.GetResult(c).GetPairedExtrema(pairs);
+		assert(pairs.size() == expected.size());
+		for (size_t i = 0; i < pairs.size(); i++)
+		{
+			assert(pairs[i].MinIndex == expected[i].MinIndex && pairs[i].MaxIndex == expected[i].MaxIndex);
+		}
+		assert(columns.GetResult(c).GetGlobalMinimumIndex() == p.GetGlobalMinimumIndex());
+	}
+
+	//selected columns, in order of position
+	vector<size_t> selected;
+	selected.push_back(numColumns);
+	selected.push_back(1);
+	const bool selectedRan = columns.Run(text.c_str(), text.size(), delimiter, selected);
+	assert(selectedRan);
+	assert(columns.GetNumberOfColumns() == (numColumns == 1 ? 1u : 2u) && columns.GetColumnPosition(0) == 1);
+	assert(columns.GetResult(columns.GetNumberOfColumns() - 1).GetNumberOfSamples() == (size_t)numRows);
+
+	selected.assign(1, 0);
+	const bool timestampRan = columns.Run(text.c_str(), text.size(), delimiter, selected);
+	const bool noNumbersRan = columns.Run("a,b\n", 4, ',');
+	assert(!timestampRan && !noNumbersRan);
+}
+void DispatcherMatchesPersistence1D()
+{
+	const int size = rand() % 3000 + 1;
+	const int kind = rand() % 3;
+	vector<float> data;
+	for (int i = 0; i < size; i++)
+	{
+		//small integers with plateaus and both zeros, noise with negative values, or a smooth curve
+		if (kind == 0) data.push_back((rand() % 2) ? (float)(rand() % 10) : -0.0f);
+		else if (kind == 1) data.push_back((float)rand() / RAND_MAX - 0.5f);
+		else data.push_back(sinf(i * 0.01f));
+	}
+	const float threshold = (rand() % 2) ? 0 : 0.1f;
+
+	Persistence1D expected;
+	expected.RunPersistence(data, threshold);
+
+	PersistenceDispatcher dispatcher;
+	dispatcher.SetThreads(rand() % 4 + 1);
+	dispatcher.SetKeepData(false);
+	for (int engine = ENGINE_AUTOMATIC; engine < NUMBER_OF_ENGINES; engine++)
+	{
+		const bool overridden = dispatcher.SetOverride(engine);
+		Persistence1D p;
+		const bool dispatched = dispatcher.RunPersistence(p, data, threshold);
+		assert(overridden && dispatched);
+		assert(dispatcher.GetLastEngine() == (engine == ENGINE_AUTOMATIC ? dispatcher.ChooseEngine(dispatcher.GetLastProfile()) : engine));
+		assert(p.GetSortMethod() == SORT_COMPARISON);
+		AssertSameResults(expected, p);
+	}
+	const bool invalidOverridden = dispatcher.SetOverride(NUMBER_OF_ENGINES);
+	assert(!invalidOverridden);
+
+	//the sort method and sort function of p are restored after the run
+	Persistence1D custom;
+	const bool customSet = custom.SetSortMethod(SORT_CUSTOM, [](vector<TIdxAndData>& vertices) { ParallelSort(vertices, 2); });
+	const bool customWithoutFunctionSet = custom.SetSortMethod(SORT_CUSTOM);
+	assert(customSet && !customWithoutFunctionSet);
+	dispatcher.SetOverride(ENGINE_RADIX_SORT);
+	const bool customRun = dispatcher.RunPersistence(custom, data, threshold);
+	assert(customRun);
+	assert(custom.GetSortMethod() == SORT_CUSTOM && custom.GetSortFunction());
+	AssertSameResults(expected, custom);
+	custom.RunPersistence(data, threshold);
+	AssertSameResults(expected, custom);
+
+	const TInputProfile profile = dispatcher.GetLastProfile();
+	assert(profile.Size == (size_t)size);
+	assert(kind != 0 || (profile.MinValue >= 0 && profile.MaxValue <= 9 && profile.RadixPasses <= 3));
+	assert(kind != 2 || size < 1000 || profile.ExtremaFraction < 0.1f);
+
+	//data is kept unless allowed otherwise
+	dispatcher.SetOverride(ENGINE_AUTOMATIC);
+	dispatcher.SetKeepData(true);
+	assert(dispatcher.ChooseEngine(profile) != ENGINE_CRITICAL_POINTS);
+}
+void WarmStartMatchesColdRun()
+{
+	int size = rand() % 2000 + 1;
+	const bool integers = (rand() % 2) == 1;	//many equal values
+	vector<float> data;
+	for (int i = 0; i < size; i++)
+	{
+		data.push_back(integers ? (float)(rand() % 20) : (float)rand() / RAND_MAX);
+	}
+
+	Persistence1D warm, cold;
+	const bool warmSet = warm.SetSortMethod(SORT_WARM_START);
+	assert(warmSet && warm.GetSortMethod() == SORT_WARM_START);
+	for (int frame = 0; frame < 20; frame++)
+	{
+		const float threshold = (rand() % 2) ? 0 : 0.1f;
+		warm.RunPersistence(data, threshold);
+		cold.RunPersistence(data, threshold);
+		AssertSameResults(cold, warm);
+
+		//perturb some values by a little or by a lot, sometimes change the size
+		const int numChanges = rand() % (size + 1);
+		const float magnitude = (rand() % 2) ? 0.01f : 1.0f;
+		for (int c = 0; c < numChanges; c++)
+		{
+			const int i = rand() % size;
+			data[i] = integers ? (float)(rand() % 20) : data[i] + magnitude * ((float)rand() / RAND_MAX - 0.5f);
+		}
+		if (rand() % 5 == 0)
+		{
+			size = rand() % 2000 + 1;
+			data.resize(size, 0.5f);
+		}
+		if (rand() % 10 == 0) warm.TakeResult();
+	}
+}
+void PublisherServesConcurrentReaders()
+{
+	//result of version v has v*10 samples, so readers can check each result they get
+	const int numVersions = 200;
+	vector<vector<float> > data(numVersions + 1);
+	vector<size_t> expectedPairs(numVersions + 1);
+	vector<TIndex> expectedMin(numVersions + 1);
+	for (int v = 1; v <= numVersions; v++)
+	{
+		for (int i = 0; i < v * 10; i++) data[v].push_back((float)(rand() % 100));
+
+		Persistence1D p;
+		vector<TPairedExtrema> pairs;
+		p.RunPersistence(data[v]);
+		p.GetPairedExtrema(pairs);
+		expectedPairs[v] = pairs.size();
+		expectedMin[v] = p.GetGlobalMinimumIndex();
+	}
+
+	ResultPublisher publisher;
+	const bool validBeforePublish = publisher.Acquire().IsValid();
+	assert(!validBeforePublish);
+
+	const int numReaders = 4;
+	std::atomic<bool> done(false);
+	std::atomic<int> failures(0);
+	vector<std::thread> readers;
+	for (int r = 0; r < numReaders; r++)
+	{
+		readers.push_back(std::thread([&]()
+		{
+			unsigned long long lastVersion = 0;
+			PublishedResult held;
+			while (!done)
+			{
+				PublishedResult result = publisher.Acquire();
+				if (!result.IsValid()) continue;
+
+				const unsigned long long v = result.GetVersion();
+				if (v < lastVersion || result->GetNumberOfSamples() != v * 10 ||
+					result->GetNumberOfPairs() != expectedPairs[v] || result->GetGlobalMinimumIndex() != expectedMin[v])
+				{
+					failures++;
+				}
+				lastVersion = v;
+				if (v % 16 == 0) held = result;		//keep some results while newer ones are published
+				if (held.IsValid() && held->GetNumberOfSamples() != held.GetVersion() * 10) failures++;
+			}
+		}));
+	}
+
+	Persistence1D p;
+	for (int v = 1; v <= numVersions; v++)
+	{
+		p.RunPersistence(data[v]);
+		const unsigned long long version = publisher.Publish(p);
+		assert(version == (unsigned long long)v);
+	}
+	done = true;
+	for (size_t r = 0; r < readers.size(); r++)
+	{
+		readers[r].join();
+	}
+
+	assert(failures == 0);
+	const unsigned long long latestVersion = publisher.Acquire().GetVersion();
+	assert(latestVersion == (unsigned long long)numVersions);
+	assert(publisher.GetNumberOfNodes() <= (size_t)numReaders * 2 + 1);
+
+	PublishedResult first = publisher.Acquire();
+	PublishedResult copy = first;
+	PublishedResult moved(std::move(copy));
+	assert(!copy.IsValid() && moved.IsValid() && moved->GetNumberOfPairs() == expectedPairs[numVersions]);
+	moved.Release();
+	assert(!moved.IsValid() && first.IsValid());
+}
+void SimplifyKeepsPersistentPairs()
+{
+	vector<float> data; 
+	int size = rand() % 10000 + 1;
+	int range = (rand() % 2) ? 5 : 1000;	//small range - many equal values
+
+	for (int i = 0; i < size; i++)
+	{		
+		data.push_back((float)(rand() % range));
+	}
+
+	Persistence1D p;
+	p.RunPersistence(data);
+
+	float thresholds[3] = { (float)(rand() % range), (float)(range / 10), 0 };
+	if (thresholds[1] > thresholds[0]) thresholds[1] = thresholds[0];
+	vector<vector<float> > outputs(3, vector<float>(size));
+	float * outs[3] = { &outputs[0][0], &outputs[1][0], &outputs[2][0] };
+	const bool simplifiedAll = p.Simplify(thresholds, 3, outs);
+	assert(simplifiedAll);
+
+	for (int t = 0; t < 3; t++)
+	{
+		//same as a single threshold
+		vector<float> single(size);
+		const bool simplifiedSingle = p.Simplify(thresholds[t], &single[0]);
+		assert(simplifiedSingle);
+		assert(single == outputs[t]);
+
+		for (int i = 0; i < size; i++)
+		{
+			assert(fabs(outputs[t][i] - data[i]) <= thresholds[t] / 2);
+		}
+
+		//the output has the kept pairs, and pairs with persistence 0
+		Persistence1D simplified;
+		simplified.RunPersistence(outputs[t]);
+		vector<TPairedExtrema> expected, pairs;
+		p.GetPairedExtrema(expected, std::max(thresholds[t], std::numeric_limits<float>::min()));
+		simplified.GetPairedExtrema(pairs, std::numeric_limits<float>::min());
+		assert(pairs.size() == expected.size());
+		for (size_t i = 0; i < pairs.size(); i++)
+		{
+			assert(pairs[i].MinIndex == expected[i].MinIndex);
+			assert(pairs[i].MaxIndex == expected[i].MaxIndex);
+			assert(pairs[i].Persistence == expected[i].Persistence);
+		}
+		assert(simplified.GetGlobalMinimumIndex() == p.GetGlobalMinimumIndex());
+	}
+	assert(outputs[2] == data);
+
+	float ascending[2] = { 0, 1 };
+	const bool unsorted = p.Simplify(ascending, 2, outs);
+	const bool negative = p.Simplify(-1, outs[0]);
+	p.RunPersistence(data, (float)range);
+	const bool belowRunThreshold = p.Simplify(0, outs[0]);
+	assert(!unsorted && !negative && !belowRunThreshold);
+}
+#ifdef P1D_PAIR_ATTRIBUTES
+///Order of vertices in Persistence1D, see TIdxAndData.
+bool IsVertexLess(const vector<float>& data, const TIndex first, const TIndex second)
+{
+	return (data[first] < data[second] || (data[first] == data[second] && first < second));
+}
+void PairAttributesMatchBruteForce()
+{
+	vector<float> data; 
+	int size = rand() % 2000;
+	int range = (rand() % 2) ? 5 : RAND_MAX;	//small range - many equal values
+
+	for (int i = 0; i < size; i++)
+	{		
+		data.push_back((float)(rand() % range));
+	}
+
+	Persistence1D p;
+	vector<TPairedExtrema> pairs;
+	p.RunPersistence(data);
+	p.GetPairedExtrema(pairs);
+
+	for (vector<TPairedExtrema>::const_iterator it = pairs.begin(); it != pairs.end(); it++)
+	{
+		//with equal values, the maximum may be returned as the minimum - the maximum is the inner vertex 
+		//which is larger than both neighbors in the order of values and indices
+		TIndex max = (*it).MaxIndex, min = (*it).MinIndex;
+		if (max == 0 || max == size - 1 || IsVertexLess(data, max, max - 1) || IsVertexLess(data, max, max + 1)) std::swap(min, max);
+
+		const TIndex step = (min < max) ? -1 : 1;
+		TIndex width = 0;
+		double area = 0;
+		for (TIndex i = max + step; i >= 0 && i < size && IsVertexLess(data, i, max); i += step)
+		{
+			width++;
+			area += data[i];
+		}
+		assert((*it).Width == width);
+		assert((*it).Area == area);
+	}
+}
+#endif
+#ifdef __linux__
+void LowMemoryPeakMemory()
+{
+	const size_t size = 1 << 24;
+	vector<float> data(size);
+	for (size_t i = 0; i < size; i++)
+	{
+		data[i] = (float)rand();
+	}
+
+	Persistence1D p;
+	GetPeakMemorySinceLastCall();
+	size_t before = GetPeakMemorySinceLastCall();
+	p.RunPersistenceLowMemory(&data[0], size);
+	size_t peak = GetPeakMemorySinceLastCall();
+	
+	//VmHWM cannot be reset on some systems, and then says nothing
+	if (peak <= before) return;
+
+	//two indices per value of working memory, plus results - attributes add two indices and a sum per minimum, 
+	//and at most every second value is a minimum
+	vector<TPairedExtrema> pairs;
+	p.GetPairedExtrema(pairs);
+	size_t results = pairs.size() * sizeof(TPairedExtrema);
+	size_t bytesPerValue = 2 * sizeof(TIndex);
+#ifdef P1D_PAIR_ATTRIBUTES
+	bytesPerValue += (2 * sizeof(TIndex) + sizeof(double)) / 2;
+#endif
+	cout << "LowMemoryPeakMemory: " << (double)(peak - before - results) / size << " bytes per value" << endl;
+	assert(peak - before < bytesPerValue * size + results + (1 << 20));
+}
+#endif
+void ResultCacheDropsLeastRecentlyUsed()
+{
+	//FNV-1a test vectors
+	assert(HashBytes("", 0) == 14695981039346656037ULL);
+	assert(HashBytes("a", 1) == 0xaf63dc4c8601ec8cULL);
+	assert(HashBytes("b", 1, HashBytes("a", 1)) == HashBytes("ab", 2));
+
+	//SHA-256 test vectors, the last one has padding in a second block
+	const char * messages[3] = { "", "abc", "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq" };
+	const char * digests[3] = { "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855",
+								"ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad",
+								"248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1" };
+	for (int m = 0; m < 3; m++)
+	{
+		unsigned char digest[SERVER_DIGEST_SIZE];
+		DigestBytes(messages[m], strlen(messages[m]), digest);
+		string hex;
+		for (int i = 0; i < SERVER_DIGEST_SIZE; i++)
+		{
+			hex += "0123456789abcdef"[digest[i] >> 4];
+			hex += "0123456789abcdef"[digest[i] & 15];
+		}
+		assert(hex == digests[m]);
+	}
+
+	ResultCache cache(2);
+	TCacheKey keys[3];
+	string contents[3];
+	std::shared_ptr<const PersistenceResult> results[3];
+	for (int i = 0; i < 3; i++)
+	{
+		vector<float> data(10 + i, (float)i);
+		contents[i].assign((const char *)&data[0], data.size() * sizeof(float));
+		DigestBytes(contents[i].data(), contents[i].size(), keys[i].Digest);
+		keys[i].Size = contents[i].size();
+		keys[i].IsPath = false;
+
+		Persistence1D p;
+		p.RunPersistence(data);
+		results[i] = std::make_shared<const PersistenceResult>(p.TakeResult());
+	}
+
+	//Find marks hits as recently used, so it is called outside of assert
+	std::shared_ptr<const PersistenceResult> found = cache.Find(keys[0]);
+	assert(!found);
+	cache.Add(keys[0], results[0]);
+	cache.Add(keys[1], results[1]);
+	found = cache.Find(keys[0]);	//keys[1] is now least recently used
+	assert(found == results[0]);
+
+	cache.Add(keys[2], results[2]);
+	assert(cache.GetNumberOfEntries() == 2);
+	found = cache.Find(keys[0]);
+	assert(found == results[0]);
+	found = cache.Find(keys[1]);
+	assert(!found);
+	found = cache.Find(keys[2]);
+	assert(found == results[2]);
+
+	//results stay valid after they are dropped
+	assert(results[1]->GetGlobalMinimumIndex() == 0);
+	
+	keys[2].IsPath = true;
+	found = cache.Find(keys[2]);
+	assert(!found);
+
+	//data of the same size which differs in one bit is a miss
+	string changed(contents[0]);
+	changed[0] ^= 1;
+	TCacheKey changedKey = keys[0];
+	DigestBytes(changed.data(), changed.size(), changedKey.Digest);
+	found = cache.Find(changedKey);
+	assert(!found);
+	found = cache.Find(keys[0]);
+	assert(found == results[0]);
+}
+#ifdef P1D_64BIT_INDICES
+/*!
+	Streams more than 2^31 values of a sawtooth with decreasing minima through Persistence1DOutOfCore.
+	Each tooth of the sawtooth has a pair with the same persistence, the last minimum is the global minimum.
+*/
+void OutOfCoreBeyond32BitIndices()
+{
+	const long long period = 1 << 24;
+	const long long numTeeth = 129;
+	const long long size = numTeeth * period + 1000;
+	assert(size > (1LL << 31));
+
+	Persistence1DOutOfCore ooc;
+	vector<float> chunk(1 << 20);
+	ooc.Begin();
+	for (long long first = 0; first < size; first += chunk.size())
+	{
+		size_t count = (size_t)std::min((long long)chunk.size(), size - first);
+		for (size_t i = 0; i < count; i++)
+		{
+			long long idx = first + i;
+			chunk[i] = (float)(idx % period - idx / period);
+		}
+		ooc.AddSamples(&chunk[0], count);
+	}
+	const bool ended = ooc.End();
+	assert(ended);
+
+	assert(ooc.GetNumberOfSamples() == (size_t)size);
+	assert(ooc.GetNumberOfPairs() == (size_t)numTeeth);
+	assert(ooc.GetGlobalMinimumIndex() == numTeeth * period);
+	assert(ooc.GetGlobalMinimumValue() == (float)-numTeeth);
+
+	vector<TPairedExtrema> pairs;
+	ooc.GetPairedExtrema(pairs);
+	for (long long k = 0; k < numTeeth; k++)
+	{
+		assert(pairs[k].MinIndex == k * period);
+		assert(pairs[k].MaxIndex == k * period + period - 1);
+		assert(pairs[k].Persistence == (float)(period - 1));
+	}
+}
+#endif
 int main()
 {
 	TestInputSizeOne();
@@ -226,6 +1714,110 @@ int main()
 	{
 		RandomizedTesting();
 	}
+	for (int i = 0; i < 100; i++)
+	{
+		ThresholdedRunMatchesFiltering();
+	}
+	for (int i = 0; i < 30; i++)
+	{
+		OutOfCoreMatchesInMemory(i % 3);
+	}
+	for (int i = 0; i < 100; i++)
+	{
+		UpdateValuesMatchesFullRun();
+	}
+	for (int i = 0; i < 100; i++)
+	{
+		VisitorMatchesStoredPairs();
+	}
+	for (int i = 0; i < 100; i++)
+	{
+		PersistenceCurveMatchesFiltering();
+	}
+	for (int i = 0; i < 100; i++)
+	{
+		SummaryMatchesPairs();
+	}
+	for (int i = 0; i < 20; i++)
+	{
+		DistancesMatchBruteForce();
+	}
+	for (int i = 0; i < 100; i++)
+	{
+		FixedMatchesPersistence1D<1>();
+		FixedMatchesPersistence1D<2>();
+		FixedMatchesPersistence1D<3>();
+		FixedMatchesPersistence1D<16>();
+		FixedMatchesPersistence1D<17>();
+		FixedMatchesPersistence1D<64>();
+		FixedMatchesPersistence1D<200>();
+		FixedMatchesPersistence1D<256>();
+	}
+	ResultCacheDropsLeastRecentlyUsed();
+	for (int i = 0; i < 100; i++)
+	{
+		LowMemoryMatchesPersistence1D();
+	}
+	for (int i = 0; i < 100; i++)
+	{
+		RangeIndexMatchesSlices();
+	}
+	for (int i = 0; i < 10; i++)
+	{
+		TracedRunMatchesPersistence1D();
+	}
+	for (int i = 0; i < 30; i++)
+	{
+		ScaleSpaceMatchesPersistence1D();
+	}
+	for (int i = 0; i < 100; i++)
+	{
+		ApproximateWithinErrorBound();
+	}
+	for (int i = 0; i < 100; i++)
+	{
+		TakenResultMatchesPersistence1D();
+	}
+	for (int i = 0; i < 100; i++)
+	{
+		PairLookupMatchesPairs();
+	}
+	for (int i = 0; i < 100; i++)
+	{
+		ColumnsMatchPersistence1D();
+	}
+	for (int i = 0; i < 100; i++)
+	{
+		DispatcherMatchesPersistence1D();
+	}
+	for (int i = 0; i < 100; i++)
+	{
+		WarmStartMatchesColdRun();
+	}
+	for (int i = 0; i < 5; i++)
+	{
+		PublisherServesConcurrentReaders();
+	}
+	for (int i = 0; i < 100; i++)
+	{
+		SimplifyKeepsPersistentPairs();
+	}
+	for (int i = 0; i < 30; i++)
+	{
+		SnapshotMatchesPersistence1D();
+	}
+#ifdef __linux__
+	LowMemoryPeakMemory();
+#endif
+#ifdef P1D_64BIT_INDICES
+	OutOfCoreBeyond32BitIndices();
+#endif
+#ifdef P1D_PAIR_ATTRIBUTES
+	for (int i = 0; i < 100; i++)
+	{
+		PairAttributesMatchBruteForce();
+	}
+#endif
 	return 0;
 }
 